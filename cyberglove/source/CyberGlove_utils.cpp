@@ -1,10 +1,15 @@
 #include "CyberGlove.h"
 #include "CyberGlove_utils.h"
+#include "crossplatform.h"
+#include "pubsub.h"
+#include "timing.h"
 #include <Windows.h>
 #include <stdio.h>
 #include <math.h>
+#include <chrono>
 
 static CyberGlove* persistentGlove = NULL;
+static mjPublisher* persistentPublisher = NULL;
 cgData cgdata;
 cgOption option;
 
@@ -426,14 +431,26 @@ cgOption * readOptions(const char* filename)
 	// Hand
 	util_config(filename, "char* modelFile", &option.modelFile);
 	util_config(filename, "char* logFile", &option.logFile);
+	util_config(filename, "int logSlots", &option.logSlots);
+	util_config(filename, "int logChunk", &option.logChunk);
+	util_config(filename, "int logSync", &option.logSync);
+	util_config(filename, "char* logStreams", &option.logStreams);
+	util_config(filename, "bool logSession", &option.logSession);
 	util_config(filename, "int calibSenor_n", &option.calibSenor_n);
 	util_config(filename, "char* driver_ip", &option.driver_ip);
 	util_config(filename, "char* driver_port", &option.driver_port);
+	util_config(filename, "int reconnect_min", &option.reconnect_min);
+	util_config(filename, "int reconnect_max", &option.reconnect_max);
 
 	// Mujoco
 	util_config(filename, "char* viz_ip", &option.viz_ip);
+	util_config(filename, "int loop_timeout", &option.loop_timeout);
 	util_config(filename, "int skip", &option.skip);
 
+	// Telemetry
+	util_config(filename, "char* pubsub_port", &option.pubsub_port);
+	util_config(filename, "int pubsub_queue", &option.pubsub_queue);
+
 	// Calibration 
 	util_config(filename, "char* calibFile", &option.calibFile);
 	util_config(filename, "char* userRangeFile", &option.userRangeFile);
@@ -495,6 +512,15 @@ void cGlove_clean(char* errorInfo)
 		}
 		printf("cGlove:>\t Glove update thread exited\n");
 	}
+
+	// stop telemetry
+	if(persistentPublisher != NULL)
+	{
+		printf("cGlove:>\t Telemetry: %lld samples published, %lld dropped\n",
+			persistentPublisher->getNPublished(), persistentPublisher->getNDropped());
+		delete persistentPublisher;
+	}
+	persistentPublisher = NULL;
 	
 	// remove glove
 	if(persistentGlove != NULL)
@@ -544,17 +570,24 @@ void cGlove_connect(cgOption* o)
 void cGlove_update(cgData* d, cgOption* o)
 {
 	printf("cGlove:>\t cGlove update thread started\n");
+	mjTimerThreadName("glove");
 
 	cgNum* calibSample_local = (cgNum*)util_malloc(100000+sizeof(cgNum)*o->calibSenor_n, 8); // Mujoco convension 
 	int n_samples = persistentGlove->SampleSize();
 	static std::vector<unsigned int> inputSample(n_samples);
 
+	// telemetry message: seq, time, calibrated sample
+	long long seq = 0;
+	char* msg = (char*)util_malloc(CG_MSG_SIZE(o->calibSenor_n), 8);
+
 	// start streaming and start update loop
 	persistentGlove->StartStreaming(o->HIRES_DATA);
 	while(d->updateGlove)
 	{
+		double tm;
 		try
 		{
+			mjTIMER("glove sample");
 			if(o->HIRES_DATA)
 				persistentGlove->GetHiResSample(&inputSample.front(),	persistentGlove->SampleSize(), d->timestamp);
 			else
@@ -564,6 +597,8 @@ void cGlove_update(cgData* d, cgOption* o)
 		{
 			printf("cGlove:>\t Error getting sample:: %s\n", name.what());
 		}
+		tm = mjTimeSec();	// sample arrival, on the time base shared with physics/render/logs
+		mjTIMER("glove process");
 
 		// Note : No mutex: partial info can be read by the graphics  
 		for (int s=0; s<n_samples; s++)
@@ -578,13 +613,26 @@ void cGlove_update(cgData* d, cgOption* o)
 		cGlove_nrmRawSample(d->rawSample_nrm, d->rawSample, d->userRangeMat, o->rawSenor_n);
 		cGlove_calibrateNrmSample(calibSample_local, d->rawSample_nrm, d->handRangeMat, d->calibMat, o->calibSenor_n, o->rawSenor_n);
 
-		// update
+		// update, wake up waiting consumers
 		d->cgGlove.lock();
 		memcpy(d->calibSample, calibSample_local, o->calibSenor_n*sizeof(cgNum));
+		d->seq++;
 		d->cgGlove.unlock();
+		d->cgNew.notify_all();
+
+		// broadcast to subscribers (copy only, never waits on the network)
+		if(persistentPublisher)
+		{
+			memcpy(msg, &seq, sizeof(long long));
+			memcpy(msg+sizeof(long long), &tm, sizeof(double));
+			memcpy(msg+sizeof(long long)+sizeof(double), calibSample_local, o->calibSenor_n*sizeof(cgNum));
+			persistentPublisher->publish(msg);
+			seq++;
+		}
 	}
 
 	// Clear buffers
+	util_free(msg);
 	util_free(calibSample_local);
 	printf("cGlove:>\t cGlove update thread exiting\n");
 }
@@ -599,6 +647,19 @@ void cGlove_update(cgData* d, cgOption* o)
 	// make cgdata
 	cGlove_initData(&cgdata, &option);
 
+	// start telemetry server
+	if(strcmp(option.pubsub_port, "none")!=0)
+	{
+		persistentPublisher = new mjPublisher();
+		persistentPublisher->verbose = true;
+		if(!persistentPublisher->start(option.pubsub_port, CG_MSG_SIZE(option.calibSenor_n), option.pubsub_queue))
+		{
+			util_warning("Couldn't start telemetry server. Continuing without it.");
+			delete persistentPublisher;
+			persistentPublisher = NULL;
+		}
+	}
+
 	// start thread for fast udpate
 	cgdata.updateGlove = true;
 	cgdata.glove_th = std::thread(cGlove_update, &cgdata, &option);
@@ -620,3 +681,19 @@ void cGlove_getData(cgNum *buff, const int n_buff)
 	cgdata.cgGlove.unlock();
 }
 
+
+// Wait for a sample newer than seq
+long long cGlove_waitData(cgNum *buff, const int n_buff, long long seq, int tmout)
+{
+	if(n_buff<option.calibSenor_n)
+	{
+		printf("Warning:: Buffer too small to update. Minimum size should be %d", option.calibSenor_n);
+		return seq;
+	}
+	std::unique_lock<std::mutex> lock(cgdata.cgGlove);
+	if(!cgdata.cgNew.wait_for(lock, std::chrono::milliseconds(tmout), [seq]{return cgdata.seq!=seq;}))
+		return seq;
+	memcpy(buff, cgdata.calibSample, option.calibSenor_n*sizeof(cgNum));
+	return cgdata.seq;
+}
+
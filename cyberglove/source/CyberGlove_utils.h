@@ -3,6 +3,7 @@
 
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 
 	typedef double cgNum;
 	typedef struct _options
@@ -25,7 +26,14 @@
 		int calibSenor_n = 24;
 		char* driver_ip = "128.208.4.243";
 		char* driver_port = "COM1";
+		int reconnect_min = 100;	// first reconnect delay (ms) for the driver/visualizer links
+		int reconnect_max = 5000;	// reconnect delay doubles up to this (ms)
 		char* logFile ="none";
+		int logSlots = 4096;	// log ring capacity in records (records are dropped, not waited for, when full)
+		int logChunk = 256;		// records per compressed chunk (.mjc log, CRC-checked), 0 for uncompressed .log
+		int logSync = 1000;		// flush the log to disk every logSync ms (a crash loses at most that much), 0: never
+		char* logStreams = "";	// log schema, e.g. "qpos,ctrl sensordata/5 qvel/50" (fields/decimation per stream), "": all fields every step
+		bool logSession = false;	// also log the inputs (VR, glove, scene) and exact step inputs for 'puppet replay' (.mjc); not closed by resets
 
 		// Calibration 
 		char* calibFile = "";
@@ -34,8 +42,13 @@
 
 		// Mujoco
 		char* viz_ip = "128.208.4.243";
+		int loop_timeout = 20;	// haptixGlove: max wait (ms) for a new glove sample before polling keys
 		int skip = 1;		// update teleOP every skip steps(1: updates tracking every mj_step)
 
+		// Telemetry
+		char* pubsub_port = "none";	// broadcast glove samples to any number of subscribers ("none": off)
+		int pubsub_queue = 64;		// per-subscriber queue length (oldest sample dropped when full)
+
 		// feedback
 		char* DOChan = "Dev2/port0/line0:7";
 		int pulseWidth = 20; // width of feedback pulse in ms;
@@ -57,8 +70,14 @@
 		std::thread glove_th;   // Glove background update thread 
 		bool updateGlove;		// update glove with latest data?
 		std::mutex cgGlove;		// Mutex on the calibSamples
+		std::condition_variable cgNew;	// signaled when a new calibSample is published
+		long long seq = 0;		// number of calibSamples published (protected by cgGlove)
 	}cgData;
 
+	// Telemetry message broadcast by the glove thread on option.pubsub_port
+	// [long long seq][double time (sec)][cgNum calibSample[calibSenor_n]]
+	#define CG_MSG_SIZE(n_calib) (sizeof(long long) + sizeof(double) + (n_calib)*sizeof(cgNum))
+
 	extern cgData cgdata;
 	extern cgOption option;
 
@@ -67,6 +86,10 @@
 	// Get the latest data from the glove
 	void cGlove_getData(cgNum *buff, const int n_buff);
 
+	// Wait up to tmout ms for a sample newer than seq, copy it. Returns its sequence
+	// number, or seq if no new sample arrived in time (buff is then left unchanged)
+	long long cGlove_waitData(cgNum *buff, const int n_buff, long long seq, int tmout);
+
 	//  Clean up glove
 	void cGlove_clean(char* errorInfo);
 
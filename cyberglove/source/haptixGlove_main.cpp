@@ -2,8 +2,14 @@
 #include <cstdlib>
 #include <conio.h>
 #include <signal.h>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
 
 #include "socket.h"
+#include "timing.h"
 #include "cyberGlove_utils.h"
 #include "matplotpp.h"
 #include "haptix.h"
@@ -19,101 +25,232 @@ cgOption* o;				// options
 
 
 
-// VISUALIZER =================================================
+// LINKS ======================================================
+//
+// Every outbound link (visualizer, driver) is owned by a background thread that
+// (re)connects with exponential backoff and sends the most recent sample. The
+// acquisition loop never touches the network: it checks the atomic connected
+// flag and posts its sample, overwriting one that has not been sent yet.
 
-// clean up vizualizer connections
-void viz_clean()
+typedef struct _link
 {
-	if( mj_connected() )
-		mj_close();
+	const char* name;
+	bool (*connect)(void);					// one connection attempt; true if connected
+	bool (*send)(const cgNum* buf, int n);	// send one sample; false if the link dropped
+	void (*close)(void);					// release the connection
+
+	std::thread th;							// reconnect/send thread
+	std::atomic<bool> running;				// thread should keep going
+	std::atomic<bool> connected;			// link is up (checked by the acquisition loop)
+	std::mutex mtx;							// protects sample and fresh
+	std::condition_variable cv;				// signals new sample or stop
+	cgNum* sample;							// latest sample posted by the acquisition loop
+	bool fresh;								// sample has not been sent yet
+
+	long long nsent;						// samples sent
+	long long nskipped;						// samples overwritten before they were sent
+	int nconnect;							// successful connections
+}cgLink;
+
+cgLink vizLink;
+cgLink driverLink;
+
+
+// reconnect/send thread
+void link_run(cgLink* l)
+{
+	int n = o->calibSenor_n;
+	int backoff = o->reconnect_min;
+	cgNum* buf = (cgNum*)util_malloc(sizeof(cgNum)*n, 8);
+	mjTimerThreadName(l->name);
+
+	while( l->running )
+	{
+		// not connected: try once, back off exponentially on failure
+		if( !l->connected )
+		{
+			if( l->connect() )
+			{
+				printf("Main:>\t %s connected\n", l->name);
+				l->nconnect++;
+				backoff = o->reconnect_min;
+
+				// never send a sample from before the connection
+				std::unique_lock<std::mutex> lock(l->mtx);
+				l->fresh = false;
+				l->connected = true;
+			}
+			else
+			{
+				printf("Main:>\t %s unavailable, retrying in %d ms\n", l->name, backoff);
+				std::unique_lock<std::mutex> lock(l->mtx);
+				l->cv.wait_for(lock, std::chrono::milliseconds(backoff), [l]{return !l->running;});
+				backoff = (2*backoff < o->reconnect_max ? 2*backoff : o->reconnect_max);
+			}
+			continue;
+		}
+
+		// wait for a fresh sample
+		{
+			std::unique_lock<std::mutex> lock(l->mtx);
+			l->cv.wait(lock, [l]{return l->fresh || !l->running;});
+			if( !l->running )
+				break;
+			memcpy(buf, l->sample, sizeof(cgNum)*n);
+			l->fresh = false;
+		}
+
+		// send, drop the link on failure
+		bool ok;
+		{
+			mjTIMER("link send");
+			ok = l->send(buf, n);
+		}
+		if( ok )
+			l->nsent++;
+		else
+		{
+			printf("Main:>\t %s disconnected\n", l->name);
+			l->connected = false;
+			l->close();
+		}
+	}
+
+	if( l->connected )
+		l->close();
+	l->connected = false;
+	util_free(buf);
 }
 
-// Connect to visualizer
-void viz_connect(const char* viz_ip, const char* filename)
+
+// start link thread
+void link_start(cgLink* l, const char* name, bool (*connect)(void),
+				bool (*send)(const cgNum*, int), void (*close)(void))
 {
-	mjInfo info;
-	printf("Main:>\t Connecting to the Vizualizer\n");
-	mj_connect(viz_ip);
-	if( !mj_connected() )
+	l->name = name;
+	l->connect = connect;
+	l->send = send;
+	l->close = close;
+	l->sample = (cgNum*)util_malloc(sizeof(cgNum)*o->calibSenor_n, 8);
+	l->fresh = false;
+	l->nsent = l->nskipped = 0;
+	l->nconnect = 0;
+	l->connected = false;
+	l->running = true;
+	l->th = std::thread(link_run, l);
+}
+
+
+// post latest sample (never blocks on the network)
+void link_post(cgLink* l, const cgNum* sample)
+{
+	if( !l->connected )
+		return;
+	{
+		std::lock_guard<std::mutex> lock(l->mtx);
+		if( l->fresh )
+			l->nskipped++;
+		memcpy(l->sample, sample, sizeof(cgNum)*o->calibSenor_n);
+		l->fresh = true;
+	}
+	l->cv.notify_one();
+}
+
+
+// stop link thread, print stats
+void link_stop(cgLink* l)
+{
+	if( !l->th.joinable() )
+		return;
 	{
-		printf("Main:>\t ERROR: Coudn't connect to the Vizualizer. Check if Mujoco haptix is running.\n");
-		cGlove_clean("Coudn't connect to the Vizualizer.");
+		std::lock_guard<std::mutex> lock(l->mtx);
+		l->running = false;
 	}
-	else
+	l->cv.notify_one();
+	l->th.join();
+	printf("%s: %lld samples sent, %lld skipped, %d connection(s)\n",
+		l->name, l->nsent, l->nskipped, l->nconnect);
+	util_free(l->sample);
+}
+
+
+
+// VISUALIZER =================================================
+
+// one attempt to connect to the visualizer
+bool viz_connect(void)
+{
+	mjInfo info;
+	mj_connect(o->viz_ip);
+	if( !mj_connected() )
+		return false;
+
+	// connected, but the model is not loaded yet
+	mj_info(&info);
+	if( info.nq==0 && info.ngeom==0 )
 	{
-		 mj_info(&info);
-		 if(info.nq==0 && info.ngeom==0)
-		 {	printf("Main:>\t ERROR: No model found. Please load appropriate Mujoco model.\n");
-			cGlove_clean("No model found.");
-		 }
+		printf("Main:>\t No model found. Please load appropriate Mujoco model.\n");
+		mj_close();
+		return false;
 	}
+	return true;
 }
 
 // Stream controls to visualizer
-void viz_update(double* ctrl, double time)
+bool viz_update(const cgNum* ctrl, int n)
 {
+	mjState state;
 	mjControl u;
-	u.nu = o->calibSenor_n;
-	u.time = (float)time;
-	for(int i=0; i<o->calibSenor_n; i++)
+	if( mj_get_state(&state)!=mjCOM_OK )
+		return false;
+
+	u.nu = n;
+	u.time = (float)state.time;
+	for(int i=0; i<n; i++)
 		u.ctrl[i] = (float)ctrl[i];
-	mj_set_control(&u);
+	return (mj_set_control(&u)==mjCOM_OK);
 }
 
+// clean up vizualizer connections
+void viz_clean(void)
+{
+	if( mj_connected() )
+		mj_close();
+}
+
+
 
 // HARDWRE ====================================================
 
-// connect to a socket
-int socConnect(mjSocket *soc, const char* ip, int timeOut, bool isServer)
+mjSocket socDriver;			// driver connects to us
+
+// stop listening when the link is shut down
+bool driver_exit(void)
 {
-	int err;
-	if(isServer)
-		err = soc->connectServer(timeOut, true, ip);
-	else
-		err = soc->connectClient(timeOut, (const char*)&ip);
-
-	if(err)
-		printf("Connected");
-	else
-	{	soc->clear();
-		printf("Timeout");		
-	}
-	return err;
+	return !driverLink.running;
 }
 
-// connect to the driver
-void driver_connect(mjSocket *soc)
+// one attempt to accept the driver (listens for up to reconnect_max)
+bool driver_connect(void)
 {
-	soc->mjInitSockets();
-	strcpy_s((char*)(soc->portListen), 100*sizeof(char), o->driver_port);
-	printf("Main:> Soc connecting to Driver:: ");
-	if(!socConnect(soc, o->driver_ip, 2500, true))
-	{	soc->clear();
-		cGlove_clean("Error Connecting to the driver.");
-	}
+	strcpy_s((char*)(socDriver.portListen), 100*sizeof(char), o->driver_port);
+	socDriver.userexit = driver_exit;
+	if( socDriver.connectServer(o->reconnect_max, false, o->driver_ip) )
+		return true;
+	socDriver.clear();
+	return false;
 }
 
-// Communicate data to driver
-void driver_update(mjSocket *soc)
+// Communicate data to driver; a partial send desyncs the stream, so any failure drops the link
+bool driver_update(const cgNum* buff, int n)
 {
-	// Socket buffer
-	int soc_err = 0;	
-	int buf_sz = o->calibSenor_n; // Jnt;
-	static cgNum* buff = (cgNum*)util_malloc(buf_sz*sizeof(cgNum), 8); 
-	
-	// laod buffer
-	cGlove_getData(buff, buf_sz);
-
-	soc_err = 0;
-	// Send buffer 
-	if(soc->getState())
-		soc_err = soc->sendBuffer((char*)buff, sizeof(cgNum)*buf_sz, 2);
-	else
-	{	printf("Main:> Driver\n");
-		soc_err = socConnect(soc, o->driver_ip, 10, true);
-	}
-	if(soc_err!=0)
-		soc->clear();
+	return (socDriver.sendBuffer((char*)buff, sizeof(cgNum)*n, o->reconnect_max)==mjSOC_OK);
+}
+
+// clean up driver connection
+void driver_clean(void)
+{
+	socDriver.clear();
 }
 
 
@@ -122,24 +259,21 @@ void driver_update(mjSocket *soc)
 // main (Initiate communication with the glove and the visualizer, and update)
 int main(int argc, char** argv)
 {   
-	clock_t start_t, end_t, total_t;
-	int frame_i =0;
-	mjState state;
-
-	// Driver sockets
-	mjSocket socDriver;
+	double start_t, total_t;
 
 	// Connect to Glove ----------------------------------
 	o = readOptions("cyberglove.config");
 	cGlove_init(o);
 
-	// Connect to visualizer -------------------------------
+	// Connect to visualizer (background) -------------------------------
 	if(o->STREAM_2_VIZ)
-		viz_connect(o->viz_ip, o->modelFile);
+		link_start(&vizLink, "Vizualizer", viz_connect, viz_update, viz_clean);
 
-	// Connect to hardware -------------------------------
+	// Connect to hardware (background) -------------------------------
 	if(o->STREAM_2_DRIVER)
-		driver_connect(&socDriver);
+	{	socDriver.mjInitSockets();
+		link_start(&driverLink, "Driver", driver_connect, driver_update, driver_clean);
+	}
 
 	// Graphs ----------------------------------
 	if(o->USEGRAPHICS)
@@ -148,41 +282,55 @@ int main(int argc, char** argv)
 	}
 
 	// Acquire data ----------------------------
-	start_t = clock();
+	// Block until the glove publishes a new sample (or loop_timeout passes, so keys
+	// and graphics stay responsive); only fresh samples are forwarded to the links.
+	long long seq = 0;
+	long long nforward = 0, nmissed = 0, ntimeout = 0;
+	double cpu_t = mjCPUTimeSec();
+	start_t = mjTimeSec();
 	printf("Main:>\t Acquiring data...\n");
 	cgNum* desPos = (cgNum*)util_malloc(sizeof(cgNum)*o->calibSenor_n, 8);
 	while( (Graphics_Key()!=27) && (!_kbhit()) )
 	{
-		// Get data from the glove
-		cGlove_getData(desPos, o->calibSenor_n);
+		// Wait for a new sample from the glove
+		long long s = cGlove_waitData(desPos, o->calibSenor_n, seq, o->loop_timeout);
+		if( s==seq )
+		{	ntimeout++;		// no new sample within loop_timeout
+			continue;
+		}
+		if( seq>0 )
+			nmissed += s-seq-1;
+		seq = s;
 
 		// Stream data to  vizualizer
 		if(o->STREAM_2_VIZ)
-		{
-			mj_get_state(&state);
-			viz_update(desPos, state.time);
-		}
+			link_post(&vizLink, desPos);
 
 		// Stream data to  driver
 		if(o->STREAM_2_DRIVER)
-			driver_update(&socDriver);
-		frame_i++;
+			link_post(&driverLink, desPos);
+		nforward++;
 	}
 
 	// Finalize -------------------------------
-	end_t = clock();
+	total_t = mjTimeSec() - start_t;
+	cpu_t = mjCPUTimeSec() - cpu_t;
 	printf("Main:>\t Done\n");
 
-	total_t = (long)(end_t - start_t) / CLOCKS_PER_SEC;
-	printf("\n\nTotal time taken by CPU: %f sec\n", (double)total_t);
-	printf("Total loop frame_i %d\n", frame_i);
-	printf("Update rate %f\n", (double)frame_i/(double)(total_t));
+	printf("\n\nTotal time: %f sec\n", total_t);
+	printf("Samples forwarded: %lld (%.1f Hz)\n", nforward, (double)nforward/total_t);
+	printf("Samples missed: %lld\n", nmissed);
+	printf("Wait timeouts: %lld\n", ntimeout);
+	printf("CPU usage (all threads): %.1f%% of one core\n", 100.0*cpu_t/total_t);
 
 	// Close and clean up -------------------------------
+	link_stop(&vizLink);
+	link_stop(&driverLink);
 	if(o->USEGRAPHICS)
 		Graphics_Close();
 	
 	cGlove_clean(NULL);
+	mjTimerReport();
 	//Sleep(2500);
 	return 0;
 }
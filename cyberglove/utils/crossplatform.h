@@ -116,17 +116,20 @@ int mjGetNCores(void);
 
 //---------------------------- Timing ---------------------------------------------------
 
-// initialize 1 msec timer (on Windows), record base time
+// initialize 1 msec timer (on Windows)
 void mjBeginTime(void);
 
 // close timer (on Windows)
 void mjEndTime(void);
 
-// get time in milliseconds scince mjBeginTime
+// get time in milliseconds since process start
 int mjGetTime(void);
 
-// get time in microseconds since mjBeginTime
+// get time in microseconds since process start
 long long int mjGetTimeHR(void);
 
+// get monotonic time in nanoseconds since process start (same as mjTimeNS)
+long long int mjGetTimeNS(void);
+
 // sleep for given number of milliseconds
 void mjSleep(unsigned int msec);
@@ -6,14 +6,17 @@
 
 //#include "common/errmem.h"
 #include "crossplatform.h"
+#include "timing.h"
 
 #include "unistd.h"
 #include "stdio.h"
 #include "stdlib.h"
 #include "string.h"
-#include <sys/time.h>
 #include <sys/types.h>
+#include <time.h>
+#if defined(__APPLE__)
 #include <sys/sysctl.h>
+#endif
 
 
 
@@ -236,18 +239,11 @@ int mjGetNCores(void)
 
 //---------------------------- Timing ---------------------------------------------------
 
-static bool _tmInitialized = false;
-static struct timeval _tmBase;
-
+// all times are on the process-wide monotonic time base (see timing.h)
 
-// record base time
+// nothing to do in Linux: the time base is set at process start
 void mjBeginTime(void)
 {
-	if( _tmInitialized )
-		return;
-
-	gettimeofday(&_tmBase, 0);
-	_tmInitialized = true;
 }
 
 
@@ -259,30 +255,26 @@ void mjEndTime(void)
 
 
 
-// get time in milliseconds scince initialization
+// get time in milliseconds since process start
 int mjGetTime(void)
 {
-	if( !_tmInitialized )
-		mjBeginTime();
-
-	struct timeval now;
-	gettimeofday(&now, 0);
-	return (int)(now.tv_sec*1000 - _tmBase.tv_sec*1000 +  
-				 now.tv_usec/1000 - _tmBase.tv_usec/1000);
+	return (int)(mjTimeNS()/1000000);
 }
 
 
 
-// get time in microseconds scince initialization
+// get time in microseconds since process start
 long long int mjGetTimeHR(void)
 {
-	if( !_tmInitialized )
-		mjBeginTime();
+	return mjTimeNS()/1000;
+}
+
 
-	struct timeval now;
-	gettimeofday(&now, 0);
-	return (int)(now.tv_sec*1000000 - _tmBase.tv_sec*1000000 +  
-				 now.tv_usec - _tmBase.tv_usec);
+
+// get monotonic time in nanoseconds since process start
+long long int mjGetTimeNS(void)
+{
+	return mjTimeNS();
 }
 
 
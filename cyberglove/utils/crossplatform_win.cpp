@@ -5,6 +5,7 @@
 //-----------------------------------//
 
 #include "crossplatform.h"
+#include "timing.h"
 #include "stdio.h"
 
 #pragma comment(lib, "winmm.lib")
@@ -173,25 +174,18 @@ int mjGetNCores(void)
 
 //---------------------------- Timing ---------------------------------------------------
 
+// all times are on the process-wide monotonic time base (see timing.h)
 static bool _tmInitialized = false;
-static int _tmBase;
-static LARGE_INTEGER _tmFreqHR;
-static LARGE_INTEGER _tmBaseHR;
 
 
-// initialize 1 msec timer, record base time
+// initialize 1 msec timer
 void mjBeginTime(void)
 {
 	if( _tmInitialized )
 		return;
 
-	// initialize multimedia timer
+	// initialize multimedia timer (1 msec sleep granularity)
 	timeBeginPeriod(1);
-	_tmBase = timeGetTime();
-
-	// initialize high performance timer
-	QueryPerformanceFrequency(&_tmFreqHR);
-	QueryPerformanceCounter(&_tmBaseHR);
 
 	_tmInitialized = true;
 }
@@ -210,26 +204,35 @@ void mjEndTime(void)
 
 
 
-// get time in milliseconds scince initialization
+// get time in milliseconds since process start
 int mjGetTime(void)
 {
 	if( !_tmInitialized )
 		mjBeginTime();
 
-	return (timeGetTime() - _tmBase);
+	return (int)(mjTimeNS()/1000000);
 }
 
 
 
-// get time in microseconds scince initialization
+// get time in microseconds since process start
 long long int mjGetTimeHR(void)
 {
 	if( !_tmInitialized )
 		mjBeginTime();
 
-	LARGE_INTEGER tm;
-	QueryPerformanceCounter(&tm);
-	return (long long int) (((tm.QuadPart - _tmBaseHR.QuadPart)*1000000)/_tmFreqHR.QuadPart);
+	return mjTimeNS()/1000;
+}
+
+
+
+// get monotonic time in nanoseconds since process start
+long long int mjGetTimeNS(void)
+{
+	if( !_tmInitialized )
+		mjBeginTime();
+
+	return mjTimeNS();
 }
 
 
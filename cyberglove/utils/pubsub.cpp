@@ -0,0 +1,522 @@
+//-----------------------------------//
+//  Multi-subscriber telemetry server for the cyberglove project      //
+//  Built on top of the mjSocket conventions (see socket.h)           //
+//-----------------------------------//
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "pubsub.h"
+#include "socket.h"
+#include "crossplatform.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+	#pragma comment(lib,"Ws2_32.lib")
+#else
+	#include <sys/epoll.h>
+	#include <sys/eventfd.h>
+	#include <unistd.h>
+	#include <stdint.h>
+#endif
+
+
+//---------------------------- Internal state -------------------------------------------
+
+// one connected subscriber
+struct _mjSubscriber
+{
+	SOCKET soc;						// connection to subscriber
+	char* queue;					// ring of queuelen messages
+	int head;						// oldest queued message
+	int count;						// number of queued messages
+	char* cur;						// message in flight (already removed from queue)
+	int cursent;					// bytes of cur sent; -1: nothing in flight
+	bool wantwrite;					// waiting for socket to become writable
+	long long ndropped;				// messages dropped for this subscriber
+};
+
+
+// server state
+struct _mjPubState
+{
+	mjSocket helper;				// used for getHost, mjSetBlocking, mjSocketError
+	SOCKET listener;				// listening socket
+	int msgsz;						// message size in bytes
+	int queuelen;					// per-subscriber queue length
+	std::vector<_mjSubscriber*> sub;// connected subscribers
+	char dummy[1000];				// used to flush subscriber input
+#ifdef _WIN32
+	SOCKET wakerecv;				// loopback datagram socket polled with the subscribers
+	SOCKET wakesend;				// used by publish() to wake the server through wakerecv
+	struct sockaddr_in wakeaddr;	// address of wakerecv
+#else
+	int epfd;						// epoll instance
+	int wakefd;						// eventfd used by publish() to wake the server
+#endif
+};
+
+
+
+//---------------------------- Utility functions ----------------------------------------
+
+// set keepalive, no-delay and non-blocking
+static void pub_setOptions(_mjPubState* ps, SOCKET s)
+{
+	int on = 1;
+	setsockopt(s, SOL_SOCKET, SO_KEEPALIVE, (char*)&on, sizeof(on));
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (char*)&on, sizeof(on));
+	ps->helper.mjSetBlocking(s, false);
+}
+
+
+
+// true if the last socket error only means "try again later"
+static bool pub_wouldBlock(_mjPubState* ps)
+{
+	return (ps->helper.mjSocketError()==WSAEWOULDBLOCK);
+}
+
+
+
+// change the events we wait for on a subscriber
+static void pub_watch(_mjPubState* ps, _mjSubscriber* s, bool write)
+{
+	s->wantwrite = write;
+
+#ifndef _WIN32
+	struct epoll_event ev;
+	ev.events = EPOLLIN | EPOLLRDHUP | (write ? (uint32_t)EPOLLOUT : 0u);
+	ev.data.ptr = s;
+	epoll_ctl(ps->epfd, EPOLL_CTL_MOD, s->soc, &ev);
+#endif
+}
+
+
+
+// wake the server thread
+static void pub_wake(_mjPubState* ps)
+{
+#ifdef _WIN32
+	char one = 1;
+	sendto(ps->wakesend, &one, 1, 0, (struct sockaddr*)&ps->wakeaddr, sizeof(ps->wakeaddr));
+#else
+	uint64_t one = 1;
+	if( write(ps->wakefd, &one, sizeof(one)) ) {}
+#endif
+}
+
+
+
+//---------------------------- Main API -------------------------------------------------
+
+// constructor
+mjPublisher::mjPublisher()
+{
+	ps = new _mjPubState;
+	ps->listener = INVALID_SOCKET;
+	ps->msgsz = 0;
+	ps->queuelen = 0;
+#ifdef _WIN32
+	ps->wakerecv = INVALID_SOCKET;
+	ps->wakesend = INVALID_SOCKET;
+#else
+	ps->epfd = -1;
+	ps->wakefd = -1;
+#endif
+
+	verbose = false;
+	running = false;
+	npublished = 0;
+	ndropped = 0;
+}
+
+
+
+// destructor
+mjPublisher::~mjPublisher()
+{
+	stop();
+	delete ps;
+}
+
+
+
+// start listening and launch the server thread
+bool mjPublisher::start(const char* port, int msgsz, int queuelen, const char* host)
+{
+	if( running )
+		return true;
+	if( msgsz<=0 || queuelen<=0 )
+		return false;
+
+	ps->msgsz = msgsz;
+	ps->queuelen = queuelen;
+	ps->helper.mjInitSockets();
+
+	// get address info for local machine
+	struct addrinfo* info = ps->helper.getHost(true, port, host);
+	if( !info )
+	{
+		printf("pubsub: getaddrinfo failed for port %s\n", port);
+		return false;
+	}
+
+	// create a socket for listening, get rid of reuse error
+	int on = 1;
+	ps->listener = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+	if( ps->listener==INVALID_SOCKET ||
+		setsockopt(ps->listener, SOL_SOCKET, SO_REUSEADDR, (char*)&on, sizeof(int)) ||
+		bind(ps->listener, info->ai_addr, (int)info->ai_addrlen) ||
+		listen(ps->listener, SOMAXCONN) )
+	{
+		printf("pubsub: could not listen on port %s, error %d\n", port, ps->helper.mjSocketError());
+		if( ps->listener!=INVALID_SOCKET )
+			closesocket(ps->listener);
+		ps->listener = INVALID_SOCKET;
+		freeaddrinfo(info);
+		return false;
+	}
+	freeaddrinfo(info);
+	ps->helper.mjSetBlocking(ps->listener, false);
+
+#ifdef _WIN32
+	// loopback datagram socket: WSAPoll cannot wait on events, publish() sends it a byte
+	int addrlen = sizeof(ps->wakeaddr);
+	memset(&ps->wakeaddr, 0, sizeof(ps->wakeaddr));
+	ps->wakeaddr.sin_family = AF_INET;
+	ps->wakeaddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	ps->wakerecv = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	ps->wakesend = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if( ps->wakerecv==INVALID_SOCKET || ps->wakesend==INVALID_SOCKET ||
+		bind(ps->wakerecv, (struct sockaddr*)&ps->wakeaddr, addrlen) ||
+		getsockname(ps->wakerecv, (struct sockaddr*)&ps->wakeaddr, &addrlen) )
+	{
+		printf("pubsub: could not create wakeup socket, error %d\n", ps->helper.mjSocketError());
+		closesocket(ps->wakerecv);
+		closesocket(ps->wakesend);
+		closesocket(ps->listener);
+		ps->wakerecv = ps->wakesend = ps->listener = INVALID_SOCKET;
+		return false;
+	}
+	ps->helper.mjSetBlocking(ps->wakerecv, false);
+#else
+	// epoll instance watching the listener and the wakeup event
+	struct epoll_event ev;
+	ps->epfd = epoll_create1(0);
+	ps->wakefd = eventfd(0, EFD_NONBLOCK);
+	ev.events = EPOLLIN;
+	ev.data.ptr = &ps->listener;
+	epoll_ctl(ps->epfd, EPOLL_CTL_ADD, ps->listener, &ev);
+	ev.events = EPOLLIN;
+	ev.data.ptr = &ps->wakefd;
+	epoll_ctl(ps->epfd, EPOLL_CTL_ADD, ps->wakefd, &ev);
+#endif
+
+	if( verbose )
+		printf("pubsub: publishing %d byte messages on port %s\n", msgsz, port);
+
+	// start server
+	running = true;
+	server_th = std::thread(&mjPublisher::serve, this);
+	return true;
+}
+
+
+
+// stop the server thread, disconnect everybody
+void mjPublisher::stop(void)
+{
+	if( !running )
+		return;
+
+	// wake and join server thread
+	running = false;
+	pub_wake(ps);
+	if( server_th.joinable() )
+		server_th.join();
+
+	// close subscribers
+	mtx.lock();
+	for( size_t i=0; i<ps->sub.size(); i++ )
+	{
+		closesocket(ps->sub[i]->soc);
+		free(ps->sub[i]->queue);
+		free(ps->sub[i]->cur);
+		delete ps->sub[i];
+	}
+	ps->sub.clear();
+	mtx.unlock();
+
+	// close listener and epoll
+	closesocket(ps->listener);
+	ps->listener = INVALID_SOCKET;
+#ifdef _WIN32
+	closesocket(ps->wakerecv);
+	closesocket(ps->wakesend);
+	ps->wakerecv = INVALID_SOCKET;
+	ps->wakesend = INVALID_SOCKET;
+#else
+	close(ps->epfd);
+	close(ps->wakefd);
+	ps->epfd = -1;
+	ps->wakefd = -1;
+#endif
+	ps->helper.mjClearSockets();
+}
+
+
+
+// copy message into all subscriber queues, drop oldest if full
+void mjPublisher::publish(const char* msg)
+{
+	if( !running )
+		return;
+
+	mtx.lock();
+	for( size_t i=0; i<ps->sub.size(); i++ )
+	{
+		_mjSubscriber* s = ps->sub[i];
+
+		// queue full: drop oldest
+		if( s->count==ps->queuelen )
+		{
+			s->head = (s->head+1) % ps->queuelen;
+			s->count--;
+			s->ndropped++;
+			ndropped++;
+		}
+
+		// append
+		int slot = (s->head + s->count) % ps->queuelen;
+		memcpy(s->queue + slot*ps->msgsz, msg, ps->msgsz);
+		s->count++;
+	}
+	mtx.unlock();
+	npublished++;
+
+	// wake server
+	pub_wake(ps);
+}
+
+
+
+// number of connected subscribers
+int mjPublisher::getNSubscriber(void)
+{
+	mtx.lock();
+	int n = (int)ps->sub.size();
+	mtx.unlock();
+	return n;
+}
+
+
+
+//---------------------------- Server thread --------------------------------------------
+
+// accept all pending connections
+static void pub_accept(_mjPubState* ps, std::mutex& mtx, bool verbose)
+{
+	while( true )
+	{
+		SOCKET soc = accept(ps->listener, NULL, NULL);
+		if( soc==INVALID_SOCKET )
+			return;
+		pub_setOptions(ps, soc);
+
+		// make subscriber
+		_mjSubscriber* s = new _mjSubscriber;
+		s->soc = soc;
+		s->queue = (char*)malloc(ps->queuelen*ps->msgsz);
+		s->cur = (char*)malloc(ps->msgsz);
+		s->head = 0;
+		s->count = 0;
+		s->cursent = -1;
+		s->wantwrite = false;
+		s->ndropped = 0;
+
+#ifndef _WIN32
+		struct epoll_event ev;
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.ptr = s;
+		epoll_ctl(ps->epfd, EPOLL_CTL_ADD, soc, &ev);
+#endif
+
+		mtx.lock();
+		ps->sub.push_back(s);
+		mtx.unlock();
+
+		if( verbose )
+			printf("pubsub: subscriber connected (%d total)\n", (int)ps->sub.size());
+	}
+}
+
+
+
+// disconnect one subscriber
+static void pub_remove(_mjPubState* ps, std::mutex& mtx, _mjSubscriber* s, bool verbose)
+{
+	mtx.lock();
+	for( size_t i=0; i<ps->sub.size(); i++ )
+		if( ps->sub[i]==s )
+		{
+			ps->sub.erase(ps->sub.begin()+i);
+			break;
+		}
+	mtx.unlock();
+
+#ifndef _WIN32
+	epoll_ctl(ps->epfd, EPOLL_CTL_DEL, s->soc, NULL);
+#endif
+	closesocket(s->soc);
+
+	if( verbose )
+		printf("pubsub: subscriber disconnected after %lld drops (%d left)\n",
+			s->ndropped, (int)ps->sub.size());
+
+	free(s->queue);
+	free(s->cur);
+	delete s;
+}
+
+
+
+// discard anything the subscriber sent; false if the connection is closed
+static bool pub_drain(_mjPubState* ps, _mjSubscriber* s)
+{
+	while( true )
+	{
+		int n = recv(s->soc, ps->dummy, sizeof(ps->dummy), 0);
+		if( n>0 )
+			continue;
+		return (n<0 && pub_wouldBlock(ps));
+	}
+}
+
+
+
+// send queued messages until the socket would block; false if the connection failed
+static bool pub_flush(_mjPubState* ps, std::mutex& mtx, _mjSubscriber* s)
+{
+	// bounded so that a fast publisher cannot starve the other subscribers
+	for( int k=0; k<=ps->queuelen; k++ )
+	{
+		// take next message out of the queue
+		if( s->cursent<0 )
+		{
+			mtx.lock();
+			if( !s->count )
+			{
+				mtx.unlock();
+				break;
+			}
+			memcpy(s->cur, s->queue + s->head*ps->msgsz, ps->msgsz);
+			s->head = (s->head+1) % ps->queuelen;
+			s->count--;
+			mtx.unlock();
+			s->cursent = 0;
+		}
+
+		// optimistic send
+		int n = send(s->soc, s->cur + s->cursent, ps->msgsz - s->cursent, MSG_NOSIGNAL);
+		if( n>0 )
+		{
+			s->cursent += n;
+			if( s->cursent==ps->msgsz )
+				s->cursent = -1;
+			continue;
+		}
+
+		// socket full: wait for writable
+		if( n<0 && pub_wouldBlock(ps) )
+		{
+			if( !s->wantwrite )
+				pub_watch(ps, s, true);
+			return true;
+		}
+
+		return false;
+	}
+
+	// everything sent: stop waiting for writable
+	if( s->wantwrite && s->cursent<0 )
+		pub_watch(ps, s, false);
+	return true;
+}
+
+
+
+// server loop: accept, detect hangups, move queued messages to the network
+void mjPublisher::serve(void)
+{
+	std::vector<_mjSubscriber*> closed;
+
+	while( running )
+	{
+		closed.clear();
+
+#ifdef _WIN32
+		// poll listener, wakeup socket and all subscribers
+		std::vector<WSAPOLLFD> fds(2 + ps->sub.size());
+		fds[0].fd = ps->listener;
+		fds[0].events = POLLRDNORM;
+		fds[1].fd = ps->wakerecv;
+		fds[1].events = POLLRDNORM;
+		for( size_t i=0; i<ps->sub.size(); i++ )
+		{
+			fds[i+2].fd = ps->sub[i]->soc;
+			fds[i+2].events = POLLRDNORM | (ps->sub[i]->wantwrite ? POLLWRNORM : 0);
+		}
+
+		// wait for connections, hangups, writable sockets or new messages
+		std::vector<_mjSubscriber*> snapshot(ps->sub);
+		if( WSAPoll(fds.data(), (ULONG)fds.size(), -1)>0 )
+		{
+			if( fds[0].revents & POLLRDNORM )
+				pub_accept(ps, mtx, verbose);
+			if( fds[1].revents & POLLRDNORM )
+				while( recv(ps->wakerecv, ps->dummy, sizeof(ps->dummy), 0)>0 ) {}
+			for( size_t i=0; i<snapshot.size(); i++ )
+			{
+				short rev = fds[i+2].revents;
+				if( (rev & (POLLERR | POLLHUP | POLLNVAL)) ||
+					((rev & POLLRDNORM) && !pub_drain(ps, snapshot[i])) )
+					closed.push_back(snapshot[i]);
+			}
+		}
+#else
+		// wait for connections, hangups, writable sockets or new messages
+		struct epoll_event ev[64];
+		int n = epoll_wait(ps->epfd, ev, 64, 100);
+		for( int i=0; i<n; i++ )
+		{
+			if( ev[i].data.ptr==&ps->listener )
+				pub_accept(ps, mtx, verbose);
+			else if( ev[i].data.ptr==&ps->wakefd )
+			{
+				uint64_t cnt;
+				if( read(ps->wakefd, &cnt, sizeof(cnt)) ) {}
+			}
+			else
+			{
+				_mjSubscriber* s = (_mjSubscriber*)ev[i].data.ptr;
+				if( (ev[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) ||
+					((ev[i].events & EPOLLIN) && !pub_drain(ps, s)) )
+					closed.push_back(s);
+			}
+		}
+#endif
+
+		// remove closed subscribers
+		for( size_t i=0; i<closed.size(); i++ )
+			pub_remove(ps, mtx, closed[i], verbose);
+
+		// send pending data (only this thread modifies the subscriber list)
+		closed.clear();
+		for( size_t i=0; i<ps->sub.size(); i++ )
+			if( !pub_flush(ps, mtx, ps->sub[i]) )
+				closed.push_back(ps->sub[i]);
+		for( size_t i=0; i<closed.size(); i++ )
+			pub_remove(ps, mtx, closed[i], verbose);
+	}
+}
@@ -0,0 +1,63 @@
+//-----------------------------------//
+//  Multi-subscriber telemetry server for the cyberglove project      //
+//  Built on top of the mjSocket conventions (see socket.h)           //
+//-----------------------------------//
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <vector>
+
+
+//------------------------- Publisher ---------------------------------------------------
+//
+// Single-threaded (epoll on Linux, WSAPoll on Windows) TCP server that accepts any
+// number of subscribers and broadcasts fixed-size messages to all of them.
+//
+// Every subscriber owns a bounded queue. When a queue is full the oldest message is
+// dropped, so a slow subscriber never delays the others or the publishing thread.
+// publish() only copies the message into the queues and wakes the server thread;
+// it never touches the network.
+//
+// Subscribers need no special client: mjSocket::connectClient() followed by
+// mjSocket::recvBuffer(buf, msgsz) receives one message at a time.
+
+struct _mjPubState;
+
+class mjPublisher
+{
+public:
+	mjPublisher();
+	~mjPublisher();
+
+	// start server thread listening on port; false if the port could not be opened
+	bool start(const char* port, int msgsz, int queuelen = 64, const char* host = 0);
+
+	// stop server thread, disconnect all subscribers
+	void stop(void);
+
+	// broadcast one message of msgsz bytes (copy only, never blocks on the network)
+	void publish(const char* msg);
+
+	// read-only access
+	int getNSubscriber(void);			// currently connected subscribers
+	long long getNPublished(void)		{return npublished;}
+	long long getNDropped(void)			{return ndropped;}
+	bool getState(void)					{return running;}
+
+	//---------------- settings
+
+	bool verbose;						// print diagnostics
+
+private:
+	void serve(void);					// server loop (runs on its own thread)
+
+	_mjPubState* ps;					// sockets and queues (see pubsub.cpp)
+	std::thread server_th;				// server thread
+	std::mutex mtx;						// protects subscriber list and queues
+	std::atomic<bool> running;			// server thread is running
+	std::atomic<long long> npublished;	// messages given to publish()
+	std::atomic<long long> ndropped;	// messages dropped over all subscribers
+};
@@ -77,7 +77,7 @@ void mjSocket::mjSetBlocking(SOCKET s, bool block)
 {
 	int flags = fcntl(s, F_GETFL, 0); 
 	if( block )
-		fcntl(s, F_SETFL, flags & (!O_NONBLOCK));
+		fcntl(s, F_SETFL, flags & (~O_NONBLOCK));
 	else
 		fcntl(s, F_SETFL, flags | O_NONBLOCK);
 }
@@ -134,11 +134,11 @@ void mjSocket::_error(const char* format, int i)
 // try to make connection to specified host
 bool mjSocket::connectClient(int tmout, const char* host)
 {
-	// record start time
-	int tmStart = mjGetTime();
+	// absolute deadline
+	long long deadline = (tmout>=0 ? mjGetTimeNS() + 1000000LL*tmout : -1);
 	
 	// try to connect
-	while( tmout<0 || mjGetTime()-tmStart<tmout )
+	while( deadline<0 || mjGetTimeNS()<deadline )
 		if( tryConnect(portListen, host, tmoutTryConnect) )
 			break;
 
@@ -185,17 +185,18 @@ bool mjSocket::connectServer(int tmout, bool print, const char* hostServer)
 		_error("setsockopt failed with error %d", mjSocketError());
 	mjSetBlocking(ListenSocket, false);
 
-	// init timing info
-	int tmStart = mjGetTime();
+	// absolute deadline
+	long long deadline = (tmout>=0 ? mjGetTimeNS() + 1000000LL*tmout : -1);
 
 	// start listening
 	if( listen(ListenSocket, SOMAXCONN) )
 		_error("listen socket failed with error %d", mjSocketError());
 
-	// wait/accept connections
-	int remaining;
-	while( tmout<0 || (remaining=tmout-(mjGetTime()-tmStart))>0 )
-	{	if( waitSocket(ListenSocket, true, remaining < 100 ? remaining : 100) )
+	// wait/accept connections, check userexit at least every 100 msec
+	while( deadline<0 || mjGetTimeNS()<deadline )
+	{
+		long long next = mjGetTimeNS() + 100000000LL;
+		if( waitSocketNS(ListenSocket, true, (deadline>=0 && deadline<next) ? deadline : next) )
 		{
 
 			// accept connection
@@ -240,11 +241,11 @@ void mjSocket::clear(void)
 
 
 
-// flush input buffer
+// flush input buffer (socket is non-blocking: read until nothing is left)
 void mjSocket::flushInput(void)
 {
-	while( waitSocket(soc, true, 0) )
-		recvBuffer(dummy, 1000, 0);
+	if( state )
+		while( recv(soc, dummy, 1000, 0)>0 );
 }
 
 
@@ -252,7 +253,8 @@ void mjSocket::flushInput(void)
 // send buffer
 int mjSocket::sendBuffer(const char *buf, int len, int tmout)
 {
-	int n, ndone = 0, tmStart = mjGetTime();
+	int n, ndone = 0;
+	long long deadline = (tmout>=0 ? mjGetTimeNS() + 1000000LL*tmout : -1);
 
 	if( verbose )
 		printf("SEND BUFFER %d\n", len);
@@ -261,49 +263,40 @@ int mjSocket::sendBuffer(const char *buf, int len, int tmout)
 	if( !state )
 		return mjSOC_CLOSED;
 
-	// send in chunks (usually necessary)
+	// send in chunks: try first, wait only when the socket buffer is full
 	while( ndone<len )
 	{
-		// prepare timeout info
-		int remaining;
-		if( tmout>=0 )
-		{
-			remaining = tmout - (mjGetTime() - tmStart);
-
-			// handle timeout
-			if( remaining<0 )
-				return mjSOC_TIMEOUT;
-		}
-		else
-			remaining = -1;
+		if( verbose )
+			printf(" trying to send %d bytes\n", len-ndone);
 
-		// wait for socket to become writable, write
-		if( waitSocket(soc, false, remaining) )
+		// send
+		n = send(soc, buf+ndone, len-ndone, MSG_NOSIGNAL);
+		if( n>0 )
 		{
 			if( verbose )
-				printf(" trying to send %d bytes\n", len-ndone);
-
-			// send
-			n = send(soc, buf+ndone, len-ndone, 0);
+				printf(" sent %d bytes\n", n);
 
-			// handle socket error
-			if( n<=0 )
-			{
-				int err = mjSocketError();
-				clear();
+			// add to done
+			ndone += n;
+			continue;
+		}
 
-				if( verbose )
-					printf("error in sendBuffer: %d\n", err);
+		// socket full: wait for it to become writable
+		int err = mjSocketError();
+		if( n<0 && err==WSAEWOULDBLOCK )
+		{
+			if( !waitSocketNS(soc, false, deadline) )
+				return mjSOC_TIMEOUT;
+			continue;
+		}
 
-				return err;
-			}
-			else if( verbose )
-				printf(" sent %d bytes\n", len-ndone);
+		// handle socket error
+		clear();
 
+		if( verbose )
+			printf("error in sendBuffer: %d\n", err);
 
-			// add to done
-			ndone += n;
-		}
+		return err;
 	}
 
 	return mjSOC_OK;
@@ -314,7 +307,8 @@ int mjSocket::sendBuffer(const char *buf, int len, int tmout)
 // receive buffer
 int mjSocket::recvBuffer(char *buf, int len, int tmout)
 {
-	int n, ndone = 0, tmStart = mjGetTime();
+	int n, ndone = 0;
+	long long deadline = (tmout>0 ? mjGetTimeNS() + 1000000LL*tmout : -1);	//??? Vik - its was if( tmout>=0 )
 
 	if( verbose )
 		printf("RECEIVE BUFFER %d\n", len);
@@ -327,55 +321,44 @@ int mjSocket::recvBuffer(char *buf, int len, int tmout)
 		return mjSOC_CLOSED;
 	}
 
-	// receive in chunks (usually necessary)
+	// receive in chunks: try first, wait only when nothing is available
 	while( ndone<len )
 	{
-		// prepare timeout info
-		int remaining;
-		if( tmout>0 )		//??? Vik - its was if( tmout>=0 )
+		if( verbose )
+			printf(" waiting for %d bytes\n", len-ndone);
+
+		// recv
+		n = recv(soc, buf+ndone, len-ndone, 0);
+		if( n>0 )
 		{
-			remaining = tmout - (mjGetTime() - tmStart);
+			if( verbose )
+				printf(" received %d bytes\n", n);
+
+			// add to done
+			ndone += n;
+			continue;
+		}
 
-			// handle timeout
-			if( remaining<=0 )
+		// nothing available: wait for socket to become readable
+		int err = (n==0) ? mjSOC_CLOSED : mjSocketError();
+		if( n<0 && err==WSAEWOULDBLOCK )
+		{
+			if( !waitSocketNS(soc, true, deadline) )
 			{
 				if( verbose )
-					printf("--- timeout: %d, %d, %d, %d\n", 
-						tmout, remaining, mjGetTime(), tmStart);
+					printf("--- timeout: %d, %d of %d bytes\n", tmout, ndone, len);
 				return mjSOC_TIMEOUT;
 			}
+			continue;
 		}
-		else
-			remaining = -1;
-
-		// wait for socket to become readable, read
-		if( waitSocket(soc, true, remaining) )
-		{
-			if( verbose )
-				printf(" waiting for %d bytes\n", len-ndone);
-
-			// recv
-			n = recv(soc, buf+ndone, len-ndone, 0);
-
-			// handle socket error
-			if( n<=0 )
-			{
-				int err = (n==0) ? 2 : mjSocketError();
-				clear();
 
-				if( verbose )
-					printf("error in recvBuffer: %d\n", err);
+		// handle socket error
+		clear();
 
-				return err;
-			}
-			else if( verbose )
-				printf(" received %d bytes\n", n);
+		if( verbose )
+			printf("error in recvBuffer: %d\n", err);
 
-			// add to done
-			ndone += n;
-		}
-		else if( verbose )
-			printf("could not wait: %d\n", remaining);
+		return err;
 	}
 
 	return mjSOC_OK;
@@ -478,29 +461,65 @@ bool mjSocket::tryConnect(const char* port, const char* host, int tmout)
 
 
 
-// use select() to wait for socket operation, true if not timeout
+// use poll() to wait for socket operation, true if not timeout
 bool mjSocket::waitSocket(SOCKET s, bool read, int tmout)
 {
-	// make set with socket s
-	fd_set set;
-	FD_ZERO(&set);
-	FD_SET(s, &set);
-
-	// timeout structure
-	struct timeval tm;
-	tm.tv_sec = tmout/1000;
-	tm.tv_usec = ((long)(tmout%1000)) * 1000;
-
-	// call with read or write set
-	int result = 0;
-	if( read )
-		result = select((int)s+1, &set, 0, 0, tmout>=0 ? &tm : 0);
-	else
-		result = select((int)s+1, 0, &set, 0, tmout>=0 ? &tm : 0);
+	return waitSocketNS(s, read, tmout>=0 ? mjGetTimeNS() + 1000000LL*tmout : -1);
+}
+
+
+
+// use poll() to wait for socket operation until deadline, true if not timeout
+bool mjSocket::waitSocketNS(SOCKET s, bool read, long long deadline)
+{
+#ifdef _WIN32
+	WSAPOLLFD pfd;
+	pfd.fd = s;
+	pfd.events = (read ? POLLRDNORM : POLLWRNORM);
+#else
+	struct pollfd pfd;
+	pfd.fd = s;
+	pfd.events = (read ? POLLIN : POLLOUT);
+#endif
+
+	while( true )
+	{
+		// remaining time, never negative
+		long long remaining = -1;
+		if( deadline>=0 )
+		{
+			remaining = deadline - mjGetTimeNS();
+			if( remaining<0 )
+				remaining = 0;
+		}
+
+		// wait: nanosecond resolution on Linux, milliseconds (rounded up) elsewhere
+		pfd.revents = 0;
+#if defined(__linux__)
+		struct timespec tm;
+		tm.tv_sec = (time_t)(remaining/1000000000LL);
+		tm.tv_nsec = (long)(remaining%1000000000LL);
+		int result = ppoll(&pfd, 1, remaining>=0 ? &tm : 0, 0);
+#else
+		int msec = (remaining>=0 ? (int)((remaining+999999)/1000000) : -1);
+	#ifdef _WIN32
+		int result = WSAPoll(&pfd, 1, msec);
+	#else
+		int result = poll(&pfd, 1, msec);
+	#endif
+#endif
 
-	// check for error
-	if( result==SOCKET_ERROR )
-		_error("select socket failed with error %d", mjSocketError());
+		// check for error, retry if interrupted by a signal
+		if( result==SOCKET_ERROR )
+		{
+#ifndef _WIN32
+			if( mjSocketError()==EINTR )
+				continue;
+#endif
+			_error("poll socket failed with error %d", mjSocketError());
+		}
 
-	return (result==1);
+		// error and hangup count as ready: the following send/recv reports them
+		return (result>0);
+	}
 }
@@ -11,6 +11,8 @@
 	#include <winsock2.h>
 	#include <ws2tcpip.h>
 
+	#define MSG_NOSIGNAL 0
+
 #else
 	#include <sys/socket.h>
 	#include <netinet/in.h>
@@ -18,6 +20,7 @@
 	#include <arpa/inet.h>
 	#include <errno.h>
 	#include <fcntl.h>
+	#include <poll.h>
 
 	#define SOCKET int
 	#define INVALID_SOCKET -1
@@ -101,9 +104,12 @@ public:
 	// make connection
 	bool tryConnect(const char* port, const char* host, int tmout);
 
-	// use select() to wait for socket read/write, true if not timeout
+	// use poll() to wait for socket read/write, true if not timeout
 	bool waitSocket(SOCKET s, bool read, int tmout);
 
+	// same, with absolute deadline in nanoseconds (mjGetTimeNS); <0: no deadline
+	bool waitSocketNS(SOCKET s, bool read, long long deadline);
+
 
 	//---------------- settings
 
@@ -0,0 +1,112 @@
+//-----------------------------------//
+//  Loopback microbenchmark for mjSocket                              //
+//  Usage: socket_bench [msgsize] [count] [port]                      //
+//-----------------------------------//
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "socket.h"
+#include "crossplatform.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+
+// benchmark settings
+static int msgsz = 64;
+static int count = 20000;
+static char port[100] = "50600";
+
+
+// monotonic time in nanoseconds (independent of the mjSocket timing code under test)
+static long long nowNS(void)
+{
+	return (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+
+// server: echo ping-pong messages, then swallow the stream
+static void server(void)
+{
+	mjSocket soc;
+	std::vector<char> buf(msgsz);
+	strcpy(soc.portListen, port);
+	if( !soc.connectServer(5000, false, "127.0.0.1") )
+		return;
+
+	// ping-pong
+	for( int i=0; i<count; i++ )
+		if( soc.recvBuffer(buf.data(), msgsz, 1000)!=mjSOC_OK ||
+			soc.sendBuffer(buf.data(), msgsz, 1000)!=mjSOC_OK )
+			return;
+
+	// stream
+	for( int i=0; i<count; i++ )
+		if( soc.recvBuffer(buf.data(), msgsz, 1000)!=mjSOC_OK )
+			return;
+	soc.sendBuffer(buf.data(), 1, 1000);
+}
+
+
+
+int main(int argc, char** argv)
+{
+	if( argc>1 )
+		msgsz = atoi(argv[1]);
+	if( argc>2 )
+		count = atoi(argv[2]);
+	if( argc>3 )
+		strcpy(port, argv[3]);
+
+	// start echo server, connect
+	std::thread srv(server);
+	mjSocket soc;
+	strcpy(soc.portListen, port);
+	mjSleep(100);
+	if( !soc.connectClient(5000, "127.0.0.1") )
+	{
+		printf("could not connect to 127.0.0.1:%s\n", port);
+		srv.join();
+		return 1;
+	}
+
+	// ping-pong: round-trip latency
+	std::vector<char> buf(msgsz, 1);
+	std::vector<long long> rtt(count);
+	long long tmStart = nowNS();
+	for( int i=0; i<count; i++ )
+	{
+		long long t0 = nowNS();
+		if( soc.sendBuffer(buf.data(), msgsz, 1000)!=mjSOC_OK ||
+			soc.recvBuffer(buf.data(), msgsz, 1000)!=mjSOC_OK )
+		{
+			printf("ping-pong failed at message %d\n", i);
+			srv.join();
+			return 1;
+		}
+		rtt[i] = nowNS() - t0;
+	}
+	double pingsec = 1e-9*(double)(nowNS() - tmStart);
+
+	// stream: one-way throughput
+	tmStart = nowNS();
+	for( int i=0; i<count; i++ )
+		soc.sendBuffer(buf.data(), msgsz, 1000);
+	soc.recvBuffer(buf.data(), 1, 5000);
+	double streamsec = 1e-9*(double)(nowNS() - tmStart);
+	srv.join();
+
+	// report
+	std::sort(rtt.begin(), rtt.end());
+	printf("mjSocket loopback, %d messages of %d bytes\n", count, msgsz);
+	printf("  ping-pong : %10.0f msg/s   rtt p50 %7.1f us   p99 %7.1f us   max %7.1f us\n",
+		count/pingsec, 1e-3*rtt[count/2], 1e-3*rtt[(count*99)/100], 1e-3*rtt[count-1]);
+	printf("  stream    : %10.0f msg/s   %7.1f MB/s\n",
+		count/streamsec, 1e-6*(double)count*msgsz/streamsec);
+	return 0;
+}
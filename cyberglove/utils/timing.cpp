@@ -0,0 +1,199 @@
+//-----------------------------------//
+//  Monotonic high-resolution timing for the cyberglove project      //
+//-----------------------------------//
+
+#include "timing.h"
+
+#include <string.h>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#else
+	#include <time.h>
+	#include <sys/resource.h>
+	#ifndef CLOCK_MONOTONIC_RAW
+		#define CLOCK_MONOTONIC_RAW CLOCK_MONOTONIC
+	#endif
+#endif
+
+
+
+//---------------------------- Clock ----------------------------------------------------
+
+#ifdef _WIN32
+
+// counter frequency (ticks per second)
+static long long tmQueryFreq(void)
+{
+	LARGE_INTEGER f;
+	QueryPerformanceFrequency(&f);
+	return (long long)f.QuadPart;
+}
+
+
+// counter frequency, queried on first use (also from other files' static initializers)
+static long long tmFreq(void)
+{
+	static const long long freq = tmQueryFreq();
+	return freq;
+}
+
+
+// raw counter in nanoseconds; split seconds and remainder to avoid overflow of ticks*1e9
+static long long tmRaw(void)
+{
+	LARGE_INTEGER tm;
+	QueryPerformanceCounter(&tm);
+	long long freq = tmFreq();
+	long long sec = tm.QuadPart / freq;
+	long long rem = tm.QuadPart % freq;
+	return sec*1000000000LL + (rem*1000000000LL)/freq;
+}
+
+
+// resolution of the underlying clock in nanoseconds
+long long mjTimeResolutionNS(void)
+{
+	long long freq = tmFreq();
+	return (1000000000LL + freq - 1) / freq;
+}
+
+
+// CPU time consumed by this process (FILETIME is in 100 nsec units)
+double mjCPUTimeSec(void)
+{
+	FILETIME create, exit, kernel, user;
+	if( !GetProcessTimes(GetCurrentProcess(), &create, &exit, &kernel, &user) )
+		return 0;
+
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+	return 1e-7*(double)(k.QuadPart + u.QuadPart);
+}
+
+#else
+
+// raw monotonic clock in nanoseconds
+static long long tmRaw(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	return (long long)now.tv_sec*1000000000LL + (long long)now.tv_nsec;
+}
+
+
+// resolution of the underlying clock in nanoseconds
+long long mjTimeResolutionNS(void)
+{
+	struct timespec res;
+	clock_getres(CLOCK_MONOTONIC_RAW, &res);
+	return (long long)res.tv_sec*1000000000LL + (long long)res.tv_nsec;
+}
+
+
+// CPU time consumed by this process
+double mjCPUTimeSec(void)
+{
+	struct rusage ru;
+	if( getrusage(RUSAGE_SELF, &ru) )
+		return 0;
+
+	return (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+		1e-6*(double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec);
+}
+
+#endif
+
+
+// process-wide time base, set on first use: a static initializer of another file may
+// read the clock before this file's statics are initialized
+static long long tmBase(void)
+{
+	static const long long base = tmRaw();
+	return base;
+}
+
+// at the latest during static initialization of this file (before any thread starts)
+static const long long _tmBase = tmBase();
+
+
+// nanoseconds since process start
+long long mjTimeNS(void)
+{
+	return tmRaw() - tmBase();
+}
+
+
+
+// seconds since process start
+double mjTimeSec(void)
+{
+	return 1e-9*(double)(tmRaw() - tmBase());
+}
+
+
+
+//---------------------------- Scoped timers --------------------------------------------
+
+static std::mutex _tmStatMtx;						// protects the record list
+static std::vector<mjTimerStat*> _tmStat;			// all records, never freed
+static int _tmNThread = 0;							// threads that created records
+static thread_local char _tmThread[32] = "";		// label of the calling thread
+
+
+// label the calling thread in reports
+void mjTimerThreadName(const char* name)
+{
+	strncpy(_tmThread, name, sizeof(_tmThread)-1);
+	_tmThread[sizeof(_tmThread)-1] = 0;
+}
+
+
+
+// get the calling thread's record for name, create on first use
+mjTimerStat* mjTimerGet(const char* name)
+{
+	std::lock_guard<std::mutex> lock(_tmStatMtx);
+
+	// default thread label
+	if( !_tmThread[0] )
+		snprintf(_tmThread, sizeof(_tmThread), "thread %d", _tmNThread++);
+
+	// existing record (same name reached from another call site)
+	for( size_t i=0; i<_tmStat.size(); i++ )
+		if( !strcmp(_tmStat[i]->name, name) && !strcmp(_tmStat[i]->thread, _tmThread) )
+			return _tmStat[i];
+
+	// new record
+	mjTimerStat* st = new mjTimerStat;
+	memset(st, 0, sizeof(mjTimerStat));
+	st->name = name;
+	strcpy(st->thread, _tmThread);
+	_tmStat.push_back(st);
+	return st;
+}
+
+
+
+// print all records
+void mjTimerReport(FILE* fp)
+{
+	std::lock_guard<std::mutex> lock(_tmStatMtx);
+
+	if( _tmStat.empty() )
+		return;
+
+	fprintf(fp, "%-16s %-24s %10s %12s %12s\n", "thread", "timer", "count", "mean (us)", "max (us)");
+	for( size_t i=0; i<_tmStat.size(); i++ )
+	{
+		mjTimerStat* st = _tmStat[i];
+		fprintf(fp, "%-16s %-24s %10lld %12.2f %12.2f\n", st->thread, st->name, st->count,
+			st->count ? 1e-3*(double)st->totalNS/(double)st->count : 0.0, 1e-3*(double)st->maxNS);
+	}
+}
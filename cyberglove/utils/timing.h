@@ -0,0 +1,81 @@
+//-----------------------------------//
+//  Monotonic high-resolution timing for the cyberglove project      //
+//  One time base shared by the glove, physics, render, log threads  //
+//-----------------------------------//
+
+#pragma once
+
+#include <stdio.h>
+
+
+//---------------------------- Clock ----------------------------------------------------
+//
+// All timestamps are nanoseconds since process start on a single monotonic clock:
+// CLOCK_MONOTONIC_RAW on Linux (not slewed by NTP), QueryPerformanceCounter on
+// Windows (TSC-backed on machines with an invariant TSC). Values taken on different
+// threads are directly comparable, so cross-thread latencies are plain differences.
+
+// nanoseconds since process start
+long long mjTimeNS(void);
+
+// seconds since process start (same base as mjTimeNS)
+double mjTimeSec(void);
+
+// resolution of the underlying clock in nanoseconds
+long long mjTimeResolutionNS(void);
+
+// CPU time (user + kernel, all threads) consumed by this process, in seconds
+double mjCPUTimeSec(void);
+
+
+//---------------------------- Scoped timers --------------------------------------------
+//
+// mjTIMER("name") measures the rest of the enclosing scope. Statistics live in
+// thread-local records, so timing costs two clock reads and no locking; a record
+// is created (under a lock) only the first time a thread reaches the timer.
+// mjTimerReport() reads all records without locking: call it after the timed
+// threads have stopped.
+
+typedef struct _mjTimerStat
+{
+	const char* name;				// timer name (string literal)
+	char thread[32];				// thread label (see mjTimerThreadName)
+	long long count;				// number of measurements
+	long long totalNS;				// accumulated time
+	long long maxNS;				// worst measurement
+} mjTimerStat;
+
+// label the calling thread in reports (default: "thread <n>")
+void mjTimerThreadName(const char* name);
+
+// get the calling thread's record for name, create on first use
+mjTimerStat* mjTimerGet(const char* name);
+
+// print all records
+void mjTimerReport(FILE* fp = stdout);
+
+
+// measure lifetime of this object
+class mjScopedTimer
+{
+public:
+	mjScopedTimer(mjTimerStat* _st) {st = _st; start = mjTimeNS();}
+	~mjScopedTimer()
+	{
+		long long dt = mjTimeNS() - start;
+		st->count++;
+		st->totalNS += dt;
+		if( dt>st->maxNS )
+			st->maxNS = dt;
+	}
+
+private:
+	mjTimerStat* st;
+	long long start;
+};
+
+#define mjTIMER_CAT2(a, b) a##b
+#define mjTIMER_CAT(a, b) mjTIMER_CAT2(a, b)
+#define mjTIMER(name) \
+	static thread_local mjTimerStat* mjTIMER_CAT(_mjTimerStat, __LINE__) = mjTimerGet(name); \
+	mjScopedTimer mjTIMER_CAT(_mjTimer, __LINE__)(mjTIMER_CAT(_mjTimerStat, __LINE__))
@@ -0,0 +1,178 @@
+//---------------------------------//
+//  Headless re-simulation check   //
+//  of puppet logs (.mjl / .mjc)   //
+//---------------------------------//
+
+#include "mujoco.h"
+#include "timing.h"
+#include "mjlog.h"
+#include "mjlcheck.h"
+#include "mjlcatalog.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+
+//-------------------------------- check ------------------------------------------------
+//
+// Each log is checked on a thread of its own with its own model (reset records of
+// session logs change model parameters) and its own mapping of the log. Loading is
+// serialized: the XML parser is not thread safe. The errors of every compared state
+// are written next to the log in <log>.div; the summary lines are printed in
+// argument order once all logs are done.
+
+std::mutex loadmtx;
+
+
+// does name end with ext
+bool hasExt(const char* name, const char* ext)
+{
+    size_t n = strlen(name), e = strlen(ext);
+    return (n>e && !strcmp(name+n-e, ext));
+}
+
+
+// load a model (serialized)
+mjModel* loadModel(const char* filename, char* error, int nerror)
+{
+    std::lock_guard<std::mutex> lock(loadmtx);
+    if( hasExt(filename, ".mjb") )
+    {
+        snprintf(error, nerror, "could not load binary model %s", filename);
+        return mj_loadModel(filename, 0);
+    }
+    return mj_loadXML(filename, 0, error, nerror);
+}
+
+
+// check one log; summary line in out; true if it re-simulates within tolerance
+bool checkLog(const char* modelfile, const char* logfile, double tol, std::string& out)
+{
+    char line[1000], error[500] = "";
+    mjlCheck res;
+    memset(&res, 0, sizeof(res));
+    res.first = -1;
+    bool ok = false;
+
+    mjModel* m = loadModel(modelfile, error, sizeof(error));
+    mjlReader log;
+    if( !m )
+        snprintf(res.message, sizeof(res.message), "%s", error);
+    else if( !log.open(logfile) )
+        snprintf(res.message, sizeof(res.message), "could not open the log");
+    else
+    {
+        std::string divfile = std::string(logfile) + ".div";
+        FILE* frames = fopen(divfile.c_str(), "w");
+        ok = mjl_check(m, log, &res, frames, tol);
+        if( frames )
+            fclose(frames);
+        log.close();
+    }
+    if( m )
+        mj_deleteModel(m);
+
+    const char* status = (!ok ? "ERROR" : res.ndiffer ? "DIVERGED" : "OK");
+    snprintf(line, sizeof(line), "%-8s %-5s %9lld %9lld %9lld %9lld %10.3g %10.3g %10.3g %10.3g  %s%s%s\n",
+             status, res.exact ? "exact" : "float", res.nstep, res.ncompared, res.ndiffer, res.first,
+             res.qpos, res.qvel, res.runqpos, res.runqvel, logfile, res.message[0] ? ": " : "", res.message);
+    out = line;
+    return (ok && !res.ndiffer);
+}
+
+
+// Instructions
+const char* help =
+    "-----------------------------------------------------------------\n"
+    "logcheck: re-simulate logs and compare with the logged states\n"
+    "Usage:\t logcheck [tolerance] modelfile logfile\n"
+    "\t logcheck [tolerance] logfile [logfile ...]\n"
+    "Note:\t without modelfile, each log uses the model saved next to it\n"
+    "\t (<log name>.xml); logs are checked in parallel, one per core\n"
+    "\t session logs must match exactly; other logs, stepped once from each\n"
+    "\t logged state, must match the next within tolerance (default 1e-4)\n"
+    "\t errors of every compared state are written to <log>.div\n"
+    "\t columns: status, exact/float, steps, compared, differ, first,\n"
+    "\t max |qpos|, |qvel| step error, max |qpos|, |qvel| free-run error\n"
+    "-----------------------------------------------------------------\n\n";
+
+
+int main(int argc, const char** argv)
+{
+    if( argc<2 )
+    {
+        printf("%s", help);
+        return 1;
+    }
+
+    // internal version check
+    if( mjVERSION_HEADER!=mj_version() )
+        mju_error("MuJoCo headers and library have different versions");
+
+    // activate
+    char licensePath[1000];
+    const char* mujocoPath = getenv("MUJOCOPATH");
+    if( !mujocoPath )
+    {
+        printf("WARNING:: Environment variable 'MUJOCOPATH' not found. Defaulting to the local folder\n");
+        mujocoPath = ".";
+    }
+    sprintf(licensePath, "%s/mjkey.txt", mujocoPath);
+    if( !mj_activate(licensePath) )
+        printf("ERROR:: Failed to activate license\n");
+
+    // one-step tolerance
+    double tol = mjlCHECK_TOL;
+    char* end;
+    int a = 1;
+    if( argc>2 && strtod(argv[1], &end)>0 && !*end )
+        tol = atof(argv[a++]);
+
+    // logs and their models
+    std::vector<std::string> logs, models;
+    if( argc-a==2 && (hasExt(argv[a], ".xml") || hasExt(argv[a], ".mjb")) )
+    {
+        models.push_back(argv[a]);
+        logs.push_back(argv[a+1]);
+    }
+    else
+        for( int i=a; i<argc; i++ )
+        {
+            logs.push_back(argv[i]);
+            models.push_back(mjl_modelPath(argv[i]));
+        }
+
+    // check in parallel
+    int nfile = (int)logs.size();
+    std::vector<std::string> out(nfile);
+    std::atomic<int> next(0), nfail(0);
+    int nthread = (int)std::thread::hardware_concurrency();
+    nthread = (nthread<1 ? 1 : nthread>nfile ? nfile : nthread);
+    std::vector<std::thread> pool;
+    long long t0 = mjTimeNS();
+    for( int t=0; t<nthread; t++ )
+        pool.push_back(std::thread([&]()
+        {
+            int i;
+            while( (i = next++)<nfile )
+                if( !checkLog(models[i].c_str(), logs[i].c_str(), tol, out[i]) )
+                    nfail++;
+        }));
+    for( int t=0; t<nthread; t++ )
+        pool[t].join();
+
+    printf("%-8s %-5s %9s %9s %9s %9s %10s %10s %10s %10s  %s\n", "status", "mode", "steps", "compared",
+           "differ", "first", "qpos", "qvel", "run qpos", "run qvel", "log");
+    for( int i=0; i<nfile; i++ )
+        printf("%s", out[i].c_str());
+    printf("%d logs, %d diverged or failed, %d threads, %.2f sec\n", nfile, (int)nfail, nthread,
+           1e-9*(double)(mjTimeNS()-t0));
+
+    mj_deactivate();
+    return (nfail ? 1 : 0);
+}
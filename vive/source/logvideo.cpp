@@ -0,0 +1,709 @@
+//---------------------------------//
+//  Headless video export of       //
+//  puppet logs (.mjl / .mjc)      //
+//---------------------------------//
+
+#include "mujoco.h"
+#include "timing.h"
+#include "mjlog.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+    #define popen _popen
+    #define pclose _pclose
+#endif
+
+// offscreen context: EGL or OSMesa (no display, no GPU needed), else a hidden GLFW window
+#if defined(MJ_EGL)
+    #include <EGL/egl.h>
+#elif defined(MJ_OSMESA)
+    #include <GL/osmesa.h>
+    OSMesaContext osmesa = 0;
+    unsigned char osmesabuf[800*800*4];    // default framebuffer, MuJoCo renders offscreen
+#else
+    #include "glfw3.h"
+    GLFWwindow* window = 0;
+#endif
+
+
+//-------------------------------- global variables -------------------------------------
+
+// model and data
+mjModel* m = 0;
+mjData* d = 0;
+mjlReader logReader;
+int master = 0;                 // log stream with the smallest decimation, drives the frames
+long long readahead = 0;        // records prefetched around the current frame
+
+// rendering
+mjvScene scn;
+mjvCamera cam;
+mjvOption vopt;
+mjrContext con;
+mjrRect viewport;
+
+// video frames: the render loop fills slots, the writer thread writes them in order
+const int vidNSLOT = 8;
+unsigned char* slot[vidNSLOT];
+size_t framesz = 0;
+long long filled = 0;           // frames rendered into slots
+long long written = 0;          // frames written
+bool stop = false;
+std::mutex mtx;
+std::condition_variable cond;
+FILE* fp = 0;
+bool image = false;             // single PPM image, rows written top first
+
+
+//-------------------------------- OpenGL -----------------------------------------------
+
+// create OpenGL context for offscreen rendering
+void initOpenGL(void)
+{
+#if defined(MJ_EGL)
+    const EGLint configAttribs[] =
+    {
+        EGL_RED_SIZE,           8,
+        EGL_GREEN_SIZE,         8,
+        EGL_BLUE_SIZE,          8,
+        EGL_ALPHA_SIZE,         8,
+        EGL_DEPTH_SIZE,         24,
+        EGL_STENCIL_SIZE,       8,
+        EGL_COLOR_BUFFER_TYPE,  EGL_RGB_BUFFER,
+        EGL_SURFACE_TYPE,       EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE,    EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+
+    // default display, first matching config
+    EGLDisplay dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    EGLint major, minor, nconfig;
+    EGLConfig cfg;
+    if( dpy==EGL_NO_DISPLAY || eglInitialize(dpy, &major, &minor)!=EGL_TRUE )
+        mju_error_i("Could not initialize EGL, error 0x%x", eglGetError());
+    if( eglChooseConfig(dpy, configAttribs, &cfg, 1, &nconfig)!=EGL_TRUE || nconfig<1 )
+        mju_error_i("Could not choose EGL config, error 0x%x", eglGetError());
+    if( eglBindAPI(EGL_OPENGL_API)!=EGL_TRUE )
+        mju_error_i("Could not bind EGL OpenGL API, error 0x%x", eglGetError());
+
+    // context without surface, MuJoCo renders into its own framebuffer object
+    EGLContext ctx = eglCreateContext(dpy, cfg, EGL_NO_CONTEXT, NULL);
+    if( ctx==EGL_NO_CONTEXT || eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx)!=EGL_TRUE )
+        mju_error_i("Could not create EGL context, error 0x%x", eglGetError());
+
+#elif defined(MJ_OSMESA)
+    osmesa = OSMesaCreateContextExt(GL_RGBA, 24, 8, 8, 0);
+    if( !osmesa )
+        mju_error("Could not create OSMesa context");
+    if( !OSMesaMakeCurrent(osmesa, osmesabuf, GL_UNSIGNED_BYTE, 800, 800) )
+        mju_error("Could not make OSMesa context current");
+
+#else
+    if( !glfwInit() )
+        mju_error("Could not initialize GLFW");
+
+    // invisible single-buffered window: no vsync, no events
+    glfwWindowHint(GLFW_VISIBLE, 0);
+    glfwWindowHint(GLFW_DOUBLEBUFFER, GLFW_FALSE);
+    window = glfwCreateWindow(800, 800, "logvideo", NULL, NULL);
+    if( !window )
+        mju_error("Could not create GLFW window");
+    glfwMakeContextCurrent(window);
+#endif
+}
+
+
+// close OpenGL context
+void closeOpenGL(void)
+{
+#if defined(MJ_EGL)
+    EGLDisplay dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if( dpy!=EGL_NO_DISPLAY )
+        eglTerminate(dpy);
+#elif defined(MJ_OSMESA)
+    OSMesaDestroyContext(osmesa);
+#else
+    glfwTerminate();
+#endif
+}
+
+
+//-------------------------------- log playback -----------------------------------------
+
+// mjData array of a log field
+mjtNum* fieldData(int field)
+{
+    switch( field )
+    {
+    case mjlFIELD_QPOS:         return d->qpos;
+    case mjlFIELD_QVEL:         return d->qvel;
+    case mjlFIELD_CTRL:         return d->ctrl;
+    case mjlFIELD_MOCAP_POS:    return d->mocap_pos;
+    case mjlFIELD_MOCAP_QUAT:   return d->mocap_quat;
+    case mjlFIELD_SENSORDATA:   return d->sensordata;
+    default:                    return d->userdata;
+    }
+}
+
+
+// copy the mjData fields of a record of stream s (after its time) into d
+void setStream(int s, const float* data)
+{
+    const mjlStream& st = logReader.getStream(s);
+    const float* src = data+1;
+    for( int i=0; i<st.nfield; i++ )
+    {
+        if( st.field[i]<mjlNDATAFIELD )
+            mju_f2n(fieldData(st.field[i]), src, st.size[i]);
+        src += st.size[i];
+    }
+}
+
+
+// stream has mjData fields to show
+bool hasData(int s)
+{
+    const mjlStream& st = logReader.getStream(s);
+    for( int i=0; i<st.nfield; i++ )
+        if( st.field[i]<mjlNDATAFIELD )
+            return true;
+    return false;
+}
+
+
+// set record f of the master stream, hold the other streams at its time (in the time
+// segment of their record of the same step)
+bool setFrame(long long f)
+{
+    logReader.prefetch(f, readahead, master);
+    const float* data = logReader.record(f, master);
+    if( !data )
+        return false;
+
+    d->time = (mjtNum)data[0];
+    setStream(master, data);
+    long long step = f*logReader.getStream(master).decimation;
+    for( int s=0; s<logReader.getNStream(); s++ )
+        if( s!=master && hasData(s) )
+        {
+            int dec = logReader.getStream(s).decimation;
+            long long fs = logReader.find(d->time, s, dec>0 ? step/dec : -1);
+            const float* sdata = (fs>=0 ? logReader.record(fs, s) : 0);
+            if( sdata )
+                setStream(s, sdata);
+        }
+    return true;
+}
+
+
+// map logfile, pick the stream that drives the frames
+void openLog(const char* logfile)
+{
+    if( !logReader.open(logfile) )
+        mju_error("Could not open logfile");
+
+    // frames follow the densest stream with mjData fields
+    master = logReader.getMasterStream();
+    if( master<0 || !logReader.getNRecord(master) )
+        mju_error("Logfile has no qpos/qvel/ctrl/... records to render");
+    if( !logReader.record(0, master) || !logReader.record(logReader.getNRecord(master)-1, master) )
+        mju_error("Could not read the first and last records of the logfile");
+    readahead = mjMAX(256, (long long)((16<<20)/(sizeof(float)*logReader.getRecsz(master))));
+}
+
+
+// time restarts at a reset: each time segment of the master stream is rendered in
+// turn, from its first record at fps
+std::vector<long long> segFrame;    // video frames up to the end of each segment
+std::vector<double> segTime;        // time of the first record of each segment
+
+
+// number of video frames at fps
+long long frameCount(double fps)
+{
+    const std::vector<long long>& seg = logReader.getSegments(master);
+    long long nrec = logReader.getNRecord(master), n = 0;
+    segFrame.clear();
+    segTime.clear();
+    for( size_t k=0; k<seg.size(); k++ )
+    {
+        long long last = (k+1<seg.size() ? seg[k+1] : nrec) - 1;
+        const float* rec = logReader.record(seg[k], master);
+        segTime.push_back(rec ? rec[0] : 0);
+        rec = logReader.record(last, master);
+        n += (long long)(((rec ? rec[0] : segTime[k]) - segTime[k])*fps) + 1;
+        segFrame.push_back(n);
+    }
+    return n;
+}
+
+
+// record of video frame k (frameCount called), -1 if there is none
+long long frameRecord(long long k, double fps)
+{
+    size_t j = std::upper_bound(segFrame.begin(), segFrame.end(), k) - segFrame.begin();
+    if( j==segFrame.size() )
+        return -1;
+    long long k0 = (j ? segFrame[j-1] : 0);
+    return logReader.find(segTime[j] + (k-k0)/fps, master, logReader.getSegments(master)[j]);
+}
+
+
+// load model (log already open), make rendering context of size W x H
+void initMuJoCo(const char* filename, int W, int H)
+{
+    // activate
+    char licensePath[1000];
+    const char* mujocoPath = getenv("MUJOCOPATH");
+    if( !mujocoPath )
+    {
+        printf("WARNING:: Environment variable 'MUJOCOPATH' not found. Defaulting to the local folder\n");
+        mujocoPath = ".";
+    }
+    sprintf(licensePath, "%s/mjkey.txt", mujocoPath);
+    if( !mj_activate(licensePath) )
+        printf("ERROR:: Failed to activate license\n");
+
+    // load and compile model
+    char error[1000] = "Could not load binary model";
+    if( strlen(filename)>4 && !strcmp(filename+strlen(filename)-4, ".mjb") )
+        m = mj_loadModel(filename, 0);
+    else
+        m = mj_loadXML(filename, 0, error, 1000);
+    if( !m )
+        mju_error_s("Load model error: %s", error);
+
+    // check sizes
+    const int* header = logReader.getSizes();
+    if( m->nq!=header[0] || m->nv!=header[1] || m->nu!=header[2] ||
+        m->nmocap!=header[3] || m->nsensordata!=header[4] || m->nuserdata!=header[5] )
+        mju_error("Model sizes incompatible with sizes found in logfile header");
+    d = mj_makeData(m);
+
+    // offscreen buffer of the video size
+    m->vis.global.offwidth = W;
+    m->vis.global.offheight = H;
+    mjv_makeScene(m, &scn, 1000);
+    mjv_defaultCamera(&cam);
+    mjv_defaultOption(&vopt);
+    mjr_defaultContext(&con);
+    mjr_makeContext(m, &con, 150);
+    mjr_setBuffer(mjFB_OFFSCREEN, &con);
+    if( con.currentBuffer!=mjFB_OFFSCREEN )
+        mju_error("Offscreen rendering not supported");
+    viewport = mjr_maxViewport(&con);
+    if( viewport.width!=W || viewport.height!=H )
+        printf("Warning: offscreen buffer is %dx%d\n", viewport.width, viewport.height);
+
+    // same view as playlog
+    cam.lookat[0] = m->stat.center[0];
+    cam.lookat[1] = m->stat.center[1];
+    cam.lookat[2] = m->stat.center[2];
+    cam.distance = 1.5 * m->stat.extent;
+    cam.type = mjCAMERA_FREE;
+}
+
+
+// deallocate everything
+void closeMuJoCo(void)
+{
+    logReader.close();
+    mj_deleteData(d);
+    mj_deleteModel(m);
+    mjr_freeContext(&con);
+    mjv_freeScene(&scn);
+    mj_deactivate();
+}
+
+
+//-------------------------------- video output -----------------------------------------
+//
+// Video files ending in .mp4/.mkv/.mov/.avi are encoded by an ffmpeg process fed
+// through a pipe (H.264, flipped upright, encoded on ffmpeg's threads while the
+// next frames render); a name ending in .ppm receives one binary PPM image (top row
+// first, used as the log's thumbnail by mjltool catalog); any other name receives raw
+// rgb24 frames, bottom row first.
+
+// name asks for an encoded video
+bool isEncoded(const char* name)
+{
+    const char* ext[] = {".mp4", ".mkv", ".mov", ".avi"};
+    size_t n = strlen(name);
+    for( int i=0; i<4; i++ )
+        if( n>4 && !strcmp(name+n-4, ext[i]) )
+            return true;
+    return false;
+}
+
+
+// name asks for a single PPM image
+bool isImage(const char* name)
+{
+    size_t n = strlen(name);
+    return (n>4 && !strcmp(name+n-4, ".ppm"));
+}
+
+
+// open raw file, or start ffmpeg reading W x H rgb24 frames at fps from a pipe
+FILE* openVideo(const char* name, int W, int H, double fps)
+{
+    if( isImage(name) )
+    {
+        FILE* img = fopen(name, "wb");
+        if( img )
+            fprintf(img, "P6\n%d %d\n255\n", W, H);
+        return img;
+    }
+    if( !isEncoded(name) )
+        return fopen(name, "wb");
+
+    // odd sizes are padded: yuv420p needs even width and height
+    char cmd[1000];
+    snprintf(cmd, sizeof(cmd), "ffmpeg -loglevel error -y -f rawvideo -pixel_format rgb24 "
+             "-video_size %dx%d -framerate %g -i - -vf \"vflip,pad=ceil(iw/2)*2:ceil(ih/2)*2\" "
+             "-c:v libx264 -preset fast -crf 18 -pix_fmt yuv420p \"%s\"", W, H, fps, name);
+#ifdef _WIN32
+    return popen(cmd, "wb");
+#else
+    return popen(cmd, "w");
+#endif
+}
+
+
+// close video; false if ffmpeg failed
+bool closeVideo(FILE* fp, const char* name)
+{
+    if( !isEncoded(name) )
+        return (fclose(fp)==0);
+    return (pclose(fp)==0);
+}
+
+
+// size of a file in bytes, 0 if missing
+long long fileSize(const char* name)
+{
+    FILE* fp = fopen(name, "rb");
+    if( !fp )
+        return 0;
+    fseek(fp, 0, SEEK_END);
+    long long sz = ftell(fp);
+    fclose(fp);
+    return sz;
+}
+
+
+// writer thread: write rendered frames in order
+void writer(void)
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    while( true )
+    {
+        cond.wait(lock, []{ return stop || written<filled; });
+        if( written==filled )
+            return;
+
+        unsigned char* frame = slot[written%vidNSLOT];
+        lock.unlock();
+        if( image )
+        {
+            size_t rowsz = (size_t)3*viewport.width;
+            for( int r=viewport.height-1; r>=0; r-- )
+                fwrite(frame + r*rowsz, 1, rowsz, fp);
+        }
+        else
+            fwrite(frame, 1, framesz, fp);
+        lock.lock();
+
+        written++;
+        cond.notify_all();
+    }
+}
+
+
+// render video frames [first, last) of the log at fps into a raw rgb24 file, as fast
+// as rendering allows
+int exportVideo(const char* videofile, double fps, long long first, long long last)
+{
+    fp = openVideo(videofile, viewport.width, viewport.height, fps);
+    if( !fp )
+    {
+        printf("Could not create %s\n", videofile);
+        return 1;
+    }
+    framesz = (size_t)3*viewport.width*viewport.height;
+    for( int i=0; i<vidNSLOT; i++ )
+        if( !(slot[i] = (unsigned char*)malloc(framesz)) )
+            mju_error("Could not allocate frame buffers");
+    std::thread thread(writer);
+
+    // one frame every 1/fps sec of log time (decimated logs hold their last record)
+    long long tmStart = mjTimeNS(), tmRender = 0;
+    for( long long k=first; k<last; k++ )
+    {
+        long long f = frameRecord(k, fps);
+        if( f<0 || !setFrame(f) )
+        {
+            printf("Corrupt record in logfile, stopping at frame %lld\n", k);
+            break;
+        }
+        mj_forward(m, d);
+
+        // wait for a free slot
+        unsigned char* rgb;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cond.wait(lock, []{ return filled-written<vidNSLOT; });
+            rgb = slot[filled%vidNSLOT];
+        }
+
+        // render with time stamp, read into the slot
+        long long tm = mjTimeNS();
+        char stamp[50];
+        sprintf(stamp, "Time = %.3f", d->time);
+        mjv_updateScene(m, d, &vopt, NULL, &cam, mjCAT_ALL, &scn);
+        mjr_render(viewport, &scn, &con);
+        mjr_overlay(mjFONT_NORMAL, mjGRID_TOPLEFT, viewport, stamp, NULL, &con);
+        mjr_readPixels(rgb, NULL, viewport, &con);
+        tmRender += mjTimeNS()-tm;
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            filled++;
+            cond.notify_all();
+        }
+
+        // progress every 100 frames: '.' if ok, 'x' if OpenGL error
+        if( ((k-first)%100)==0 )
+        {
+            printf(mjr_getError() ? "x" : ".");
+            fflush(stdout);
+        }
+    }
+
+    // drain
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stop = true;
+        cond.notify_all();
+    }
+    thread.join();
+    bool ok = closeVideo(fp, videofile);
+    for( int i=0; i<vidNSLOT; i++ )
+        free(slot[i]);
+
+    double sec = 1e-9*(double)(mjTimeNS()-tmStart);
+    printf("\n%s: %lld frames %dx%d at %g fps (%.1f sec of log) in %.1f sec: %.1f frames/sec, %.1fx real time\n",
+           videofile, filled, viewport.width, viewport.height, fps, filled/fps, sec,
+           sec>0 ? filled/sec : 0, sec>0 ? filled/fps/sec : 0);
+    printf("render+readback %.2f ms/frame\n", filled ? 1e-6*(double)tmRender/filled : 0);
+    if( isEncoded(videofile) )
+    {
+        double raw = (double)framesz*filled, sz = (double)fileSize(videofile);
+        printf("encoded %.2f MB (%.0fx smaller than raw) at %.1f frames/sec\n", 1e-6*sz,
+               sz>0 ? raw/sz : 0, sec>0 ? filled/sec : 0);
+    }
+    if( !ok )
+        printf("Could not write %s%s\n", videofile, isEncoded(videofile) ? " (is ffmpeg on the PATH?)" : "");
+    return (ok && filled==last-first ? 0 : 1);
+}
+
+
+
+//-------------------------------- parallel export --------------------------------------
+//
+// The frames are split into njob contiguous ranges, each rendered by a logvideo
+// process of its own (own OpenGL context, own mapping of the log) into a part file;
+// the parts are then joined in order: raw frames by concatenation, encoded parts by
+// ffmpeg's concat demuxer (no re-encoding).
+
+// append file src to dst, delete src
+bool appendPart(FILE* dst, const char* src)
+{
+    FILE* fp = fopen(src, "rb");
+    if( !fp )
+        return false;
+
+    std::vector<char> buf(1<<20);
+    size_t n;
+    bool ok = true;
+    while( ok && (n = fread(buf.data(), 1, buf.size(), fp))>0 )
+        ok = (fwrite(buf.data(), 1, n, dst)==n);
+    fclose(fp);
+    remove(src);
+    return ok;
+}
+
+
+// join encoded parts with ffmpeg (stream copy), delete them
+bool joinEncoded(const char* videofile, const std::vector<std::string>& part)
+{
+    std::string list = std::string(videofile) + ".parts.txt";
+    FILE* fp = fopen(list.c_str(), "w");
+    if( !fp )
+        return false;
+    for( size_t j=0; j<part.size(); j++ )
+    {
+        // names relative to the list file
+        std::string name = part[j];
+        size_t slash = name.find_last_of("/\\");
+        if( slash!=std::string::npos )
+            name = name.substr(slash+1);
+        fprintf(fp, "file '%s'\n", name.c_str());
+    }
+    fclose(fp);
+
+    std::string cmd = "ffmpeg -loglevel error -y -f concat -safe 0 -i \"" + list + "\" -c copy \"" +
+                      videofile + "\"";
+#ifdef _WIN32
+    cmd = "\"" + cmd + "\"";
+#endif
+    bool ok = (system(cmd.c_str())==0);
+    remove(list.c_str());
+    for( size_t j=0; j<part.size(); j++ )
+        remove(part[j].c_str());
+    return ok;
+}
+
+
+// run njob logvideo processes over frame ranges, join their parts into videofile
+int exportParallel(const char* exe, const char** argv, double fps, int njob)
+{
+    const char* videofile = argv[3];
+    long long nframe = frameCount(fps);
+    njob = (int)mjMIN((long long)njob, nframe);
+    logReader.close();
+
+    // one process per range: logvideo model log part W H fps first last
+    long long tmStart = mjTimeNS();
+    std::vector<std::string> part(njob);
+    std::vector<int> ret(njob, 0);
+    std::vector<std::thread> pool;
+    for( int j=0; j<njob; j++ )
+    {
+        long long first = nframe*j/njob, last = nframe*(j+1)/njob;
+        char range[100], name[20];
+        sprintf(range, " %lld %lld", first, last);
+        sprintf(name, ".part%d", j);
+        part[j] = std::string(videofile) + name;
+        if( isEncoded(videofile) )
+            part[j] += std::string(videofile + strlen(videofile) - 4);
+
+        std::string cmd = std::string("\"") + exe + "\" \"" + argv[1] + "\" \"" + argv[2] + "\" \"" +
+                          part[j] + "\" " + argv[4] + " " + argv[5] + " " + argv[6] + range;
+#ifdef _WIN32
+        cmd = "\"" + cmd + "\"";       // cmd.exe strips the outer quotes
+#endif
+        pool.push_back(std::thread([cmd, j, &ret]{ ret[j] = system(cmd.c_str()); }));
+    }
+    for( int j=0; j<njob; j++ )
+        pool[j].join();
+
+    // join in order
+    bool ok = true;
+    for( int j=0; j<njob; j++ )
+        if( ret[j] )
+        {
+            printf("Part %d failed (exit code %d)\n", j, ret[j]);
+            ok = false;
+        }
+    if( ok && isEncoded(videofile) )
+        ok = joinEncoded(videofile, part);
+    else if( ok )
+    {
+        FILE* fp = fopen(videofile, "wb");
+        ok = (fp!=0);
+        for( int j=0; j<njob; j++ )
+            ok = ok && appendPart(fp, part[j].c_str());
+        if( fp )
+            fclose(fp);
+    }
+    if( !ok )
+    {
+        printf("Could not export %s\n", videofile);
+        return 1;
+    }
+
+    double sec = 1e-9*(double)(mjTimeNS()-tmStart);
+    printf("\n%s: %lld frames at %g fps by %d processes in %.1f sec: %.1f frames/sec, %.1fx real time\n",
+           videofile, nframe, fps, njob, sec, sec>0 ? nframe/sec : 0, sec>0 ? nframe/fps/sec : 0);
+    if( isEncoded(videofile) )
+        printf("encoded %.2f MB\n", 1e-6*(double)fileSize(videofile));
+    return 0;
+}
+
+
+// Instructions
+const char* help =
+    "-----------------------------------------------------------------\n"
+    "logvideo: render a log to video without a window\n"
+    "Usage:\t logvideo modelfile logfile video_name W H fps [njob]\n"
+    "\t logvideo modelfile logfile video_name W H fps first last\n"
+    "Note:\t frames are 1/fps apart in log time, rendered as fast as possible\n"
+    "\t njob processes render parts of the log in parallel (default 1)\n"
+    "\t first last: render only video frames [first, last)\n"
+    "\t video_name .mp4/.mkv/.mov/.avi: H.264 through ffmpeg, else raw rgb24\n"
+    "\t video_name .ppm: one image from the middle of the log (catalog thumbnail)\n"
+    "\t build with MJ_EGL or MJ_OSMESA for machines without a display/GPU\n"
+    "-----------------------------------------------------------------\n\n";
+
+
+int main(int argc, const char** argv)
+{
+    if( argc<7 || argc>9 )
+    {
+        printf("%s", help);
+        return 1;
+    }
+
+    // internal version check
+    if( mjVERSION_HEADER!=mj_version() )
+        mju_error("MuJoCo headers and library have different versions");
+
+    int W = atoi(argv[4]), H = atoi(argv[5]);
+    double fps = atof(argv[6]);
+    if( W<=0 || H<=0 || fps<=0 )
+    {
+        printf("Bad video size or fps\n");
+        return 1;
+    }
+
+    // frame range
+    openLog(argv[2]);
+    long long nframe = frameCount(fps), first = 0, last = nframe;
+    if( argc==9 )
+    {
+        first = mjMAX(0, atoll(argv[7]));
+        last = mjMIN(nframe, atoll(argv[8]));
+    }
+
+    // single image: middle frame
+    image = isImage(argv[3]);
+    if( image )
+    {
+        first = nframe/2;
+        last = mjMIN(nframe, first+1);
+    }
+
+    // parallel: this process only splits and joins
+    int njob = (argc==8 && !image ? atoi(argv[7]) : 1);
+    if( njob>1 )
+        return exportParallel(argv[0], argv, fps, njob);
+
+    initOpenGL();
+    initMuJoCo(argv[1], W, H);
+    int ret = exportVideo(argv[3], fps, first, last);
+    closeMuJoCo();
+    closeOpenGL();
+    if( argc!=9 && !isEncoded(argv[3]) && !image )
+        printf("ffmpeg -f rawvideo -pixel_format rgb24 -video_size %dx%d -framerate %g -i %s -vf \"vflip\" video.mp4\n",
+               W, H, fps, argv[3]);
+    return ret;
+}
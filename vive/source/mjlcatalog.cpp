@@ -0,0 +1,284 @@
+//---------------------------------//
+//  Catalog of puppet log files    //
+//---------------------------------//
+
+#include "mjlcatalog.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+	#define mjl_stat _stat64
+	#define mjl_fseek _fseeki64
+#else
+	#define mjl_stat stat
+	#define mjl_fseek fseeko
+#endif
+
+
+// size and modification time of a file
+bool mjl_fileInfo(const char* path, long long* size, long long* mtime)
+{
+	struct mjl_stat st;
+	if( mjl_stat(path, &st) )
+		return false;
+
+	*size = (long long)st.st_size;
+	*mtime = (long long)st.st_mtime;
+	return true;
+}
+
+
+
+// absolute path of an existing file or directory
+std::string mjl_fullPath(const char* path)
+{
+#ifdef _WIN32
+	char buf[_MAX_PATH];
+	if( !_fullpath(buf, path, sizeof(buf)) )
+		return path;
+
+	// '/' separators, doubled ones removed (except the leading pair of a UNC path)
+	std::string full;
+	for( size_t i=0; buf[i]; i++ )
+	{
+		char c = (buf[i]=='\\' ? '/' : buf[i]);
+		if( c!='/' || i<2 || full.empty() || full[full.size()-1]!='/' )
+			full += c;
+	}
+	return full;
+#else
+	char* buf = realpath(path, 0);
+	if( !buf )
+		return path;
+	std::string full(buf);
+	free(buf);
+	return full;
+#endif
+}
+
+
+
+// path without the extension
+static std::string stemOf(const char* path)
+{
+	std::string name(path);
+	size_t dot = name.find_last_of('.');
+	size_t slash = name.find_last_of("/\\");
+	if( dot!=std::string::npos && (slash==std::string::npos || dot>slash) )
+		name = name.substr(0, dot);
+	return name;
+}
+
+
+
+// model file next to a log
+std::string mjl_modelPath(const char* logpath)
+{
+	return stemOf(logpath) + ".xml";
+}
+
+
+
+// CRC-32C of a file, 0 if it cannot be read
+static unsigned int fileCRC(const char* path)
+{
+	FILE* fp = fopen(path, "rb");
+	if( !fp )
+		return 0;
+
+	unsigned int crc = 0;
+	char buf[1<<16];
+	size_t n;
+	while( (n = fread(buf, 1, sizeof(buf), fp))>0 )
+		crc = mjl_crc32(crc, buf, n);
+	fclose(fp);
+	return (crc ? crc : 1);
+}
+
+
+
+// thumbnail from a binary PPM (P6, 8 bit), box-filtered to mjlTHUMB_W x mjlTHUMB_H
+static bool readThumb(const char* path, unsigned char* rgb)
+{
+	FILE* fp = fopen(path, "rb");
+	if( !fp )
+		return false;
+
+	int W, H, maxval;
+	std::vector<unsigned char> img;
+	bool ok = (fscanf(fp, "P6 %d %d %d", &W, &H, &maxval)==3 && fgetc(fp)!=EOF &&
+			   W>=mjlTHUMB_W && H>=mjlTHUMB_H && W<=16384 && H<=16384 && maxval==255);
+	if( ok )
+	{
+		img.resize((size_t)3*W*H);
+		ok = (fread(img.data(), 1, img.size(), fp)==img.size());
+	}
+	fclose(fp);
+	if( !ok )
+		return false;
+
+	for( int y=0; y<mjlTHUMB_H; y++ )
+		for( int x=0; x<mjlTHUMB_W; x++ )
+		{
+			int x0 = x*W/mjlTHUMB_W, x1 = (x+1)*W/mjlTHUMB_W;
+			int y0 = y*H/mjlTHUMB_H, y1 = (y+1)*H/mjlTHUMB_H;
+			for( int c=0; c<3; c++ )
+			{
+				long sum = 0;
+				for( int v=y0; v<y1; v++ )
+					for( int u=x0; u<x1; u++ )
+						sum += img[((size_t)v*W+u)*3+c];
+				rgb[(y*mjlTHUMB_W+x)*3+c] = (unsigned char)(sum/((long)(x1-x0)*(y1-y0)));
+			}
+		}
+	return true;
+}
+
+
+
+// describe a log from its header and index
+bool mjl_catalogLog(const char* path, mjlCatalogEntry& e)
+{
+	memset(&e, 0, sizeof(e));
+	if( strlen(path)>=sizeof(e.path) )
+	{
+		printf("%s: path too long for the catalog\n", path);
+		return false;
+	}
+	strcpy(e.path, path);
+	if( !mjl_fileInfo(path, &e.filesz, &e.mtime) )
+	{
+		printf("Could not find %s\n", path);
+		return false;
+	}
+
+	// header and index (.mjc without index: chunk headers)
+	mjlReader rd;
+	if( !rd.open(path) )
+	{
+		printf("Could not open %s\n", path);
+		return false;
+	}
+	memcpy(e.sizes, rd.getSizes(), sizeof(e.sizes));
+	int namelen = rd.getSizes()[6];
+	strncpy(e.model, rd.getNames(), namelen<(int)sizeof(e.model) ? namelen : sizeof(e.model)-1);
+	e.version = rd.getVersion();
+	e.nstream = rd.getNStream();
+
+	// the stream playlog plays
+	int master = rd.getMasterStream();
+
+	// records and time span: .mjc from the index, .mjl from the first and last record
+	if( master>=0 && (e.nrec = rd.getNRecord(master))>0 )
+	{
+		if( rd.isChunked() )
+		{
+			const std::vector<mjlIndexEntry>& index = rd.getIndex();
+			bool first = true;
+			for( size_t c=0; c<index.size(); c++ )
+				if( index[c].stream==master )
+				{
+					if( first )
+						e.t0 = index[c].t0;
+					e.t1 = index[c].t1;
+					first = false;
+				}
+		}
+		else
+		{
+			const float* rec = rd.record(0);
+			e.t0 = (rec ? rec[0] : 0);
+			rec = rd.record(e.nrec-1);
+			e.t1 = (rec ? rec[0] : 0);
+		}
+	}
+	rd.close();
+
+	// model next to the log, thumbnail
+	std::string stem = stemOf(path);
+	e.hash = fileCRC((stem + ".xml").c_str());
+	e.thumb = readThumb((stem + ".ppm").c_str(), e.rgb);
+	return true;
+}
+
+
+
+// read header, check it
+static bool readHeader(FILE* fp, mjlCatalogHeader* h)
+{
+	return fread(h, sizeof(mjlCatalogHeader), 1, fp)==1 && h->magic==mjlMAGIC_CATALOG &&
+		   h->version==mjlCATALOG_VERSION && h->entrysz==(int)sizeof(mjlCatalogEntry) && h->nentry>=0;
+}
+
+
+
+// all entries of a catalog
+bool mjl_readCatalog(const char* filename, std::vector<mjlCatalogEntry>& entries)
+{
+	entries.clear();
+	FILE* fp = fopen(filename, "rb");
+	if( !fp )
+		return false;
+
+	mjlCatalogHeader h;
+	bool ok = readHeader(fp, &h);
+	if( ok )
+	{
+		entries.resize(h.nentry);
+		ok = (!h.nentry || fread(entries.data(), sizeof(mjlCatalogEntry), h.nentry, fp)==(size_t)h.nentry);
+	}
+	fclose(fp);
+	if( !ok )
+		entries.clear();
+	return ok;
+}
+
+
+
+// entry i of a catalog
+bool mjl_catalogEntry(const char* filename, int i, mjlCatalogEntry& e)
+{
+	FILE* fp = fopen(filename, "rb");
+	if( !fp )
+		return false;
+
+	mjlCatalogHeader h;
+	bool ok = (readHeader(fp, &h) && i>=0 && i<h.nentry &&
+			   mjl_fseek(fp, sizeof(h) + (long long)i*sizeof(mjlCatalogEntry), SEEK_SET)==0 &&
+			   fread(&e, sizeof(e), 1, fp)==1);
+	fclose(fp);
+	return ok;
+}
+
+
+
+// write a catalog, through a temporary file so readers never see half of it
+bool mjl_writeCatalog(const char* filename, std::vector<mjlCatalogEntry>& entries)
+{
+	std::sort(entries.begin(), entries.end(),
+		[](const mjlCatalogEntry& a, const mjlCatalogEntry& b){return strcmp(a.path, b.path)<0;});
+
+	std::string tmp = std::string(filename) + ".tmp";
+	FILE* fp = fopen(tmp.c_str(), "wb");
+	if( !fp )
+		return false;
+
+	mjlCatalogHeader h = {mjlMAGIC_CATALOG, mjlCATALOG_VERSION, (int)entries.size(), (int)sizeof(mjlCatalogEntry)};
+	bool ok = (fwrite(&h, sizeof(h), 1, fp)==1 &&
+			   (entries.empty() || fwrite(entries.data(), sizeof(mjlCatalogEntry), entries.size(), fp)==entries.size()));
+	ok = (fclose(fp)==0) && ok;
+
+	// replace (rename does not overwrite on Windows)
+	if( ok )
+	{
+		remove(filename);
+		ok = (rename(tmp.c_str(), filename)==0);
+	}
+	if( !ok )
+		remove(tmp.c_str());
+	return ok;
+}
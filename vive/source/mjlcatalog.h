@@ -0,0 +1,79 @@
+//---------------------------------//
+//  Catalog of puppet log files    //
+//  (.mjl / .mjc, see mjlog.h)     //
+//---------------------------------//
+
+#pragma once
+
+#include "mjlog.h"
+
+#include <string>
+#include <vector>
+
+
+//------------------------- Catalog -----------------------------------------------------
+//
+// A catalog describes a library of logs (puppet writes <logFile>_<timestamp>.log or
+// .mjc next to the model <logFile>_<timestamp>.xml) from their headers and chunk
+// indexes only: no record is decoded. Entries have a fixed size and are sorted by
+// path, so entry i is at a known offset and a viewer opens session i with one seek.
+// Updating a catalog rereads only the logs whose size or modification time changed.
+// Paths are stored in full (mjl_fullPath), so a log is listed once however its
+// directory was given and the catalog can be used from any directory.
+//
+// The thumbnail is taken from an image next to the log, <log name>.ppm (binary PPM,
+// e.g. rendered by logvideo), scaled down to mjlTHUMB_W x mjlTHUMB_H.
+//
+// file: mjlCatalogHeader, mjlCatalogEntry[nentry]
+
+#define mjlMAGIC_CATALOG	0x544A4D4D		// "MMJT"
+#define mjlCATALOG_VERSION	1
+#define mjlTHUMB_W			32
+#define mjlTHUMB_H			24
+
+typedef struct _mjlCatalogHeader
+{
+	int magic;							// mjlMAGIC_CATALOG
+	int version;						// mjlCATALOG_VERSION
+	int nentry;							// entries that follow
+	int entrysz;						// sizeof(mjlCatalogEntry)
+} mjlCatalogHeader;
+
+typedef struct _mjlCatalogEntry
+{
+	char path[256];						// log file (full path)
+	char model[64];						// model name (first name in the log header)
+	unsigned int hash;					// CRC-32C of the model .xml next to the log, 0: none
+	int sizes[6];						// nq nv nu nmocap nsensordata nuserdata
+	int version;						// .mjc version, 0 for .mjl
+	int nstream;						// record streams
+	int thumb;							// rgb holds a thumbnail
+	long long nrec;						// records of the densest stream with mjData fields
+	long long filesz;					// log size in bytes
+	long long mtime;					// log modification time (sec since 1970)
+	double t0;							// time of the first record
+	double t1;							// time of the last record
+	unsigned char rgb[3*mjlTHUMB_W*mjlTHUMB_H];	// thumbnail, top row first
+} mjlCatalogEntry;
+
+// size and modification time of a file; false if it does not exist
+bool mjl_fileInfo(const char* path, long long* size, long long* mtime);
+
+// absolute path without "." and ".." components or doubled separators (Windows: '/'
+// separators); the path itself if it does not exist
+std::string mjl_fullPath(const char* path);
+
+// model file next to a log: same name, .xml
+std::string mjl_modelPath(const char* logpath);
+
+// describe a log from its header and index; false (with a message) if it cannot be read
+bool mjl_catalogLog(const char* path, mjlCatalogEntry& e);
+
+// all entries of a catalog; false if it cannot be read
+bool mjl_readCatalog(const char* filename, std::vector<mjlCatalogEntry>& entries);
+
+// entry i of a catalog (one seek); false if out of range or unreadable
+bool mjl_catalogEntry(const char* filename, int i, mjlCatalogEntry& e);
+
+// write a catalog (entries sorted by path); false on error
+bool mjl_writeCatalog(const char* filename, std::vector<mjlCatalogEntry>& entries);
@@ -0,0 +1,343 @@
+//---------------------------------//
+//  Re-simulation check of puppet  //
+//  logs (.mjl / .mjc, see mjlog.h)//
+//---------------------------------//
+
+#include "mjlcheck.h"
+
+#include <string.h>
+#include <vector>
+
+
+// offset of a field in the records of stream s (after the time), 0 if absent
+static int fieldOffset(mjlReader& log, int s, int field, int* size = 0)
+{
+	const mjlStream& st = log.getStream(s);
+	for( int i=0, adr=1; i<st.nfield; adr+=st.size[i], i++ )
+		if( st.field[i]==field )
+		{
+			if( size )
+				*size = st.size[i];
+			return adr;
+		}
+	return 0;
+}
+
+
+
+// copy n exact doubles stored by mjlPacker::addRaw, advance src
+static void raw2n(mjtNum* dst, const float*& src, int n)
+{
+	memcpy(dst, src, sizeof(mjtNum)*n);
+	src += 2*n;
+}
+
+
+
+// copy n floats
+static void f2n(mjtNum* dst, const float* src, int n)
+{
+	for( int i=0; i<n; i++ )
+		dst[i] = src[i];
+}
+
+
+
+// largest |logged - simulated| of n values; round: simulated values rounded to float
+static double maxError(const float* logged, const mjtNum* sim, int n, bool round = false)
+{
+	double err = 0;
+	for( int i=0; i<n; i++ )
+		err = mjMAX(err, mju_abs(logged[i] - (round ? (float)sim[i] : sim[i])));
+	return err;
+}
+
+
+
+// logged values are the simulated ones rounded to float
+static bool sameFloat(const float* logged, const mjtNum* sim, int n)
+{
+	for( int i=0; i<n; i++ )
+		if( logged[i]!=(float)sim[i] )
+			return false;
+	return true;
+}
+
+
+
+// count a compared state, write its errors
+static void addFrame(mjlCheck* res, FILE* frames, long long step, double time, bool differ,
+					 double qpos, double qvel, double runqpos, double runqvel)
+{
+	res->ncompared++;
+	if( differ )
+	{
+		res->ndiffer++;
+		if( res->first<0 )
+			res->first = step;
+	}
+	res->qpos = mjMAX(res->qpos, qpos);
+	res->qvel = mjMAX(res->qvel, qvel);
+	res->runqpos = mjMAX(res->runqpos, runqpos);
+	res->runqvel = mjMAX(res->runqvel, runqvel);
+	if( frames )
+		fprintf(frames, "%lld\t%.9g\t%g\t%g\t%g\t%g\n", step, time, qpos, qvel, runqpos, runqvel);
+}
+
+
+
+//------------------------- Session logs ------------------------------------------------
+
+// step freely from the recorded resets with the recorded inputs
+static bool checkExact(mjModel* m, mjData* d, mjlReader& log, int sinput, int adrin,
+					   int sreset, int adrreset, mjlCheck* res, FILE* frames)
+{
+	// densest stream with qpos to compare against
+	int field = mjlFIELD_QPOS;
+	int sstate = log.getMasterStream(&field, 1), adrqpos = 0, adrqvel = 0, dec = 0;
+	if( sstate>=0 )
+	{
+		adrqpos = fieldOffset(log, sstate, mjlFIELD_QPOS);
+		adrqvel = fieldOffset(log, sstate, mjlFIELD_QVEL);
+		dec = log.getStream(sstate).decimation;
+	}
+
+	long long nstep = log.getNRecord(sinput), nreset = log.getNRecord(sreset), r = 0, drop = 0;
+	for( long long i=0; i<nstep; i++ )
+	{
+		// resets recorded at this step: exact state and model parameters
+		const float* rec;
+		while( r<nreset && (rec = log.record(r, sreset)) )
+		{
+			const float* src = rec + adrreset;
+			mjtNum step;
+			raw2n(&step, src, 1);
+			if( (long long)step>i )
+				break;
+			raw2n(&d->time, src, 1);
+			raw2n(d->qpos, src, m->nq);
+			raw2n(d->qvel, src, m->nv);
+			raw2n(d->act, src, m->na);
+			raw2n(d->qacc_warmstart, src, m->nv);
+			raw2n(m->body_pos, src, 3*m->nbody);
+			raw2n(m->body_quat, src, 4*m->nbody);
+			raw2n(m->site_pos, src, 3*m->nsite);
+			r++;
+		}
+		if( !r )
+		{
+			snprintf(res->message, sizeof(res->message), "no reset record before step %lld", i);
+			return false;
+		}
+
+		// step inputs; records dropped by the writer (ring full) fail the check: the
+		// steps after them cannot be re-simulated
+		rec = log.record(i, sinput);
+		if( !rec || rec[0]!=(float)d->time )
+		{
+			snprintf(res->message, sizeof(res->message), "input record %lld %s, stopped at time %.4f",
+					 i, rec ? "missing" : "corrupt", d->time);
+			return false;
+		}
+		const float* src = rec + adrin;
+		raw2n(d->ctrl, src, m->nu);
+		raw2n(d->qfrc_applied, src, m->nv);
+		raw2n(d->xfrc_applied, src, 6*m->nbody);
+		raw2n(d->mocap_pos, src, 3*m->nmocap);
+		raw2n(d->mocap_quat, src, 4*m->nmocap);
+
+		// compare with the state logged before this step; after state records dropped
+		// by the writer (ring full, one stream at a time) it is found by time, a gap
+		const float* state = 0;
+		if( dec && i%dec==0 && i/dec-drop<log.getNRecord(sstate) )
+		{
+			long long j = i/dec - drop;
+			state = log.record(j, sstate);
+			if( state && state[0]!=(float)d->time )
+			{
+				res->ngap++;
+				j = log.find((float)d->time, sstate, j);
+				drop = i/dec - j;
+				state = log.record(j, sstate);
+				if( state && state[0]!=(float)d->time )
+					state = 0;
+			}
+		}
+		if( state )
+		{
+			bool same = (state[0]==(float)d->time && sameFloat(state+adrqpos, d->qpos, m->nq) &&
+						 (!adrqvel || sameFloat(state+adrqvel, d->qvel, m->nv)));
+			double qpos = maxError(state+adrqpos, d->qpos, m->nq, true);
+			double qvel = (adrqvel ? maxError(state+adrqvel, d->qvel, m->nv, true) : 0);
+			addFrame(res, frames, i, d->time, !same, qpos, qvel, qpos, qvel);
+		}
+
+		mj_step(m, d);
+		res->nstep = i+1;
+	}
+	return true;
+}
+
+
+
+//------------------------- Other logs --------------------------------------------------
+
+// set time and state of d from a record
+static void setState(const mjModel* m, mjData* d, const float* rec, int adrqpos, int adrqvel)
+{
+	d->time = rec[0];
+	f2n(d->qpos, rec+adrqpos, m->nq);
+	f2n(d->qvel, rec+adrqvel, m->nv);
+}
+
+
+
+// set the inputs of d from a record
+static void setInputs(const mjModel* m, mjData* d, const float* rec, int adrctrl, int adrmpos, int adrmquat)
+{
+	if( adrctrl )
+		f2n(d->ctrl, rec+adrctrl, m->nu);
+	if( adrmpos )
+		f2n(d->mocap_pos, rec+adrmpos, 3*m->nmocap);
+	if( adrmquat )
+		f2n(d->mocap_quat, rec+adrmquat, 4*m->nmocap);
+}
+
+
+
+// step once from every logged state, and freely from the first one
+static bool checkPlain(mjModel* m, mjData* d, mjlReader& log, double tol, mjlCheck* res, FILE* frames)
+{
+	// stream written every step with the state and the inputs
+	int s, adrqpos = 0, adrqvel = 0, adrctrl = 0, adrmpos = 0, adrmquat = 0;
+	for( s=0; s<log.getNStream(); s++ )
+	{
+		adrqpos = fieldOffset(log, s, mjlFIELD_QPOS);
+		adrqvel = fieldOffset(log, s, mjlFIELD_QVEL);
+		adrctrl = fieldOffset(log, s, mjlFIELD_CTRL);
+		adrmpos = fieldOffset(log, s, mjlFIELD_MOCAP_POS);
+		adrmquat = fieldOffset(log, s, mjlFIELD_MOCAP_QUAT);
+		if( log.getStream(s).decimation==1 && adrqpos && adrqvel && (adrctrl || !m->nu) &&
+			((adrmpos && adrmquat) || !m->nmocap) )
+			break;
+	}
+	if( s==log.getNStream() )
+	{
+		snprintf(res->message, sizeof(res->message),
+				 "no stream with qpos, qvel, ctrl and mocap written every step");
+		return false;
+	}
+
+	// records are copied: the next read may evict the chunk they point into
+	long long nrec = log.getNRecord(s);
+	int recsz = log.getRecsz(s);
+	std::vector<float> cur(recsz), next(recsz);
+	const float* rec = (nrec ? log.record(0, s) : 0);
+	if( !rec )
+	{
+		snprintf(res->message, sizeof(res->message), "no records");
+		return false;
+	}
+	memcpy(cur.data(), rec, sizeof(float)*recsz);
+	setState(m, d, cur.data(), adrqpos, adrqvel);
+
+	mjData* one = mj_makeData(m);
+	double dt = m->opt.timestep;
+	bool ok = true;
+	for( long long i=0; i+1<nrec; i++ )
+	{
+		// corrupt record: the rest of the log is not checked
+		if( !(rec = log.record(i+1, s)) )
+		{
+			snprintf(res->message, sizeof(res->message), "record %lld corrupt, stopped at time %.4f",
+					 i+1, cur[0]);
+			ok = false;
+			break;
+		}
+		memcpy(next.data(), rec, sizeof(float)*recsz);
+
+		// gap: restart the free run from the logged state
+		if( mju_abs(next[0] - cur[0] - dt)>0.5*dt )
+		{
+			res->ngap++;
+			setState(m, d, next.data(), adrqpos, adrqvel);
+			cur.swap(next);
+			continue;
+		}
+
+		// one step from the logged state (activations and warmstart from the free run)
+		setState(m, one, cur.data(), adrqpos, adrqvel);
+		mju_copy(one->act, d->act, m->na);
+		mju_copy(one->qacc_warmstart, d->qacc_warmstart, m->nv);
+		setInputs(m, one, cur.data(), adrctrl, adrmpos, adrmquat);
+		mj_step(m, one);
+
+		// free run
+		setInputs(m, d, cur.data(), adrctrl, adrmpos, adrmquat);
+		mj_step(m, d);
+
+		double qpos = maxError(next.data()+adrqpos, one->qpos, m->nq);
+		double qvel = maxError(next.data()+adrqvel, one->qvel, m->nv);
+		addFrame(res, frames, i+1, next[0], qpos>tol || qvel>tol, qpos, qvel,
+				 maxError(next.data()+adrqpos, d->qpos, m->nq),
+				 maxError(next.data()+adrqvel, d->qvel, m->nv));
+		res->nstep++;
+		cur.swap(next);
+	}
+
+	mj_deleteData(one);
+	return ok;
+}
+
+
+
+//------------------------- Check -------------------------------------------------------
+
+// re-simulate a log, compare with the logged states
+bool mjl_check(mjModel* m, mjlReader& log, mjlCheck* res, FILE* frames, double tol)
+{
+	memset(res, 0, sizeof(mjlCheck));
+	res->first = -1;
+
+	const int* sizes = log.getSizes();
+	if( m->nq!=sizes[0] || m->nv!=sizes[1] || m->nu!=sizes[2] || m->nmocap!=sizes[3] )
+	{
+		snprintf(res->message, sizeof(res->message), "model sizes do not match the log");
+		return false;
+	}
+
+	// session streams (their raw fields also depend on nbody, nsite and na)
+	int sinput = -1, sreset = -1, adrin = 0, adrreset = 0, size;
+	for( int s=0; s<log.getNStream(); s++ )
+	{
+		int adr;
+		if( (adr = fieldOffset(log, s, mjlFIELD_INPUT, &size)) )
+		{
+			if( size!=2*(m->nu+m->nv+6*m->nbody+7*m->nmocap) )
+				sinput = -2;
+			else if( sinput==-1 )
+				sinput = s, adrin = adr;
+		}
+		if( (adr = fieldOffset(log, s, mjlFIELD_RESET, &size)) )
+		{
+			if( size!=2*(2+m->nq+2*m->nv+m->na+7*m->nbody+3*m->nsite) )
+				sreset = -2;
+			else if( sreset==-1 )
+				sreset = s, adrreset = adr;
+		}
+	}
+	if( sinput==-2 || sreset==-2 )
+	{
+		snprintf(res->message, sizeof(res->message), "session fields do not match the model");
+		return false;
+	}
+
+	if( frames )
+		fprintf(frames, "# step\ttime\tqpos\tqvel\trunqpos\trunqvel\n");
+	mjData* d = mj_makeData(m);
+	res->exact = (sinput>=0 && sreset>=0);
+	bool ok = (res->exact ? checkExact(m, d, log, sinput, adrin, sreset, adrreset, res, frames) :
+							checkPlain(m, d, log, tol, res, frames));
+	mj_deleteData(d);
+	return ok;
+}
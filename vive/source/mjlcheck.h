@@ -0,0 +1,60 @@
+//---------------------------------//
+//  Re-simulation check of puppet  //
+//  logs (.mjl / .mjc, see mjlog.h)//
+//---------------------------------//
+
+#pragma once
+
+#include "mujoco.h"
+#include "mjlog.h"
+
+#include <stdio.h>
+
+
+//------------------------- Check -------------------------------------------------------
+//
+// A log is re-simulated with its model and the re-simulated qpos/qvel are compared
+// with the logged ones. Records hold the state before a physics step and the inputs
+// of that step.
+//
+// Session logs (logSession = true) hold the exact inputs of every step (raw input
+// field) and the exact states the recording started from (raw reset field). They are
+// stepped freely from these and must reproduce every logged state exactly (as floats);
+// logged states dropped by the writer are gaps.
+//
+// Other logs need a stream written every step with qpos, qvel, ctrl (and mocap_pos,
+// mocap_quat if the model has mocap bodies). Their states are floats, so two errors
+// are measured at each step: "step" steps once from the logged state and compares
+// with the next record (agreement of model and engine with the recording up to float
+// rounding; qpos and qvel must stay within a tolerance), "run" steps freely from the
+// first record with the logged inputs (accumulated divergence, which contacts
+// amplify; it is reported, not checked). Perturbations and actuator activations
+// are not in these logs; logs that used them diverge. Gaps (records dropped by the
+// writer) restart the free run from the logged state.
+//
+// A check that stops early fails: a session log with a missing or corrupt input
+// record, or a corrupt record in other logs. The counts cover the steps before it.
+
+#define mjlCHECK_TOL		1e-4		// default largest one-step |qpos|, |qvel| error of other logs
+
+typedef struct _mjlCheck
+{
+	bool exact;							// session log: exact inputs and resets
+	long long nstep;					// steps re-simulated
+	long long ncompared;				// logged states compared
+	long long ndiffer;					// states that differ (exact) or exceed the tolerance
+	long long first;					// step of the first of these, -1: none
+	long long ngap;						// gaps in the log (session logs: in the states)
+	double qpos;						// largest step error of qpos (session logs: run error)
+	double qvel;						// largest step error of qvel
+	double runqpos;						// largest run error of qpos
+	double runqvel;						// largest run error of qvel
+	char message[200];					// why the check failed or stopped early, "" if it did not
+} mjlCheck;
+
+// re-simulate a log with model m, which reset records may change (use a copy per
+// log); frames: one tab-separated line "step time qpos qvel runqpos runqvel" of
+// errors per compared state, may be 0; tol: one-step tolerance of non-session logs;
+// false if the log cannot be checked or the check stopped early (reason in
+// res->message)
+bool mjl_check(mjModel* m, mjlReader& log, mjlCheck* res, FILE* frames = 0, double tol = mjlCHECK_TOL);
@@ -0,0 +1,1813 @@
+//---------------------------------//
+//  Log writing/reading for puppet //
+//---------------------------------//
+
+#include "mjlog.h"
+#include "timing.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <chrono>
+#include <algorithm>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+	#include <io.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+	#include <immintrin.h>
+	#define mjlSSE2
+#endif
+
+
+// writer wakes up at least this often, and when this many records are pending
+static const int mjlWAKE_MS = 20;
+static const int mjlBATCH = 64;
+
+// stdio buffer of the output file
+static const int mjlFILEBUF = 1<<20;
+
+// 64-bit file positions, flush file data to disk
+#ifdef _WIN32
+	#define mjl_fseek _fseeki64
+	#define mjl_ftell _ftelli64
+	#define mjl_fsync(fp) FlushFileBuffers((HANDLE)_get_osfhandle(_fileno(fp)))
+#elif defined(__APPLE__)
+	#define mjl_fseek fseeko
+	#define mjl_ftell ftello
+	#define mjl_fsync(fp) fsync(fileno(fp))
+#else
+	#define mjl_fseek fseeko
+	#define mjl_ftell ftello
+	#define mjl_fsync(fp) fdatasync(fileno(fp))
+#endif
+
+
+
+//------------------------- Record packer -----------------------------------------------
+
+// convert n doubles to float
+void mjl_d2f(float* dst, const double* src, int n)
+{
+	int i = 0;
+
+#if defined(__AVX__)
+	// 4 doubles per instruction
+	for( ; i+8<=n; i+=8 )
+	{
+		_mm_storeu_ps(dst+i,   _mm256_cvtpd_ps(_mm256_loadu_pd(src+i)));
+		_mm_storeu_ps(dst+i+4, _mm256_cvtpd_ps(_mm256_loadu_pd(src+i+4)));
+	}
+#endif
+
+#if defined(mjlSSE2)
+	// 2 doubles per instruction, 4 floats per store
+	for( ; i+4<=n; i+=4 )
+	{
+		__m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(src+i));
+		__m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(src+i+2));
+		_mm_storeu_ps(dst+i, _mm_movelh_ps(lo, hi));
+	}
+#endif
+
+	// remainder (or everything without SIMD)
+	for( ; i<n; i++ )
+		dst[i] = (float)src[i];
+}
+
+
+
+// remove all fields
+void mjlPacker::clear(void)
+{
+	src.clear();
+	num.clear();
+	raw.clear();
+	recsz = 0;
+}
+
+
+
+// append field
+void mjlPacker::add(const double* _src, int n)
+{
+	if( n<=0 )
+		return;
+
+	src.push_back(_src);
+	num.push_back(n);
+	raw.push_back(0);
+	recsz += n;
+}
+
+
+
+// append raw field
+void mjlPacker::addRaw(const double* _src, int n)
+{
+	if( n<=0 )
+		return;
+
+	src.push_back(_src);
+	num.push_back(n);
+	raw.push_back(1);
+	recsz += 2*n;
+}
+
+
+
+// record size in floats
+int mjlPacker::size(void)
+{
+	return recsz;
+}
+
+
+
+// convert all fields into dst
+void mjlPacker::pack(float* dst)
+{
+	int nfield = (int)src.size();
+	for( int i=0; i<nfield; i++ )
+		if( raw[i] )
+		{
+			memcpy(dst, src[i], sizeof(double)*num[i]);
+			dst += 2*num[i];
+		}
+		else
+		{
+			mjl_d2f(dst, src[i], num[i]);
+			dst += num[i];
+		}
+}
+
+
+
+//------------------------- Chunk codec -------------------------------------------------
+
+// CRC-32C tables for slicing by 8, built during static initialization
+static unsigned int crcTable[8][256];
+
+static bool crcInit(void)
+{
+	for( unsigned int i=0; i<256; i++ )
+	{
+		unsigned int c = i;
+		for( int k=0; k<8; k++ )
+			c = (c>>1) ^ (0x82F63B78u & (0u - (c&1)));
+		crcTable[0][i] = c;
+	}
+	for( unsigned int i=0; i<256; i++ )
+		for( int t=1; t<8; t++ )
+			crcTable[t][i] = (crcTable[t-1][i]>>8) ^ crcTable[0][crcTable[t-1][i]&0xFF];
+	return true;
+}
+
+static const bool _crcInit = crcInit();
+
+
+
+// CRC-32C of n bytes, continuing from crc
+unsigned int mjl_crc32(unsigned int crc, const void* data, size_t n)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	crc = ~crc;
+
+	// 8 bytes per step (little-endian)
+	while( n>=8 )
+	{
+		unsigned int lo, hi;
+		memcpy(&lo, p, 4);
+		memcpy(&hi, p+4, 4);
+		lo ^= crc;
+		crc = crcTable[7][lo&0xFF] ^ crcTable[6][(lo>>8)&0xFF] ^
+			  crcTable[5][(lo>>16)&0xFF] ^ crcTable[4][lo>>24] ^
+			  crcTable[3][hi&0xFF] ^ crcTable[2][(hi>>8)&0xFF] ^
+			  crcTable[1][(hi>>16)&0xFF] ^ crcTable[0][hi>>24];
+		p += 8;
+		n -= 8;
+	}
+
+	// tail
+	while( n-- )
+		crc = (crc>>8) ^ crcTable[0][(crc^*p++)&0xFF];
+
+	return ~crc;
+}
+
+
+
+// worst-case encoded size of n floats (4n bytes, one control byte per 128 literals)
+int mjl_encodeBound(int n)
+{
+	return 4*n + (4*n)/128 + 16;
+}
+
+
+
+// 8 bytes at i (unaligned)
+static inline unsigned long long load8(const unsigned char* p)
+{
+	unsigned long long w;
+	memcpy(&w, p, 8);
+	return w;
+}
+
+
+
+// run-length encode zero bytes: control c<128: c+1 literals follow; c>=128: c-127 zeros
+// scans 8 bytes at a time where possible (long zero runs in the high byte planes)
+static int rleEncode(unsigned char* out, const unsigned char* in, int n)
+{
+	int o = 0, i = 0;
+	while( i<n )
+	{
+		// zero run
+		if( in[i]==0 )
+		{
+			int end = (n-i>128 ? i+128 : n);
+			int j = i+1;
+			while( j+8<=end && !load8(in+j) )
+				j += 8;
+			while( j<end && in[j]==0 )
+				j++;
+			out[o++] = (unsigned char)(127 + (j-i));
+			i = j;
+		}
+
+		// literals, up to the next pair of zeros
+		else
+		{
+			int end = (n-i>128 ? i+128 : n);
+			int j = i+1;
+			while( j<end )
+			{
+				// skip 8 bytes with no zero byte
+				if( j+8<=end )
+				{
+					unsigned long long w = load8(in+j);
+					if( !((w - 0x0101010101010101ULL) & ~w & 0x8080808080808080ULL) )
+					{
+						j += 8;
+						continue;
+					}
+				}
+				if( in[j]==0 && (j+1==n || in[j+1]==0) )
+					break;
+				j++;
+			}
+			out[o++] = (unsigned char)(j-i-1);
+			memcpy(out+o, in+i, j-i);
+			o += j-i;
+			i = j;
+		}
+	}
+
+	return o;
+}
+
+
+
+// decode run-length encoded bytes; false if the sizes do not match
+static bool rleDecode(unsigned char* out, int n, const unsigned char* in, int insz)
+{
+	int o = 0, i = 0;
+	while( i<insz )
+	{
+		int c = in[i++];
+		if( c>=128 )
+		{
+			int len = c-127;
+			if( o+len>n )
+				return false;
+			memset(out+o, 0, len);
+			o += len;
+		}
+		else
+		{
+			int len = c+1;
+			if( o+len>n || i+len>insz )
+				return false;
+			memcpy(out+o, in+i, len);
+			o += len;
+			i += len;
+		}
+	}
+
+	return (o==n);
+}
+
+
+
+// encode records: predict each column linearly from its last two values, zigzag
+// the integer residual, split into byte planes, RLE
+int mjl_encode(unsigned char* out, const float* rec, int nrec, int recsz, unsigned char* work)
+{
+	int n = nrec*recsz;
+	unsigned char* p0 = work;
+	unsigned char* p1 = work + n;
+	unsigned char* p2 = work + 2*n;
+	unsigned char* p3 = work + 3*n;
+
+	// column-major residuals
+	const unsigned int* u = (const unsigned int*)rec;
+	for( int c=0; c<recsz; c++ )
+	{
+		unsigned int prev1 = 0, prev2 = 0;
+		int k = c*nrec;
+		const unsigned int* src = u + c;
+		for( int r=0; r<nrec; r++, k++, src+=recsz )
+		{
+			unsigned int v = *src;
+			int e = (int)(v - (2*prev1 - prev2));
+			unsigned int x = ((unsigned int)e<<1) ^ (unsigned int)(e>>31);
+			prev2 = (r ? prev1 : v);
+			prev1 = v;
+			p0[k] = (unsigned char)x;
+			p1[k] = (unsigned char)(x>>8);
+			p2[k] = (unsigned char)(x>>16);
+			p3[k] = (unsigned char)(x>>24);
+		}
+	}
+
+	return rleEncode(out, work, 4*n);
+}
+
+
+
+// decode records
+bool mjl_decode(float* rec, const unsigned char* in, int insz, int nrec, int recsz, unsigned char* work)
+{
+	int n = nrec*recsz;
+	if( !rleDecode(work, 4*n, in, insz) )
+		return false;
+
+	const unsigned char* p0 = work;
+	const unsigned char* p1 = work + n;
+	const unsigned char* p2 = work + 2*n;
+	const unsigned char* p3 = work + 3*n;
+
+	unsigned int* u = (unsigned int*)rec;
+	for( int c=0; c<recsz; c++ )
+	{
+		unsigned int prev1 = 0, prev2 = 0;
+		int k = c*nrec;
+		unsigned int* dst = u + c;
+		for( int r=0; r<nrec; r++, k++, dst+=recsz )
+		{
+			unsigned int x = (unsigned int)p0[k] | ((unsigned int)p1[k]<<8) |
+							 ((unsigned int)p2[k]<<16) | ((unsigned int)p3[k]<<24);
+			unsigned int e = (x>>1) ^ (0u - (x&1));
+			unsigned int v = e + (2*prev1 - prev2);
+			prev2 = (r ? prev1 : v);
+			prev1 = v;
+			*dst = v;
+		}
+	}
+
+	return true;
+}
+
+
+
+// write index trailer at the current file position
+long long mjl_writeIndex(FILE* fp, const std::vector<mjlIndexEntry>& index, long long nrec, int version)
+{
+	mjlIndexFooter ft;
+	ft.offset = mjl_ftell(fp);
+	ft.nrec = nrec;
+	ft.nchunk = (int)index.size();
+	ft.magic = mjlMAGIC_INDEX;
+
+	// entries: whole structure, or the prefix that older versions had
+	long long n = 0;
+	size_t entsz = (version>=3 ? sizeof(mjlIndexEntry) : mjlINDEXENTRY_V2);
+	for( size_t c=0; c<index.size(); c++ )
+		n += fwrite(&index[c], 1, entsz, fp);
+	n += fwrite(&ft, 1, sizeof(ft), fp);
+	return n;
+}
+
+
+
+// CRC of a chunk: header fields except crc, then the encoded records
+static unsigned int chunkCRC(const mjlChunkHeader* ch, const unsigned char* data, int version)
+{
+	unsigned int crc = mjl_crc32(0, ch, offsetof(mjlChunkHeader, crc));
+	if( version>=3 )
+		crc = mjl_crc32(crc, &ch->stream, sizeof(int));
+	return mjl_crc32(crc, data, ch->size);
+}
+
+
+
+//------------------------- Streams -----------------------------------------------------
+
+const char* mjlFIELDNAME[mjlNFIELD] =
+{
+	"qpos",
+	"qvel",
+	"ctrl",
+	"mocap_pos",
+	"mocap_quat",
+	"sensordata",
+	"userdata",
+	"clock",
+	"controller",
+	"hmd",
+	"scene",
+	"glove",
+	"input",
+	"reset"
+};
+
+
+// size of a field in floats
+int mjl_fieldSize(const int* sizes, int field)
+{
+	switch( field )
+	{
+	case mjlFIELD_QPOS:			return sizes[0];
+	case mjlFIELD_QVEL:			return sizes[1];
+	case mjlFIELD_CTRL:			return sizes[2];
+	case mjlFIELD_MOCAP_POS:	return 3*sizes[3];
+	case mjlFIELD_MOCAP_QUAT:	return 4*sizes[3];
+	case mjlFIELD_SENSORDATA:	return sizes[4];
+	case mjlFIELD_USERDATA:		return sizes[5];
+	default:					return 0;
+	}
+}
+
+
+
+// mjData field sizes from the header
+void mjl_setSizes(const int* sizes, mjlStream& stream)
+{
+	for( int i=0; i<stream.nfield; i++ )
+		if( stream.field[i]<mjlNDATAFIELD )
+			stream.size[i] = mjl_fieldSize(sizes, stream.field[i]);
+}
+
+
+
+// record size of a stream
+int mjl_recsz(const int* sizes, const mjlStream& stream)
+{
+	int n = 1;
+	for( int i=0; i<stream.nfield; i++ )
+		n += (stream.field[i]<mjlNDATAFIELD ? mjl_fieldSize(sizes, stream.field[i]) : stream.size[i]);
+	return n;
+}
+
+
+
+// all mjData fields at decimation 1
+mjlStream mjl_defaultStream(void)
+{
+	mjlStream st;
+	st.decimation = 1;
+	st.nfield = mjlNDATAFIELD;
+	for( int i=0; i<mjlNDATAFIELD; i++ )
+	{
+		st.field[i] = i;
+		st.size[i] = 0;
+	}
+	return st;
+}
+
+
+
+// add field by name to a stream; false if unknown or repeated
+static bool addField(mjlStream& st, const char* name, int len)
+{
+	// "mocap": position and orientation
+	if( len==5 && !strncmp(name, "mocap", 5) )
+		return addField(st, "mocap_pos", 9) && addField(st, "mocap_quat", 10);
+
+	for( int f=0; f<mjlNFIELD; f++ )
+		if( (int)strlen(mjlFIELDNAME[f])==len && !strncmp(name, mjlFIELDNAME[f], len) )
+		{
+			for( int i=0; i<st.nfield; i++ )
+				if( st.field[i]==f )
+					return false;
+			st.field[st.nfield] = f;
+			st.size[st.nfield++] = 0;
+			return true;
+		}
+
+	return false;
+}
+
+
+
+// parse schema
+bool mjl_parseStreams(const char* spec, std::vector<mjlStream>& streams)
+{
+	streams.clear();
+	const char* p = spec;
+	while( *p )
+	{
+		// skip separators, stop at the end
+		while( *p==' ' || *p=='\t' || *p==';' )
+			p++;
+		if( !*p )
+			break;
+
+		mjlStream st;
+		st.decimation = 1;
+		st.nfield = 0;
+
+		// fields up to '/', space or end
+		while( *p && *p!=' ' && *p!='\t' && *p!=';' && *p!='/' )
+		{
+			const char* q = p;
+			while( *q && *q!=',' && *q!=' ' && *q!='\t' && *q!=';' && *q!='/' )
+				q++;
+			if( q>p && !addField(st, p, (int)(q-p)) )
+			{
+				printf("Log schema: unknown or repeated field '%.*s'\n", (int)(q-p), p);
+				return false;
+			}
+			p = (*q==',' ? q+1 : q);
+		}
+
+		// decimation
+		if( *p=='/' )
+		{
+			char* end;
+			long dec = strtol(p+1, &end, 10);
+			if( end==p+1 || dec<1 )
+			{
+				printf("Log schema: bad decimation in '%s'\n", spec);
+				return false;
+			}
+			st.decimation = (int)dec;
+			p = end;
+		}
+
+		if( !st.nfield )
+		{
+			printf("Log schema: stream without fields in '%s'\n", spec);
+			return false;
+		}
+		if( streams.size()>=mjlMAXSTREAM )
+		{
+			printf("Log schema: more than %d streams\n", mjlMAXSTREAM);
+			return false;
+		}
+		streams.push_back(st);
+	}
+
+	return !streams.empty();
+}
+
+
+
+//------------------------- Asynchronous writer -----------------------------------------
+
+// constructor
+mjlWriter::mjlWriter()
+{
+	fp = 0;
+	ring = 0;
+	slotStream = 0;
+	recsz = nslot = 0;
+	head = tail = 0;
+	noverflow = nbytes = 0;
+	tmAcquire = worstEnqueue = tmOpen = 0;
+	running = false;
+	chunk = 0;
+	encbuf = workbuf = 0;
+	nraw = tmEncode = 0;
+	syncms = 0;
+	tmSync = nsync = 0;
+}
+
+
+
+// destructor
+mjlWriter::~mjlWriter()
+{
+	close();
+}
+
+
+
+// single stream: .mjl, or .mjc with all fields
+bool mjlWriter::open(const char* filename, const void* header, int headersz,
+					 int _recsz, int _nslot, int _chunk, int _syncms)
+{
+	close();
+
+	// .mjc: one stream with all fields, sizes from the .mjl header
+	if( _chunk>0 )
+	{
+		std::vector<mjlStream> streams(1, mjl_defaultStream());
+		if( headersz<7*(int)sizeof(int) || mjl_recsz((const int*)header, streams[0])!=_recsz )
+		{
+			printf("Log header does not match the record size\n");
+			return false;
+		}
+		return open(filename, header, headersz, streams, _nslot, _chunk, _syncms);
+	}
+
+	// .mjl
+	chunk = 0;
+	srecsz.assign(1, _recsz);
+	return start(filename, header, headersz, _nslot, _syncms);
+}
+
+
+
+// several streams, .mjc
+bool mjlWriter::open(const char* filename, const void* header, int headersz,
+					 const std::vector<mjlStream>& streams, int _nslot, int _chunk, int _syncms)
+{
+	close();
+
+	if( headersz<7*(int)sizeof(int) || streams.empty() || streams.size()>mjlMAXSTREAM )
+	{
+		printf("Log needs the .mjl header and 1 to %d streams\n", mjlMAXSTREAM);
+		return false;
+	}
+
+	// stream record sizes
+	chunk = (_chunk>0 ? _chunk : 256);
+	srecsz.resize(streams.size());
+	for( size_t s=0; s<streams.size(); s++ )
+		srecsz[s] = mjl_recsz((const int*)header, streams[s]);
+
+	// .mjl header followed by the stream table
+	std::vector<int> table(1, (int)streams.size());
+	for( size_t s=0; s<streams.size(); s++ )
+	{
+		mjlStream st = streams[s];
+		mjl_setSizes((const int*)header, st);
+		table.push_back(st.decimation);
+		table.push_back(st.nfield);
+		for( int i=0; i<st.nfield; i++ )
+		{
+			table.push_back(st.field[i]);
+			table.push_back(st.size[i]);
+		}
+	}
+	std::vector<char> full(headersz + sizeof(int)*table.size());
+	memcpy(full.data(), header, headersz);
+	memcpy(full.data()+headersz, table.data(), sizeof(int)*table.size());
+
+	return start(filename, full.data(), (int)full.size(), _nslot, _syncms);
+}
+
+
+
+// create file, allocate buffers, write header, start writer thread
+bool mjlWriter::start(const char* filename, const void* header, int headersz, int _nslot, int _syncms)
+{
+	// create file with a large stdio buffer
+	fp = fopen(filename, "wb");
+	if( !fp )
+	{
+		printf("Could not open %s\n", filename);
+		return false;
+	}
+	setvbuf(fp, 0, _IOFBF, mjlFILEBUF);
+
+	// allocate ring and chunk buffers
+	int nstream = (int)srecsz.size();
+	recsz = *std::max_element(srecsz.begin(), srecsz.end());
+	nslot = (_nslot>0 ? _nslot : 4096);
+	ring = (float*)malloc(sizeof(float)*recsz*(size_t)nslot);
+	slotStream = (int*)calloc(nslot, sizeof(int));
+	bool ok = (ring && slotStream);
+	if( chunk )
+	{
+		chunkbuf.assign(nstream, (float*)0);
+		for( int s=0; s<nstream; s++ )
+		{
+			chunkbuf[s] = (float*)malloc(sizeof(float)*srecsz[s]*(size_t)chunk);
+			ok = ok && chunkbuf[s];
+		}
+		encbuf = (unsigned char*)malloc(mjl_encodeBound(recsz*chunk));
+		workbuf = (unsigned char*)malloc(sizeof(float)*recsz*(size_t)chunk);
+		ok = ok && encbuf && workbuf;
+	}
+	if( !ok )
+	{
+		printf("Could not allocate log buffer (%d records)\n", nslot);
+		fclose(fp);
+		fp = 0;
+		close();
+		return false;
+	}
+
+	// header is written synchronously, before any record
+	nbytes = 0;
+	if( chunk )
+	{
+		mjlFileHeader fh = {mjlMAGIC_FILE, mjlVERSION, recsz, chunk, headersz, 0};
+		fh.crc = mjl_crc32(mjl_crc32(0, &fh, offsetof(mjlFileHeader, crc)), header, headersz);
+		nbytes += fwrite(&fh, 1, sizeof(fh), fp);
+	}
+	if( headersz>0 )
+		nbytes += fwrite(header, 1, headersz, fp);
+	fflush(fp);
+
+	// clear statistics, start writer
+	head = tail = 0;
+	noverflow = 0;
+	worstEnqueue = 0;
+	nchunkrec.assign(nstream, 0);
+	nchunked.assign(nstream, 0);
+	nraw = tmEncode = 0;
+	index.clear();
+	syncms = (_syncms>0 ? _syncms : 0);
+	nsync = 0;
+	tmOpen = tmSync = mjTimeNS();
+	running = true;
+	writer_th = std::thread(&mjlWriter::run, this);
+	return true;
+}
+
+
+
+// drain ring, stop writer thread, close file, print statistics
+void mjlWriter::close(void)
+{
+	// stop writer (it drains the ring and the pending chunks before exiting)
+	bool wasOpen = (fp!=0);
+	if( wasOpen )
+	{
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			running = false;
+		}
+		cv.notify_one();
+		writer_th.join();
+
+		fclose(fp);
+		fp = 0;
+	}
+
+	free(ring);
+	free(slotStream);
+	for( size_t s=0; s<chunkbuf.size(); s++ )
+		free(chunkbuf[s]);
+	free(encbuf);
+	free(workbuf);
+	ring = 0;
+	slotStream = 0;
+	chunkbuf.clear();
+	encbuf = workbuf = 0;
+	if( !wasOpen )
+		return;
+
+	// statistics
+	double sec = 1e-9*(double)(mjTimeNS() - tmOpen);
+	printf("Log: %lld records, %lld dropped (ring full), %.2f MB, %.2f MB/s, worst enqueue %.1f us\n",
+		(long long)head, noverflow, 1e-6*(double)nbytes,
+		sec>0 ? 1e-6*(double)nbytes/sec : 0.0, 1e-3*(double)worstEnqueue);
+	if( syncms )
+		printf("Log: %lld syncs to disk (every %d ms)\n", nsync, syncms);
+	if( chunk && nbytes>0 && tmEncode>0 )
+		printf("Log: %d streams, compression %.2fx, encode %.2f GB/s\n", (int)srecsz.size(),
+			(double)nraw/(double)nbytes, (double)nraw/(double)tmEncode);
+}
+
+
+
+// next free slot, 0 if the ring is full
+float* mjlWriter::acquire(bool wait, int stream)
+{
+	tmAcquire = mjTimeNS();
+
+	long long h = head.load(std::memory_order_relaxed);
+	while( wait && h - tail.load(std::memory_order_acquire) >= nslot )
+	{
+		cv.notify_one();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	if( h - tail.load(std::memory_order_acquire) >= nslot )
+	{
+		noverflow++;
+		return 0;
+	}
+
+	// published together with the record by commit()
+	slotStream[h % nslot] = stream;
+	return ring + (size_t)(h % nslot)*recsz;
+}
+
+
+
+// publish the slot returned by the last acquire()
+void mjlWriter::commit(void)
+{
+	long long h = head.load(std::memory_order_relaxed) + 1;
+	head.store(h, std::memory_order_release);
+
+	// wake the writer once a batch is pending (no lock: a missed wakeup costs one period)
+	if( h - tail.load(std::memory_order_relaxed) == mjlBATCH )
+		cv.notify_one();
+
+	long long dt = mjTimeNS() - tmAcquire;
+	if( dt>worstEnqueue )
+		worstEnqueue = dt;
+}
+
+
+
+// encode and write pending chunk of stream s
+void mjlWriter::flushChunk(int s)
+{
+	int n = nchunkrec[s];
+	if( !n )
+		return;
+
+	mjTIMER("log encode");
+	long long t0 = mjTimeNS();
+	const float* buf = chunkbuf[s];
+	mjlChunkHeader ch;
+	ch.magic = mjlMAGIC_CHUNK;
+	ch.nrec = n;
+	ch.size = mjl_encode(encbuf, buf, n, srecsz[s], workbuf);
+	ch.t0 = buf[0];
+	ch.t1 = buf[(size_t)(n-1)*srecsz[s]];
+	ch.stream = s;
+	ch.crc = chunkCRC(&ch, encbuf, mjlVERSION);
+	tmEncode += mjTimeNS() - t0;
+
+	mjlIndexEntry e = {nbytes, nchunked[s], ch.t0, ch.t1, s, n};
+	index.push_back(e);
+	nchunked[s] += n;
+
+	nbytes += fwrite(&ch, 1, sizeof(ch), fp);
+	nbytes += fwrite(encbuf, 1, ch.size, fp);
+	nchunkrec[s] = 0;
+}
+
+
+
+// flush pending records and file buffers to disk
+void mjlWriter::sync(void)
+{
+	mjTIMER("log sync");
+	for( int s=0; s<(int)nchunkrec.size(); s++ )
+		flushChunk(s);
+	fflush(fp);
+	mjl_fsync(fp);
+	tmSync = mjTimeNS();
+	nsync++;
+}
+
+
+
+// write ring records [first, first+n), contiguous in the ring
+void mjlWriter::write(long long first, long long n)
+{
+	const float* rec = ring + (size_t)first*recsz;
+
+	// .mjl: straight to the file
+	if( !chunk )
+	{
+		nraw += sizeof(float)*recsz*n;
+		nbytes += sizeof(float) * fwrite(rec, sizeof(float)*recsz, (size_t)n, fp) * recsz;
+		return;
+	}
+
+	// .mjc: append each record to the chunk of its stream, encode when full
+	for( long long i=0; i<n; i++, rec+=recsz )
+	{
+		int s = slotStream[first+i];
+		memcpy(chunkbuf[s] + (size_t)nchunkrec[s]*srecsz[s], rec, sizeof(float)*srecsz[s]);
+		nraw += sizeof(float)*srecsz[s];
+		if( ++nchunkrec[s]==chunk )
+			flushChunk(s);
+	}
+}
+
+
+
+// writer thread: write all committed records in at most two calls per batch
+void mjlWriter::run(void)
+{
+	mjTimerThreadName("log writer");
+
+	while( true )
+	{
+		// wait for a batch, the wake period or stop
+		bool stop;
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			cv.wait_for(lock, std::chrono::milliseconds(mjlWAKE_MS), [this]{
+				return !running || head.load(std::memory_order_relaxed) - tail.load(std::memory_order_relaxed) >= mjlBATCH;});
+			stop = !running;
+		}
+
+		// write committed records
+		long long h = head.load(std::memory_order_acquire);
+		long long t = tail.load(std::memory_order_relaxed);
+		while( t<h )
+		{
+			mjTIMER("log write");
+			long long n = h - t;
+			long long start = t % nslot;
+			if( start + n > nslot )
+				n = nslot - start;
+
+			write(start, n);
+			t += n;
+			tail.store(t, std::memory_order_release);
+		}
+
+		// periodic sync
+		if( syncms && mjTimeNS() - tmSync >= 1000000LL*syncms )
+			sync();
+
+		if( stop )
+			break;
+	}
+
+	// pending chunks, index
+	if( chunk )
+	{
+		long long total = 0;
+		for( int s=0; s<(int)nchunkrec.size(); s++ )
+		{
+			flushChunk(s);
+			total += nchunked[s];
+		}
+		nbytes += mjl_writeIndex(fp, index, total);
+	}
+	fflush(fp);
+	if( syncms )
+		mjl_fsync(fp);
+}
+
+
+
+//------------------------- Reader ------------------------------------------------------
+
+// constructor
+mjlReader::mjlReader()
+{
+	map = 0;
+#ifdef _WIN32
+	hfile = hmap = 0;
+#else
+	fd = -1;
+#endif
+	chunked = false;
+	filesz = 0;
+	memset(sizes, 0, sizeof(sizes));
+	start = 0;
+	recbuf = 0;
+	winStream = 0;
+	winFirst = winLast = 0;
+	chunk = 0;
+	version = 0;
+	chunkhdr = sizeof(mjlChunkHeader);
+	damaged = -1;
+	workbuf = 0;
+	tmDecode = 0;
+	indexed = false;
+	dataEnd = 0;
+}
+
+
+
+// destructor
+mjlReader::~mjlReader()
+{
+	close();
+}
+
+
+
+// map the whole file read-only
+bool mjlReader::mapFile(const char* filename)
+{
+#ifdef _WIN32
+	hfile = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, 0,
+						OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if( hfile==INVALID_HANDLE_VALUE )
+	{
+		hfile = 0;
+		return false;
+	}
+
+#else
+	fd = ::open(filename, O_RDONLY);
+	if( fd<0 )
+		return false;
+#endif
+
+	return mapView(fileSize());
+}
+
+
+
+// current size of the open file, -1 on error
+long long mjlReader::fileSize(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER sz;
+	return (GetFileSizeEx(hfile, &sz) ? (long long)sz.QuadPart : -1);
+#else
+	struct stat st;
+	return (fstat(fd, &st) ? -1 : (long long)st.st_size);
+#endif
+}
+
+
+
+// map the first sz bytes of the open file, replacing the current view
+bool mjlReader::mapView(long long sz)
+{
+#ifdef _WIN32
+	if( map )
+		UnmapViewOfFile(map);
+	if( hmap )
+		CloseHandle(hmap);
+	map = 0;
+	hmap = 0;
+	filesz = 0;
+	if( sz<=0 )
+		return false;
+
+	hmap = CreateFileMappingA(hfile, 0, PAGE_READONLY, (DWORD)(sz>>32), (DWORD)sz, 0);
+	if( !hmap )
+		return false;
+	map = (const unsigned char*)MapViewOfFile(hmap, FILE_MAP_READ, 0, 0, (SIZE_T)sz);
+#else
+	if( map )
+		munmap((void*)map, (size_t)filesz);
+	map = 0;
+	filesz = 0;
+	if( sz<=0 )
+		return false;
+
+	void* p = mmap(0, (size_t)sz, PROT_READ, MAP_SHARED, fd, 0);
+	if( p==MAP_FAILED )
+		return false;
+	map = (const unsigned char*)p;
+
+	// playback reads mostly forward; prefetch() adds read-ahead around the cursor
+	madvise(p, (size_t)sz, MADV_SEQUENTIAL);
+#endif
+
+	filesz = (map ? sz : 0);
+	return (map!=0);
+}
+
+
+
+
+
+// release everything
+void mjlReader::close(void)
+{
+#ifdef _WIN32
+	if( map )
+		UnmapViewOfFile(map);
+	if( hmap )
+		CloseHandle(hmap);
+	if( hfile )
+		CloseHandle(hfile);
+	hfile = hmap = 0;
+#else
+	if( map )
+		munmap((void*)map, (size_t)filesz);
+	if( fd>=0 )
+		::close(fd);
+	fd = -1;
+#endif
+	map = 0;
+	filesz = 0;
+
+	for( size_t s=0; s<streams.size(); s++ )
+		free(streams[s].cache);
+	streams.clear();
+	free(recbuf);
+	free(workbuf);
+	recbuf = 0;
+	workbuf = 0;
+	index.clear();
+	indexed = false;
+	dataEnd = 0;
+	names.clear();
+	damaged = -1;
+	version = 0;
+	winStream = 0;
+	winFirst = winLast = 0;
+}
+
+
+
+// copy n bytes at file offset pos, false if past the end of the file
+bool mjlReader::get(void* dst, long long pos, long long n)
+{
+	if( pos<0 || n<0 || pos+n>filesz )
+		return false;
+
+	memcpy(dst, map+pos, (size_t)n);
+	return true;
+}
+
+
+
+// open log, read header and chunk index
+bool mjlReader::open(const char* filename)
+{
+	close();
+
+	if( !mapFile(filename) )
+	{
+		printf("Could not open logfile %s\n", filename);
+		close();
+		return false;
+	}
+
+	// chunked file header (version 1 has no crc)
+	long long pos = 0;
+	mjlFileHeader fh;
+	memset(&fh, 0, sizeof(fh));
+	if( !get(&fh.magic, 0, sizeof(int)) )
+	{
+		printf("Could not read logfile header\n");
+		close();
+		return false;
+	}
+	chunked = (fh.magic==mjlMAGIC_FILE);
+	version = 0;
+	if( chunked )
+	{
+		if( !get(&fh, 0, 2*sizeof(int)) || fh.version<1 || fh.version>mjlVERSION )
+		{
+			printf("Unsupported .mjc version\n");
+			close();
+			return false;
+		}
+		version = fh.version;
+		pos = (version==1 ? mjlFILEHEADER_V1 : sizeof(fh));
+		chunkhdr = (version==1 ? mjlCHUNKHEADER_V1 : version==2 ? mjlCHUNKHEADER_V2 : sizeof(mjlChunkHeader));
+		if( !get(&fh, 0, pos) || fh.recsz<=0 || fh.chunk<=0 || fh.headersz<0 || pos+fh.headersz>filesz )
+		{
+			printf("Unsupported .mjc header\n");
+			close();
+			return false;
+		}
+		if( version>=2 && fh.crc!=mjl_crc32(mjl_crc32(0, &fh, offsetof(mjlFileHeader, crc)),
+											 map+pos, fh.headersz) )
+		{
+			printf("Damaged .mjc header (checksum mismatch)\n");
+			close();
+			return false;
+		}
+		chunk = fh.chunk;
+	}
+
+	// .mjl header: sizes and names
+	if( !get(sizes, pos, 7*sizeof(int)) || sizes[6]<0 )
+	{
+		printf("Could not read logfile header\n");
+		close();
+		return false;
+	}
+	pos += 7*sizeof(int);
+	names.resize(sizes[6]+1);
+	if( !get(names.data(), pos, sizes[6]) )
+	{
+		printf("Could not read model names from logfile header\n");
+		close();
+		return false;
+	}
+	pos += sizes[6];
+	names[sizes[6]] = 0;
+
+	// streams: table (v3) or one stream with all fields
+	start = (chunked ? (long long)(version==1 ? mjlFILEHEADER_V1 : sizeof(fh)) + fh.headersz : pos);
+	if( version>=3 )
+	{
+		if( !readStreams(pos, start) )
+		{
+			printf("Bad stream table in .mjc header\n");
+			close();
+			return false;
+		}
+	}
+	else
+	{
+		Stream st;
+		st.desc = mjl_defaultStream();
+		mjl_setSizes(sizes, st.desc);
+		st.recsz = mjl_recsz(sizes, st.desc);
+		st.nrec = 0;
+		st.cache = 0;
+		st.cached = -1;
+		st.scanned = 0;
+		st.tlast = 0;
+		streams.push_back(st);
+		if( chunked && start!=pos )
+		{
+			printf("Unsupported .mjc header\n");
+			close();
+			return false;
+		}
+	}
+
+	// largest record must match the file header
+	int maxrecsz = 0;
+	for( size_t s=0; s<streams.size(); s++ )
+		maxrecsz = std::max(maxrecsz, streams[s].recsz);
+	if( chunked && maxrecsz!=fh.recsz )
+	{
+		printf("Record size in .mjc header does not match the model sizes\n");
+		close();
+		return false;
+	}
+
+	// .mjl: records are read in place, a partial last record (crash) is ignored
+	if( !chunked )
+	{
+		int recsz = streams[0].recsz;
+		long long datasz = filesz - start;
+		long long nrec = datasz/recsz/sizeof(float);
+		streams[0].nrec = nrec;
+		dataEnd = start + nrec*recsz*(long long)sizeof(float);
+		if( dataEnd!=filesz )
+			printf("Warning: ignoring %lld bytes of a partial record at the end of the log\n",
+				filesz-dataEnd);
+
+		// copy of a record, used when the header leaves records unaligned
+		recbuf = (float*)malloc(sizeof(float)*recsz);
+		if( !recbuf )
+		{
+			printf("Could not allocate record buffer\n");
+			close();
+			return false;
+		}
+
+		return true;
+	}
+
+	// chunk buffers
+	bool ok = true;
+	for( size_t s=0; s<streams.size(); s++ )
+	{
+		streams[s].cache = (float*)malloc(sizeof(float)*streams[s].recsz*(size_t)chunk);
+		ok = ok && streams[s].cache;
+	}
+	workbuf = (unsigned char*)malloc(sizeof(float)*maxrecsz*(size_t)chunk);
+	if( !ok || !workbuf )
+	{
+		printf("Could not allocate chunk buffers\n");
+		close();
+		return false;
+	}
+
+	// .mjc: index trailer, or walk the chunk headers
+	if( !readIndex(start) )
+		scanChunks(start, false);
+	splitIndex();
+
+	return true;
+}
+
+
+
+// parse the stream table in [pos, end)
+bool mjlReader::readStreams(long long pos, long long end)
+{
+	int nstream;
+	if( !get(&nstream, pos, sizeof(int)) || nstream<1 || nstream>mjlMAXSTREAM )
+		return false;
+	pos += sizeof(int);
+
+	for( int s=0; s<nstream; s++ )
+	{
+		Stream st;
+		st.nrec = 0;
+		st.cache = 0;
+		st.cached = -1;
+		st.scanned = 0;
+		st.tlast = 0;
+		if( !get(&st.desc.decimation, pos, sizeof(int)) || !get(&st.desc.nfield, pos+sizeof(int), sizeof(int)) ||
+			st.desc.decimation<(version>=4 ? 0 : 1) || st.desc.nfield<1 || st.desc.nfield>mjlNFIELD )
+			return false;
+		pos += 2*sizeof(int);
+
+		// fields (v3), or field and size pairs (v4)
+		for( int i=0; i<st.desc.nfield; i++ )
+		{
+			st.desc.size[i] = 0;
+			if( !get(st.desc.field+i, pos, sizeof(int)) ||
+				(version>=4 && !get(st.desc.size+i, pos+sizeof(int), sizeof(int))) )
+				return false;
+			pos += (version>=4 ? 2 : 1)*sizeof(int);
+
+			int f = st.desc.field[i];
+			if( f<0 || f>=(version>=4 ? mjlNFIELD : mjlNDATAFIELD) || st.desc.size[i]<0 ||
+				(version>=4 && f<mjlNDATAFIELD && st.desc.size[i]!=mjl_fieldSize(sizes, f)) )
+				return false;
+		}
+
+		mjl_setSizes(sizes, st.desc);
+		st.recsz = mjl_recsz(sizes, st.desc);
+		streams.push_back(st);
+	}
+
+	return (pos==end);
+}
+
+
+
+// read and validate the index trailer
+bool mjlReader::readIndex(long long start)
+{
+	mjlIndexFooter ft;
+	long long entsz = (version>=3 ? sizeof(mjlIndexEntry) : mjlINDEXENTRY_V2);
+	if( filesz - start < (long long)sizeof(ft) )
+		return false;
+
+	if( !get(&ft, filesz - (long long)sizeof(ft), sizeof(ft)) || ft.magic!=mjlMAGIC_INDEX ||
+		ft.nchunk<0 || ft.nrec<0 || ft.offset<start ||
+		ft.offset + entsz*ft.nchunk + (long long)sizeof(ft) != filesz )
+		return false;
+
+	// entries (stream and size are missing before version 3)
+	std::vector<mjlIndexEntry> idx(ft.nchunk);
+	for( int c=0; c<ft.nchunk; c++ )
+	{
+		idx[c].stream = 0;
+		idx[c].nrec = 0;
+		if( !get(&idx[c], ft.offset + c*entsz, entsz) )
+			return false;
+	}
+	if( version<3 )
+		for( int c=0; c<ft.nchunk; c++ )
+			idx[c].nrec = (int)((c<ft.nchunk-1 ? idx[c+1].first : ft.nrec) - idx[c].first);
+
+	// entries must be in file order, number records per stream, and cover all records
+	std::vector<long long> count(streams.size(), 0);
+	long long total = 0;
+	for( int c=0; c<ft.nchunk; c++ )
+	{
+		long long end = (c<ft.nchunk-1 ? idx[c+1].offset : ft.offset);
+		int s = idx[c].stream;
+		if( s<0 || s>=(int)streams.size() || idx[c].first!=count[s] || idx[c].nrec<=0 ||
+			idx[c].nrec>chunk || idx[c].offset<start || end - idx[c].offset < chunkhdr )
+			return false;
+		count[s] += idx[c].nrec;
+		total += idx[c].nrec;
+	}
+	if( total!=ft.nrec )
+		return false;
+
+	index.swap(idx);
+	dataEnd = ft.offset;
+	indexed = true;
+	return true;
+}
+
+
+
+// read chunk header at pos and check that it is plausible and inside the file
+bool mjlReader::readChunkHeader(long long pos, mjlChunkHeader* ch)
+{
+	ch->crc = 0;
+	ch->stream = 0;
+	return get(ch, pos, chunkhdr) && ch->magic==mjlMAGIC_CHUNK && ch->nrec>0 && ch->nrec<=chunk &&
+		   ch->stream>=0 && ch->stream<(int)streams.size() && ch->size>=0 &&
+		   ch->size<=mjl_encodeBound(streams[ch->stream].recsz*chunk) && pos + chunkhdr + ch->size <= filesz;
+}
+
+
+
+// build index by walking the chunk headers (no trailer: old or unfinished file),
+// appending to the chunks already indexed; quiet: the tail may still be written
+void mjlReader::scanChunks(long long start, bool quiet)
+{
+	long long pos = start;
+	size_t nold = index.size();
+	std::vector<long long> count(streams.size(), 0);
+	for( size_t s=0; s<streams.size(); s++ )
+		count[s] = streams[s].nrec;
+	mjlChunkHeader ch;
+	while( readChunkHeader(pos, &ch) )
+	{
+		mjlIndexEntry e = {pos, count[ch.stream], ch.t0, ch.t1, ch.stream, ch.nrec};
+		index.push_back(e);
+		count[ch.stream] += ch.nrec;
+		pos += chunkhdr + ch.size;
+	}
+	dataEnd = pos;
+
+	// a crash can leave torn chunks at the end: keep up to the last one with a valid CRC
+	int ndrop = 0;
+	while( index.size()>nold && !checkChunk((long long)index.size()-1) )
+	{
+		dataEnd = index.back().offset;
+		index.pop_back();
+		ndrop++;
+	}
+	if( quiet )
+		return;
+	if( ndrop )
+		printf("Warning: dropped %d damaged chunks at the end of the log\n", ndrop);
+
+	if( dataEnd!=filesz )
+		printf("Warning: ignoring %lld bytes after the last complete chunk\n", filesz-dataEnd);
+}
+
+
+
+// pick up records appended since open (or the last refresh)
+long long mjlReader::refresh(void)
+{
+	if( !map || indexed )
+		return 0;
+
+	long long sz = fileSize();
+	if( sz<=filesz )
+		return 0;
+
+	// map the longer file; the prefetch window refers to the old view
+	if( !mapView(sz) )
+	{
+		printf("Could not remap logfile\n");
+		close();
+		return 0;
+	}
+	winFirst = winLast = 0;
+
+	// .mjl: complete records only
+	long long nold = 0, nnew = 0;
+	for( size_t s=0; s<streams.size(); s++ )
+		nold += streams[s].nrec;
+	if( !chunked )
+	{
+		int recsz = streams[0].recsz;
+		streams[0].nrec = (filesz - start)/recsz/sizeof(float);
+		dataEnd = start + streams[0].nrec*recsz*(long long)sizeof(float);
+	}
+
+	// .mjc: complete chunks after the last one
+	else
+	{
+		scanChunks(dataEnd, true);
+		splitIndex();
+	}
+
+	for( size_t s=0; s<streams.size(); s++ )
+		nnew += streams[s].nrec;
+	return nnew - nold;
+}
+
+
+
+// per-stream chunk lists and record counts
+void mjlReader::splitIndex(void)
+{
+	for( size_t s=0; s<streams.size(); s++ )
+	{
+		streams[s].index.clear();
+		streams[s].nrec = 0;
+	}
+
+	for( size_t c=0; c<index.size(); c++ )
+	{
+		Stream& st = streams[index[c].stream];
+		st.index.push_back(index[c]);
+		st.nrec += index[c].nrec;
+	}
+}
+
+
+
+// check header and CRC of a chunk
+bool mjlReader::checkEntry(const mjlIndexEntry& e)
+{
+	mjlChunkHeader ch;
+	if( !readChunkHeader(e.offset, &ch) || ch.nrec!=e.nrec || ch.stream!=e.stream )
+		return false;
+
+	return (version<2 || ch.crc==chunkCRC(&ch, map+e.offset+chunkhdr, version));
+}
+
+
+
+// check chunk c in file order
+bool mjlReader::checkChunk(long long c)
+{
+	return checkEntry(index[c]);
+}
+
+
+
+// chunk of stream s containing record i: binary search over first records
+long long mjlReader::chunkOf(int s, long long i)
+{
+	const std::vector<mjlIndexEntry>& idx = streams[s].index;
+	return (long long)(std::upper_bound(idx.begin(), idx.end(), i,
+		[](long long v, const mjlIndexEntry& e){return v<e.first;}) - idx.begin()) - 1;
+}
+
+
+
+// decode chunk c of stream s into its cache, straight from the mapped file
+bool mjlReader::loadChunk(int s, long long c)
+{
+	Stream& st = streams[s];
+	if( c==st.cached )
+		return true;
+
+	st.cached = -1;
+	const mjlIndexEntry& e = st.index[c];
+	if( !checkEntry(e) )
+	{
+		if( e.offset!=damaged )
+			printf("Damaged chunk at offset %lld (stream %d, records %lld to %lld)\n",
+				e.offset, s, e.first, e.first+e.nrec-1);
+		damaged = e.offset;
+		return false;
+	}
+
+	mjlChunkHeader ch;
+	readChunkHeader(e.offset, &ch);
+	long long t0 = mjTimeNS();
+	bool ok = mjl_decode(st.cache, map + e.offset + chunkhdr, ch.size, ch.nrec, st.recsz, workbuf);
+	tmDecode += mjTimeNS() - t0;
+	st.cached = (ok ? c : -1);
+	return ok;
+}
+
+
+
+// record i of stream s
+const float* mjlReader::record(long long i, int s)
+{
+	if( s<0 || s>=(int)streams.size() || i<0 || i>=streams[s].nrec )
+		return 0;
+
+	// .mjl: in place when aligned, otherwise one copy
+	if( !chunked )
+	{
+		int recsz = streams[0].recsz;
+		const unsigned char* p = map + start + sizeof(float)*recsz*i;
+		if( !((size_t)p & (sizeof(float)-1)) )
+			return (const float*)p;
+
+		memcpy(recbuf, p, sizeof(float)*recsz);
+		return recbuf;
+	}
+
+	long long c = chunkOf(s, i);
+	if( !loadChunk(s, c) )
+		return 0;
+
+	return streams[s].cache + (size_t)(i-streams[s].index[c].first)*streams[s].recsz;
+}
+
+
+
+// time of record i (.mjl), without copying the record
+float mjlReader::timeOf(long long i)
+{
+	float t;
+	memcpy(&t, map + start + sizeof(float)*streams[0].recsz*i, sizeof(float));
+	return t;
+}
+
+
+
+// densest stream with mjData fields or with the given fields
+int mjlReader::getMasterStream(const int* field, int nfield, bool events)
+{
+	int best = -1;
+	for( int s=0; s<(int)streams.size(); s++ )
+	{
+		const mjlStream& st = streams[s].desc;
+		bool has = (field!=0);
+		for( int i=0; i<st.nfield && !field; i++ )
+			has = has || (st.field[i]<mjlNDATAFIELD);
+		for( int j=0; j<nfield && field && has; j++ )
+		{
+			bool found = false;
+			for( int i=0; i<st.nfield; i++ )
+				found = found || (st.field[i]==field[j]);
+			has = found;
+		}
+
+		int dec = st.decimation, bdec = (best>=0 ? streams[best].desc.decimation : 0);
+		if( has && (dec>0 || events) && (best<0 || (dec>0 && (bdec==0 || dec<bdec))) )
+			best = s;
+	}
+	return best;
+}
+
+
+
+// first records of the time segments of stream s, scanning records not seen yet
+const std::vector<long long>& mjlReader::getSegments(int s)
+{
+	Stream& st = streams[s];
+	long long i = st.scanned;
+
+	// .mjl: time column in place
+	if( !chunked )
+		for( ; i<st.nrec; i++ )
+		{
+			float t = timeOf(i);
+			if( !i || t<st.tlast )
+				st.segs.push_back(i);
+			st.tlast = t;
+		}
+
+	// .mjc: decode the chunks (a damaged one only has its first and last time)
+	else if( i<st.nrec )
+		for( long long c=chunkOf(s, i); c<(long long)st.index.size(); c++ )
+		{
+			const mjlIndexEntry& e = st.index[c];
+			bool ok = loadChunk(s, c);
+			for( ; i<e.first+e.nrec; i++ )
+			{
+				float t = (ok ? st.cache[(size_t)(i-e.first)*st.recsz] : i==e.first ? e.t0 : e.t1);
+				if( !i || t<st.tlast )
+					st.segs.push_back(i);
+				st.tlast = t;
+			}
+		}
+
+	st.scanned = st.nrec;
+	return st.segs;
+}
+
+
+
+// records [first, last) of the time segment of stream s containing record i
+void mjlReader::getSegment(long long i, int s, long long* first, long long* last)
+{
+	const std::vector<long long>& seg = getSegments(s);
+	long long k = (long long)(std::upper_bound(seg.begin(), seg.end(), i) - seg.begin()) - 1;
+	if( first )
+		*first = (k>=0 ? seg[k] : 0);
+	if( last )
+		*last = (k+1<(long long)seg.size() ? seg[k+1] : streams[s].nrec);
+}
+
+
+
+// last record of stream s with time <= t, in the time segment containing near (>=0)
+long long mjlReader::find(double t, int s, long long near)
+{
+	if( s<0 || s>=(int)streams.size() || !streams[s].nrec )
+		return -1;
+
+	// records searched: the whole stream, or one time segment
+	Stream& st = streams[s];
+	long long lo = 0, hi = st.nrec;
+	if( near>=0 )
+		getSegment(near<st.nrec ? near : st.nrec-1, s, &lo, &hi);
+
+	// .mjl: binary search on the time column in place
+	if( !chunked )
+	{
+		long long a = lo, b = hi;
+		while( a<b )
+		{
+			long long mid = (a+b)/2;
+			if( timeOf(mid) <= t )
+				a = mid+1;
+			else
+				b = mid;
+		}
+		return (a>lo ? a-1 : lo);
+	}
+
+	// .mjc: chunk whose t0 is the last one <= t (the first chunk may start in the
+	// previous segment, so only the later ones are compared), then search inside it
+	long long c0 = chunkOf(s, lo), c1 = chunkOf(s, hi-1);
+	long long c = (long long)(std::upper_bound(st.index.begin()+c0+1, st.index.begin()+c1+1, t,
+		[](double v, const mjlIndexEntry& e){return v<e.t0;}) - st.index.begin()) - 1;
+	const mjlIndexEntry& e = st.index[c];
+	if( !loadChunk(s, c) )
+		return (e.first>lo ? e.first : lo);
+
+	long long a = (lo>e.first ? lo-e.first : 0), b = (hi<e.first+e.nrec ? hi-e.first : e.nrec);
+	long long a0 = a;
+	while( a<b )
+	{
+		long long mid = (a+b)/2;
+		if( st.cache[(size_t)mid*st.recsz] <= t )
+			a = mid+1;
+		else
+			b = mid;
+	}
+	return e.first + (a>a0 ? a-1 : a0);
+}
+
+
+
+// file byte range holding records [first, last) of stream s
+void mjlReader::byteRange(int s, long long first, long long last, long long* b0, long long* b1)
+{
+	if( !chunked )
+	{
+		*b0 = start + (long long)sizeof(float)*streams[0].recsz*first;
+		*b1 = start + (long long)sizeof(float)*streams[0].recsz*last;
+		return;
+	}
+
+	// chunks of other streams in between are included
+	const std::vector<mjlIndexEntry>& idx = streams[s].index;
+	long long c0 = chunkOf(s, first), c1 = chunkOf(s, last-1) + 1;
+	*b0 = idx[c0].offset;
+	*b1 = (c1<(long long)idx.size() ? idx[c1].offset : dataEnd);
+}
+
+
+
+// page-align and pass an advice to the OS (read-ahead or release)
+static void mjl_advise(const unsigned char* map, long long filesz, long long b0, long long b1, bool need)
+{
+	const long long page = 65536;		// multiple of the page size on all targets
+	b0 = (b0/page)*page;
+	b1 = std::min(filesz, b1);
+	if( b1<=b0 )
+		return;
+
+#ifdef _WIN32
+	if( need )
+	{
+	#if defined(_WIN32_WINNT) && _WIN32_WINNT>=0x0602
+		WIN32_MEMORY_RANGE_ENTRY r = {(void*)(map+b0), (SIZE_T)(b1-b0)};
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &r, 0);
+	#endif
+	}
+	else
+		VirtualUnlock((void*)(map+b0), (SIZE_T)(b1-b0));	// not locked: trims the pages from the working set
+#else
+	madvise((void*)(map+b0), (size_t)(b1-b0), need ? MADV_WILLNEED : MADV_DONTNEED);
+#endif
+}
+
+
+
+// keep records around i mapped in: read ahead, release the previous window when left
+void mjlReader::prefetch(long long i, long long ahead, int s)
+{
+	if( !map || s<0 || s>=(int)streams.size() || !streams[s].nrec || ahead<=0 )
+		return;
+
+	long long first = std::max(0LL, i - ahead/4);
+	long long last = std::min(streams[s].nrec, i + ahead);
+	if( first>=last )
+		return;
+
+	// still inside the current window: nothing to do until half of it is used
+	bool have = (winLast>winFirst && winStream==s);
+	if( have && i>=winFirst && i < winFirst + (winLast-winFirst)/2 )
+		return;
+
+	long long b0, b1;
+	byteRange(s, first, last, &b0, &b1);
+
+	// release the parts of the old window that are not in the new one
+	if( winLast>winFirst )
+	{
+		long long o0, o1;
+		if( !have || winLast<=first || winFirst>=last )
+		{
+			byteRange(winStream, winFirst, winLast, &o0, &o1);
+			if( o1<=b0 || o0>=b1 )
+				mjl_advise(map, filesz, o0, o1, false);
+		}
+		else
+		{
+			if( winFirst<first )
+			{
+				byteRange(s, winFirst, first, &o0, &o1);
+				mjl_advise(map, filesz, o0, std::min(o1, b0), false);
+			}
+			if( winLast>last )
+			{
+				byteRange(s, last, winLast, &o0, &o1);
+				mjl_advise(map, filesz, std::max(o0, b1), o1, false);
+			}
+		}
+	}
+
+	mjl_advise(map, filesz, b0, b1, true);
+	winStream = s;
+	winFirst = first;
+	winLast = last;
+}
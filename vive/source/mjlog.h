@@ -0,0 +1,459 @@
+//---------------------------------//
+//  Log writing/reading for puppet //
+//  (.mjl, see parse_mjl.py; .mjc) //
+//---------------------------------//
+
+#pragma once
+
+#include <stdio.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+
+
+//------------------------- Record packer -----------------------------------------------
+//
+// The record layout is computed once per model: an ordered list of double arrays
+// (e.g. &d->time, d->qpos, ..., d->userdata) whose addresses stay valid for the life
+// of mjData. pack() converts all of them to float with SIMD, straight into the
+// output slot; size() is the exact record size, so buffers always match the layout.
+// Raw fields keep the exact doubles (two floats each, bit copies, for replay).
+
+class mjlPacker
+{
+public:
+	// remove all fields
+	void clear(void);
+
+	// append field of n doubles
+	void add(const double* src, int n);
+
+	// append field of n doubles stored exactly (2n floats)
+	void addRaw(const double* src, int n);
+
+	// record size in floats
+	int size(void);
+
+	// convert all fields into dst (size() floats)
+	void pack(float* dst);
+
+private:
+	std::vector<const double*> src;		// field sources
+	std::vector<int> num;				// field sizes
+	std::vector<char> raw;				// field is copied, not converted
+	int recsz = 0;						// sum of field sizes
+};
+
+
+// convert n doubles to float (SSE2/AVX when available)
+void mjl_d2f(float* dst, const double* src, int n);
+
+
+//------------------------- Chunked log format (.mjc) ----------------------------------
+//
+// A .mjc file holds the same records as a .mjl file, in chunks of up to 'chunk'
+// records compressed independently (so any chunk can be decoded on its own):
+//
+//   mjlFileHeader, .mjl header (7 ints + model names), stream table (v3)
+//   { mjlChunkHeader, encoded records (size bytes) } ...
+//   mjlIndexEntry[nchunk], mjlIndexFooter
+//
+// The index trailer is written when the log is closed; it maps frames and times to
+// chunk offsets so a reader can seek without scanning the file. Files without a
+// valid trailer (older logs, crashed sessions) are indexed by walking the chunk
+// headers instead, and 'mjltool index' appends the trailer.
+//
+// Integrity (version 2): the file header carries a CRC of itself and the .mjl
+// header, and every chunk header a CRC of the chunk, so each chunk is a sync
+// marker. After a crash the reader keeps every chunk up to the last one whose CRC
+// checks, and 'mjltool repair' truncates the file there and adds the index.
+// Version 1 files (no CRCs) are still read.
+//
+// Streams (version 3): the records can be split into several streams, each with
+// the time followed by a subset of the fields, written every 'decimation' physics
+// steps. The stream table follows the .mjl header and is covered by headersz and
+// the header CRC; chunks and index entries carry their stream id. One stream with
+// all fields at decimation 1 has the .mjl record layout.
+//
+//   stream table: int nstream, { int decimation, int nfield, int field[nfield] } ...
+//
+// Sessions (version 4): besides the mjData fields (sizes from the .mjl header), a
+// stream can hold session fields whose size is set by the writer: the inputs that
+// drove the simulation (VR devices, glove, scene transform) and the exact state and
+// step inputs needed to replay it. The stream table stores each field's size, and
+// decimation 0 marks an event stream (written when the event occurs).
+//
+//   stream table: int nstream, { int decimation, int nfield, { int field, int size }[nfield] } ...
+//
+// Codec: each float column is predicted linearly from its last two values in the
+// chunk and the integer residual is zigzag-coded (smooth signals leave mostly zero
+// high-order bytes), the residuals are split into 4 byte planes, and the planes are
+// run-length encoded (runs of zero bytes become one control byte). Lossless, no
+// external dependencies.
+
+#define mjlMAGIC_FILE	0x314A434D		// "MJC1"
+#define mjlMAGIC_CHUNK	0x4B4E4843		// "CHNK"
+#define mjlMAGIC_INDEX	0x58444E49		// "INDX"
+#define mjlVERSION		4
+#define mjlMAXSTREAM	16
+
+typedef struct _mjlFileHeader
+{
+	int magic;							// mjlMAGIC_FILE
+	int version;						// mjlVERSION
+	int recsz;							// largest record size in floats
+	int chunk;							// max records per chunk
+	int headersz;						// size of the .mjl header and stream table that follow
+	unsigned int crc;					// CRC of the fields above and what headersz covers (v2)
+} mjlFileHeader;
+
+typedef struct _mjlChunkHeader
+{
+	int magic;							// mjlMAGIC_CHUNK
+	int nrec;							// records in this chunk
+	int size;							// encoded size in bytes
+	float t0;							// time of first record
+	float t1;							// time of last record
+	unsigned int crc;					// CRC of the other fields and the encoded records (v2)
+	int stream;							// stream id (v3)
+} mjlChunkHeader;
+
+// sizes of the structures in older versions (fields at the end are missing)
+#define mjlFILEHEADER_V1	20
+#define mjlCHUNKHEADER_V1	20
+#define mjlCHUNKHEADER_V2	24
+#define mjlINDEXENTRY_V2	24
+
+
+typedef struct _mjlIndexEntry
+{
+	long long offset;					// file offset of the chunk header
+	long long first;					// first record in the chunk (counted in its stream)
+	float t0;							// time of first record
+	float t1;							// time of last record
+	int stream;							// stream id (v3)
+	int nrec;							// records in the chunk (v3)
+} mjlIndexEntry;
+
+typedef struct _mjlIndexFooter
+{
+	long long offset;					// file offset of the first index entry
+	long long nrec;						// records in the file (all streams)
+	int nchunk;							// index entries
+	int magic;							// mjlMAGIC_INDEX (last 4 bytes of the file)
+} mjlIndexFooter;
+
+
+// record fields after the time: mjData fields in .mjl order, then session fields
+// (layout defined by the writer, puppet: see write_logs; raw: exact doubles)
+typedef enum _mjlField
+{
+	mjlFIELD_QPOS = 0,
+	mjlFIELD_QVEL,
+	mjlFIELD_CTRL,
+	mjlFIELD_MOCAP_POS,
+	mjlFIELD_MOCAP_QUAT,
+	mjlFIELD_SENSORDATA,
+	mjlFIELD_USERDATA,
+	mjlNDATAFIELD,
+
+	mjlFIELD_CLOCK = mjlNDATAFIELD,		// wall clock since the log was opened (sec)
+	mjlFIELD_CONTROLLER,				// VR controller poses, buttons and tools
+	mjlFIELD_HMD,						// headset pose
+	mjlFIELD_SCENE,						// model-to-room transform
+	mjlFIELD_GLOVE,						// calibrated glove sample
+	mjlFIELD_INPUT,						// raw: everything mj_step reads besides the state
+	mjlFIELD_RESET,						// raw: state (and model changes) to start a replay
+
+	mjlNFIELD
+} mjlField;
+
+typedef struct _mjlStream
+{
+	int decimation;						// written every decimation physics steps, 0: on events
+	int nfield;							// fields after the time
+	int field[mjlNFIELD];				// mjlField, in record order
+	int size[mjlNFIELD];				// field sizes in floats (mjData fields: from the header)
+} mjlStream;
+
+// field names used in schemas
+extern const char* mjlFIELDNAME[mjlNFIELD];
+
+// size of an mjData field in floats, from the .mjl header sizes (0 for session fields)
+int mjl_fieldSize(const int* sizes, int field);
+
+// set the sizes of the mjData fields of a stream from the .mjl header sizes
+void mjl_setSizes(const int* sizes, mjlStream& stream);
+
+// record size of a stream in floats (time and fields)
+int mjl_recsz(const int* sizes, const mjlStream& stream);
+
+// one stream with all fields at decimation 1 (the .mjl layout)
+mjlStream mjl_defaultStream(void);
+
+// parse a schema like "qpos,ctrl sensordata/5 qvel/500": streams are separated by
+// spaces, fields by commas, "/n" sets the decimation, "mocap" is mocap_pos and
+// mocap_quat; false (with a message) on error
+bool mjl_parseStreams(const char* spec, std::vector<mjlStream>& streams);
+
+
+// CRC-32C of n bytes, continuing from crc (0 to start)
+unsigned int mjl_crc32(unsigned int crc, const void* data, size_t n);
+
+// worst-case encoded size of n floats
+int mjl_encodeBound(int n);
+
+// encode nrec records of recsz floats; work: 4*nrec*recsz bytes; returns encoded size
+int mjl_encode(unsigned char* out, const float* rec, int nrec, int recsz, unsigned char* work);
+
+// decode into nrec records of recsz floats; work as above; false if data is corrupt
+bool mjl_decode(float* rec, const unsigned char* in, int insz, int nrec, int recsz, unsigned char* work);
+
+// write index trailer at the current file position in the layout of the given file
+// version; nrec: records in all streams; returns bytes written
+long long mjl_writeIndex(FILE* fp, const std::vector<mjlIndexEntry>& index, long long nrec,
+						 int version = mjlVERSION);
+
+
+
+//------------------------- Asynchronous writer -----------------------------------------
+//
+// The producer (physics thread) copies each record into a slot of a preallocated
+// ring: acquire() returns the next free slot, commit() publishes it. Neither call
+// touches the disk, takes a lock or allocates. A writer thread drains the ring in
+// large batches. When the ring is full the record is dropped and counted, so a
+// slow disk never stalls the producer.
+//
+// With chunk>0 the file is written in the chunked .mjc format; compression runs
+// on the writer thread. Several streams need the chunked format: each stream is
+// collected into its own chunks, and acquire() names the stream of the record.
+//
+// With syncms>0 the writer thread makes the file durable at that interval: the
+// pending (possibly partial) chunks are written, and the file is flushed to disk
+// with fdatasync/FlushFileBuffers. A crash then loses at most syncms of records.
+//
+// Single producer only: acquire/commit must be called from one thread.
+
+class mjlWriter
+{
+public:
+	mjlWriter();
+	~mjlWriter();
+
+	// create file, write header, start writer thread; one stream of recsz floats
+	// chunk: 0 for .mjl, records per chunk for .mjc (header must hold the .mjl sizes)
+	// syncms: 0 to leave flushing to the OS
+	bool open(const char* filename, const void* header, int headersz,
+			  int recsz, int nslot = 4096, int chunk = 0, int syncms = 0);
+
+	// as above with several streams, always .mjc; header: .mjl header (sizes and names)
+	// session fields take their size from the stream, mjData fields from the header
+	bool open(const char* filename, const void* header, int headersz,
+			  const std::vector<mjlStream>& streams, int nslot = 4096, int chunk = 256, int syncms = 0);
+
+	// drain ring, stop writer thread, close file, print statistics
+	void close(void);
+
+	// next free slot (recsz floats of the stream), 0 if the ring is full (record dropped)
+	// wait: block until a slot is free instead (offline tools, never from physics)
+	float* acquire(bool wait = false, int stream = 0);
+
+	// publish the slot returned by the last acquire()
+	void commit(void);
+
+	// read-only access
+	bool isOpen(void)					{return fp!=0;}
+	long long getNRecord(void)			{return head;}
+	long long getNOverflow(void)		{return noverflow;}
+	long long getNBytes(void)			{return nbytes;}
+	long long getNRawBytes(void)		{return nraw;}
+	long long getTmEncode(void)			{return tmEncode;}	// ns spent encoding
+	long long getWorstEnqueueNS(void)	{return worstEnqueue;}
+
+private:
+	bool start(const char* filename, const void* header, int headersz, int nslot, int syncms);
+	void run(void);						// writer thread
+	void write(long long first, long long n);	// write ring records [first, first+n) (writer thread)
+	void flushChunk(int s);				// encode and write pending chunk of stream s (writer thread)
+	void sync(void);					// make everything written so far durable (writer thread)
+
+	FILE* fp;							// output file
+	int recsz;							// slot size in floats (largest record)
+	int nslot;							// ring capacity in records
+	float* ring;						// nslot*recsz floats
+	int* slotStream;					// stream of each slot
+
+	std::atomic<long long> head;		// records committed by the producer
+	std::atomic<long long> tail;		// records written by the writer thread
+	long long noverflow;				// records dropped because the ring was full
+	long long nbytes;					// bytes written, including header
+	long long tmAcquire;				// time of last acquire (ns)
+	long long worstEnqueue;				// longest acquire-to-commit (ns)
+	long long tmOpen;					// time of open (ns)
+
+	int chunk;							// records per chunk (0: .mjl)
+	std::vector<int> srecsz;			// record size of each stream
+	std::vector<float*> chunkbuf;		// pending records of each stream (chunk*srecsz)
+	std::vector<int> nchunkrec;			// records pending in chunkbuf
+	std::vector<long long> nchunked;	// records of each stream written in chunks
+	unsigned char* encbuf;				// encoded chunk
+	unsigned char* workbuf;				// codec scratch
+	long long nraw;						// uncompressed record bytes
+	long long tmEncode;					// time spent encoding (ns)
+	int syncms;							// sync interval (ms), 0: never
+	long long tmSync;					// time of last sync (ns)
+	long long nsync;					// number of syncs
+	std::vector<mjlIndexEntry> index;	// chunk index, written on close
+
+	std::thread writer_th;				// writer thread
+	std::mutex mtx;						// used with cv only
+	std::condition_variable cv;			// wakes the writer thread
+	std::atomic<bool> running;			// writer thread should keep going
+};
+
+
+
+//------------------------- Reader ------------------------------------------------------
+//
+// Reads .mjl and .mjc logs (detected from the file contents). record(i, s) returns
+// record i of stream s; for .mjc only the chunk containing it is read and decoded,
+// located by binary search in the stream's chunk index. find(time) is O(log n) for
+// both formats: .mjl records are at fixed offsets, .mjc searches the index and then
+// one chunk. Time restarts at a reset, so callers that move through a log with
+// resets search within its time segments (getSegments, find with near). .mjl files
+// and .mjc files before version 3 have a single stream with all fields.
+//
+// The file is memory-mapped, not loaded: open() only reads the header (and the
+// index), .mjl records are returned in place and .mjc chunks are decoded straight
+// from the mapping. Pages are faulted in as records are touched; prefetch() asks
+// the OS to read ahead around a cursor and to drop the window it left behind, so
+// resident memory follows the frames being viewed rather than the file size.
+//
+// A log that is still being written can be followed: refresh() maps the part
+// appended since open() and indexes the records/chunks that are complete (for .mjc
+// the writer's sync interval decides how often chunks reach the file).
+
+class mjlReader
+{
+public:
+	mjlReader();
+	~mjlReader();
+
+	// map log, read header and chunk index (scan chunks if there is no index)
+	bool open(const char* filename);
+
+	// release everything
+	void close(void);
+
+	// record i of stream s, 0 if out of range or corrupt; valid until the next call
+	// for the same stream
+	const float* record(long long i, int s = 0);
+
+	// last record of stream s with time <= t (0 if t is before the first record),
+	// -1 if the stream is empty; near>=0: search only the time segment containing
+	// record near (the first one of the segment if t is before it)
+	long long find(double t, int s = 0, long long near = -1);
+
+	// densest decimated stream with mjData fields (the one playlog plays), or with all
+	// nfield fields in field; events: an event stream if no decimated stream has them;
+	// -1 if none
+	int getMasterStream(const int* field = 0, int nfield = 0, bool events = false);
+
+	// first records of the time segments of stream s: time restarts where the
+	// simulation was reset, so a log is a sequence of segments of increasing time.
+	// Records not seen yet (the first call, or after refresh) are scanned once:
+	// .mjc decodes their chunks, which invalidates record pointers of stream s
+	const std::vector<long long>& getSegments(int s = 0);
+
+	// records [*first, *last) of the time segment of stream s containing record i
+	// (either pointer may be 0)
+	void getSegment(long long i, int s, long long* first, long long* last);
+
+	// read ahead records [i-ahead/4, i+ahead) of stream s, release the previous window
+	void prefetch(long long i, long long ahead, int s = 0);
+
+	// pick up records appended to the file (log still being written); returns the
+	// number of new records in all streams; invalidates record pointers
+	long long refresh(void);
+
+	// check the header and CRC (v2) of chunk c (file order); false if it is damaged
+	bool checkChunk(long long c);
+
+	// read-only access
+	int getNStream(void)			{return (int)streams.size();}
+	const mjlStream& getStream(int s)	{return streams[s].desc;}
+	long long getNRecord(int s = 0)	{return streams.empty() ? 0 : streams[s].nrec;}
+	int getRecsz(int s = 0)			{return streams.empty() ? 0 : streams[s].recsz;}
+	const int* getSizes(void)		{return sizes;}		// nq nv nu nmocap nsensordata nuserdata namelen
+	const char* getNames(void)		{return names.data();}
+	bool isChunked(void)			{return chunked;}
+	long long getFileSize(void)		{return filesz;}
+	long long getNChunk(void)		{return (long long)index.size();}
+	const std::vector<mjlIndexEntry>& getIndex(void)	{return index;}	// all chunks, file order
+	bool hasIndex(void)				{return indexed;}	// index read from the file
+	long long getDataEnd(void)		{return dataEnd;}	// end of the last complete record/chunk
+	int getVersion(void)			{return version;}	// .mjc version, 0 for .mjl
+	long long getTmDecode(void)		{return tmDecode;}	// ns spent decoding
+
+private:
+	struct Stream
+	{
+		mjlStream desc;					// fields and decimation
+		int recsz;						// record size in floats
+		long long nrec;					// number of records
+		std::vector<mjlIndexEntry> index;	// chunks of this stream
+		float* cache;					// decoded chunk
+		long long cached;				// chunk in cache (-1: none)
+		std::vector<long long> segs;	// first records of the time segments
+		long long scanned;				// records scanned for segments
+		float tlast;					// time of the last record scanned
+	};
+
+	bool mapFile(const char* filename);	// map the whole file read-only
+	long long fileSize(void);		// current size of the open file
+	bool mapView(long long sz);		// (re)map the first sz bytes
+	bool get(void* dst, long long pos, long long n);	// copy bytes from the mapping
+	bool readStreams(long long pos, long long end);	// parse the stream table
+	float timeOf(long long i);		// time of .mjl record i
+	void byteRange(int s, long long first, long long last, long long* b0, long long* b1);
+	long long chunkOf(int s, long long i);	// chunk of stream s containing record i
+	bool checkEntry(const mjlIndexEntry& e);	// check header and CRC of a chunk
+	bool loadChunk(int s, long long c);	// decode chunk c of stream s into its cache
+	bool readChunkHeader(long long pos, mjlChunkHeader* ch);	// read and check header
+	bool readIndex(long long start);	// read index trailer
+	void scanChunks(long long start, bool quiet);	// index chunks from their headers
+	void splitIndex(void);			// per-stream chunk lists from the index
+
+	const unsigned char* map;		// mapped file
+#ifdef _WIN32
+	void* hfile;					// file handle
+	void* hmap;						// file mapping handle
+#else
+	int fd;							// file descriptor
+#endif
+	bool chunked;					// .mjc
+	long long filesz;				// file size in bytes
+	int sizes[7];					// .mjl header sizes
+	std::vector<char> names;		// model names (0-terminated)
+	std::vector<Stream> streams;	// record streams
+
+	long long start;				// offset of the first record/chunk
+	int winStream;					// stream of the prefetched window
+	long long winFirst, winLast;	// prefetched records
+
+	// .mjl
+	float* recbuf;					// copy of an unaligned record
+
+	// .mjc
+	int chunk;						// max records per chunk
+	int version;					// file version
+	int chunkhdr;					// chunk header size in this version
+	std::vector<mjlIndexEntry> index;	// chunk index, file order
+	bool indexed;					// index read from the trailer
+	long long dataEnd;				// end of the last chunk
+	long long damaged;				// offset of the last damaged chunk reported
+	unsigned char* workbuf;			// codec scratch
+	long long tmDecode;				// time spent decoding (ns)
+};
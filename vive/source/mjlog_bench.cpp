@@ -0,0 +1,101 @@
+//---------------------------------//
+//  Log packing/writing benchmark  //
+//  Usage: mjlog_bench [recsz] [seconds] [rate]
+//---------------------------------//
+
+#include "mjlog.h"
+#include "timing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+
+// old write_logs conversion (scalar, one call per field)
+static int num2float(float* res, const double* data, int n)
+{
+	for( int i=0; i<n; i++ )
+		res[i] = (float)data[i];
+	return n;
+}
+
+
+
+int main(int argc, char** argv)
+{
+	// large model by default (humanoid100-sized state + sensors), 2 kHz, 5 sec
+	int recsz = (argc>1 ? atoi(argv[1]) : 8000);
+	double duration = (argc>2 ? atof(argv[2]) : 5);
+	double rate = (argc>3 ? atof(argv[3]) : 2000);
+
+	// split the record into 8 fields like write_logs: time, qpos, qvel, ctrl, mocap, sensors, user
+	const int nfield = 8;
+	int num[nfield] = {1, 0, 0, 0, 0, 0, 0, 0};
+	int rest = recsz - 1;
+	for( int i=1; i<nfield; i++ )
+		num[i] = (i<nfield-1 ? rest/(nfield-1) : rest - (nfield-2)*(rest/(nfield-1)));
+
+	std::vector<double> state(recsz);
+	for( int i=0; i<recsz; i++ )
+		state[i] = 0.001*i;
+
+	mjlPacker packer;
+	for( int i=0, adr=0; i<nfield; adr+=num[i], i++ )
+		packer.add(state.data()+adr, num[i]);
+
+	// packing only: scalar vs packer
+	std::vector<float> rec(recsz);
+	const int nrep = 20000;
+	long long t0 = mjTimeNS();
+	for( int r=0; r<nrep; r++ )
+	{
+		int wpos = 0;
+		for( int i=0, adr=0; i<nfield; adr+=num[i], i++ )
+			wpos += num2float(rec.data()+wpos, state.data()+adr, num[i]);
+	}
+	double scalar = (double)(mjTimeNS()-t0)/nrep;
+
+	t0 = mjTimeNS();
+	for( int r=0; r<nrep; r++ )
+		packer.pack(rec.data());
+	double simd = (double)(mjTimeNS()-t0)/nrep;
+
+	printf("record: %d floats (%.1f KB)\n", recsz, 4e-3*recsz);
+	printf("pack scalar : %8.0f ns/record  %6.2f GB/s\n", scalar, 8.0*recsz/scalar);
+	printf("pack mjl    : %8.0f ns/record  %6.2f GB/s\n", simd, 8.0*recsz/simd);
+
+	// end to end: paced producer at rate Hz through mjlWriter
+	mjlWriter writer;
+	if( !writer.open("mjlog_bench.log", 0, 0, recsz) )
+		return 1;
+
+	long long period = (long long)(1e9/rate);
+	long long next = mjTimeNS();
+	long long nrec = (long long)(duration*rate);
+	long long overrun = 0;
+	for( long long n=0; n<nrec; n++ )
+	{
+		state[0] = n/rate;
+		float* slot = writer.acquire();
+		if( slot )
+		{
+			packer.pack(slot);
+			writer.commit();
+		}
+
+		// pace like the physics loop
+		next += period;
+		long long left = next - mjTimeNS();
+		if( left>0 )
+			std::this_thread::sleep_for(std::chrono::nanoseconds(left));
+		else
+			overrun++;
+	}
+	printf("producer at %.0f Hz for %.1f s: %lld overruns\n", rate, duration, overrun);
+	writer.close();
+	remove("mjlog_bench.log");
+	return 0;
+}
@@ -0,0 +1,661 @@
+//---------------------------------//
+//  Event search in puppet logs    //
+//---------------------------------//
+
+#include "mjlquery.h"
+#include "mjlcatalog.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+
+
+//------------------------- Conditions --------------------------------------------------
+
+static const char* mjlTERMNAME[] = {"", "abs", "rate", "norm", "speed"};
+
+
+// skip spaces
+static const char* skipSpace(const char* p)
+{
+	while( *p==' ' || *p=='\t' )
+		p++;
+	return p;
+}
+
+
+
+// parse query
+bool mjl_parseQuery(const char* text, std::vector<mjlCondition>& cond)
+{
+	cond.clear();
+	const char* p = skipSpace(text);
+	while( *p )
+	{
+		mjlCondition c;
+		c.term = mjlTERM_VALUE;
+		c.first = 0;
+		c.count = 1;
+
+		// function around the field
+		for( int t=mjlTERM_ABS; t<=mjlTERM_SPEED; t++ )
+		{
+			int len = (int)strlen(mjlTERMNAME[t]);
+			if( !strncmp(p, mjlTERMNAME[t], len) && *skipSpace(p+len)=='(' )
+			{
+				c.term = t;
+				p = skipSpace(skipSpace(p+len)+1);
+				break;
+			}
+		}
+
+		// field name
+		const char* q = p;
+		while( (*q>='a' && *q<='z') || *q=='_' )
+			q++;
+		c.field = -1;
+		for( int f=0; f<mjlNFIELD; f++ )
+			if( (int)strlen(mjlFIELDNAME[f])==(int)(q-p) && !strncmp(p, mjlFIELDNAME[f], q-p) )
+				c.field = f;
+		if( c.field<0 || c.field==mjlFIELD_INPUT || c.field==mjlFIELD_RESET )
+		{
+			printf("Query: unknown or raw field '%.*s'\n", (int)(q-p), p);
+			return false;
+		}
+
+		// components: [i] or [i:j]
+		p = skipSpace(q);
+		if( *p!='[' )
+		{
+			printf("Query: '%s' needs a component, e.g. %s[0]\n", mjlFIELDNAME[c.field], mjlFIELDNAME[c.field]);
+			return false;
+		}
+		char* end;
+		c.first = (int)strtol(p+1, &end, 10);
+		p = skipSpace(end);
+		if( *p==':' )
+		{
+			c.count = (int)strtol(p+1, &end, 10) - c.first;
+			p = skipSpace(end);
+		}
+		if( *p!=']' || c.first<0 || c.count<1 || (c.count>1 && c.term!=mjlTERM_NORM && c.term!=mjlTERM_SPEED) )
+		{
+			printf("Query: bad components of '%s' (norm and speed take i:j, the others i)\n",
+				   mjlFIELDNAME[c.field]);
+			return false;
+		}
+		p = skipSpace(p+1);
+		if( c.term!=mjlTERM_VALUE )
+		{
+			if( *p!=')' )
+			{
+				printf("Query: missing ')' after %s(%s[...]\n", mjlTERMNAME[c.term], mjlFIELDNAME[c.field]);
+				return false;
+			}
+			p = skipSpace(p+1);
+		}
+
+		// operator ("<=" tried before "<")
+		static const char* opname[] = {"<", "<=", ">", ">=", "==", "!="};
+		c.op = -1;
+		for( int o=mjlOP_NE; o>=mjlOP_LT && c.op<0; o-- )
+			if( !strncmp(p, opname[o], strlen(opname[o])) )
+				c.op = o;
+		if( c.op<0 )
+		{
+			printf("Query: expected < <= > >= == or != at '%s'\n", p);
+			return false;
+		}
+		p = skipSpace(p + strlen(opname[c.op]));
+
+		// value
+		c.value = (float)strtod(p, &end);
+		if( end==p )
+		{
+			printf("Query: expected a number at '%s'\n", p);
+			return false;
+		}
+		cond.push_back(c);
+
+		// next condition
+		p = skipSpace(end);
+		if( *p && strncmp(p, "&&", 2) )
+		{
+			printf("Query: expected && at '%s'\n", p);
+			return false;
+		}
+		if( *p )
+			p = skipSpace(p+2);
+	}
+
+	if( cond.empty() )
+	{
+		printf("Query: no conditions\n");
+		return false;
+	}
+	return true;
+}
+
+
+
+//------------------------- Block statistics --------------------------------------------
+
+// statistics of one stream
+struct StreamStats
+{
+	int recsz;							// record size in floats
+	long long nrec;						// records in the stream
+	std::vector<mjlBlockStats> block;	// blocks in record order
+	std::vector<float> stat;			// 3*recsz per block: min, max, largest |rate|
+};
+
+
+// blocks of stream s: its chunks (.mjc) or mjlQBLOCK records (.mjl)
+static void makeBlocks(mjlReader& rd, int s, std::vector<mjlBlockStats>& block)
+{
+	block.clear();
+	if( rd.isChunked() )
+	{
+		const std::vector<mjlIndexEntry>& index = rd.getIndex();
+		for( size_t c=0; c<index.size(); c++ )
+			if( index[c].stream==s )
+			{
+				mjlBlockStats b = {index[c].first, index[c].nrec, 1};
+				block.push_back(b);
+			}
+	}
+	else
+		for( long long i=0; i<rd.getNRecord(s); i+=mjlQBLOCK )
+		{
+			mjlBlockStats b = {i, (int)(rd.getNRecord(s)-i<mjlQBLOCK ? rd.getNRecord(s)-i : mjlQBLOCK), 1};
+			block.push_back(b);
+		}
+}
+
+
+
+// copy records [first, first+n) of stream s into rows after the previous record: prev,
+// else record first-1 if needprev (.mjc: may decode another chunk), else (or at the
+// start of the stream) the first record again; returns the records copied, < n if the
+// block is corrupt
+static int readBlock(mjlReader& rd, int s, long long first, int n, std::vector<float>& rows,
+					 const float* prev, bool needprev)
+{
+	int recsz = rd.getRecsz(s);
+	rows.resize((size_t)(n+1)*recsz);
+	if( !prev && needprev && first>0 )
+		prev = rd.record(first-1, s);
+	if( prev )
+		memcpy(rows.data(), prev, sizeof(float)*recsz);
+
+	int r;
+	for( r=0; r<n; r++ )
+	{
+		const float* rec = rd.record(first+r, s);
+		if( !rec )
+			break;
+		memcpy(rows.data() + (size_t)(r+1)*recsz, rec, sizeof(float)*recsz);
+	}
+	if( !prev && r>0 )
+		memcpy(rows.data(), rows.data()+recsz, sizeof(float)*recsz);
+	return r;
+}
+
+
+
+// change per second between two records (0 across a time reset)
+static inline float rateOf(float x0, float x1, float t0, float t1)
+{
+	return (t1>t0 ? (x1-x0)/(t1-t0) : 0);
+}
+
+
+
+// one pass over the log: statistics of every block of every stream
+static bool buildStats(mjlReader& rd, std::vector<StreamStats>& stats)
+{
+	std::vector<float> rows, last;
+	stats.resize(rd.getNStream());
+	for( int s=0; s<rd.getNStream(); s++ )
+	{
+		StreamStats& st = stats[s];
+		st.recsz = rd.getRecsz(s);
+		st.nrec = rd.getNRecord(s);
+		makeBlocks(rd, s, st.block);
+		st.stat.resize((size_t)3*st.recsz*st.block.size());
+		last.clear();
+
+		for( size_t b=0; b<st.block.size(); b++ )
+		{
+			float* mn = st.stat.data() + (size_t)3*st.recsz*b;
+			float* mx = mn + st.recsz;
+			float* rt = mx + st.recsz;
+			rd.prefetch(st.block[b].first, 16*mjlQBLOCK, s);
+			int n = readBlock(rd, s, st.block[b].first, st.block[b].nrec, rows,
+							  last.empty() ? 0 : last.data(), true);
+			st.block[b].ok = (n==st.block[b].nrec);
+
+			// min, max and largest |rate| of each float (rows: previous record first)
+			const float* prev = rows.data();
+			for( int c=0; c<st.recsz; c++ )
+			{
+				mn[c] = prev[st.recsz+c];
+				mx[c] = prev[st.recsz+c];
+				rt[c] = 0;
+			}
+			for( int r=0; r<n; r++, prev+=st.recsz )
+			{
+				const float* rec = prev + st.recsz;
+				for( int c=0; c<st.recsz; c++ )
+				{
+					mn[c] = (rec[c]<mn[c] ? rec[c] : mn[c]);
+					mx[c] = (rec[c]>mx[c] ? rec[c] : mx[c]);
+					float a = fabsf(rateOf(prev[c], rec[c], prev[0], rec[0]));
+					rt[c] = (a>rt[c] ? a : rt[c]);
+				}
+			}
+
+			// previous record of the next block
+			if( n>0 && st.block[b].ok )
+				last.assign(prev, prev+st.recsz);
+			else
+				last.clear();
+		}
+	}
+	return true;
+}
+
+
+
+// statistics header of the log as it is now: two logs of one model and length have
+// the same sizes, so its modification time and contents identify it
+static void statsHeader(const char* filename, mjlReader& rd, mjlStatsHeader* h)
+{
+	memset(h, 0, sizeof(mjlStatsHeader));
+	h->magic = mjlMAGIC_STATS;
+	h->version = mjlSTATS_VERSION;
+	h->filesz = rd.getFileSize();
+	h->dataEnd = rd.getDataEnd();
+	long long size;
+	if( !mjl_fileInfo(filename, &size, &h->mtime) )
+		h->mtime = -1;
+	h->nstream = rd.getNStream();
+	h->block = (rd.isChunked() ? 0 : mjlQBLOCK);
+
+	// header: sizes, model names, streams; .mjc: chunk index; .mjl: last record
+	unsigned int crc = mjl_crc32(0, rd.getSizes(), 7*sizeof(int));
+	crc = mjl_crc32(crc, rd.getNames(), rd.getSizes()[6]);
+	for( int s=0; s<rd.getNStream(); s++ )
+	{
+		const mjlStream& st = rd.getStream(s);
+		crc = mjl_crc32(crc, &st.decimation, 2*sizeof(int));
+		crc = mjl_crc32(crc, st.field, st.nfield*sizeof(int));
+		crc = mjl_crc32(crc, st.size, st.nfield*sizeof(int));
+	}
+	if( rd.isChunked() )
+		crc = mjl_crc32(crc, rd.getIndex().data(), sizeof(mjlIndexEntry)*rd.getIndex().size());
+	else if( rd.getNRecord(0) )
+	{
+		const float* rec = rd.record(rd.getNRecord(0)-1, 0);
+		if( rec )
+			crc = mjl_crc32(crc, rec, sizeof(float)*rd.getRecsz(0));
+	}
+	h->crc = crc;
+}
+
+
+
+// read the statistics of a log from its .mjs file; false if missing or out of date
+static bool loadStats(const std::string& name, const char* filename, mjlReader& rd,
+					  std::vector<StreamStats>& stats)
+{
+	FILE* fp = fopen(name.c_str(), "rb");
+	if( !fp )
+		return false;
+
+	mjlStatsHeader h, cur;
+	statsHeader(filename, rd, &cur);
+	bool ok = (fread(&h, sizeof(h), 1, fp)==1 && h.magic==cur.magic && h.version==cur.version &&
+			   h.filesz==cur.filesz && h.dataEnd==cur.dataEnd && h.mtime==cur.mtime &&
+			   h.nstream==cur.nstream && h.block==cur.block && h.crc==cur.crc);
+	stats.resize(ok ? h.nstream : 0);
+	for( int s=0; ok && s<h.nstream; s++ )
+	{
+		StreamStats& st = stats[s];
+		long long nblock;
+		ok = (fread(&st.recsz, sizeof(int), 1, fp)==1 && fread(&st.nrec, sizeof(long long), 1, fp)==1 &&
+			  fread(&nblock, sizeof(long long), 1, fp)==1 && st.recsz==rd.getRecsz(s) &&
+			  st.nrec==rd.getNRecord(s) && nblock>=0 && nblock<=st.nrec);
+		if( !ok )
+			break;
+
+		st.block.resize((size_t)nblock);
+		st.stat.resize((size_t)3*st.recsz*nblock);
+		for( long long b=0; b<nblock && ok; b++ )
+			ok = (fread(&st.block[b], sizeof(mjlBlockStats), 1, fp)==1 &&
+				  fread(st.stat.data() + (size_t)3*st.recsz*b, sizeof(float)*3*st.recsz, 1, fp)==1);
+	}
+
+	fclose(fp);
+	return ok;
+}
+
+
+
+// write the statistics of a log to its .mjs file
+static bool saveStats(const std::string& name, const char* filename, mjlReader& rd,
+					  const std::vector<StreamStats>& stats)
+{
+	FILE* fp = fopen(name.c_str(), "wb");
+	if( !fp )
+		return false;
+
+	mjlStatsHeader h;
+	statsHeader(filename, rd, &h);
+	bool ok = (fwrite(&h, sizeof(h), 1, fp)==1);
+	for( size_t s=0; s<stats.size() && ok; s++ )
+	{
+		const StreamStats& st = stats[s];
+		long long nblock = (long long)st.block.size();
+		ok = (fwrite(&st.recsz, sizeof(int), 1, fp)==1 && fwrite(&st.nrec, sizeof(long long), 1, fp)==1 &&
+			  fwrite(&nblock, sizeof(long long), 1, fp)==1);
+		for( long long b=0; b<nblock && ok; b++ )
+			ok = (fwrite(&st.block[b], sizeof(mjlBlockStats), 1, fp)==1 &&
+				  fwrite(st.stat.data() + (size_t)3*st.recsz*b, sizeof(float)*3*st.recsz, 1, fp)==1);
+	}
+
+	ok = (fclose(fp)==0) && ok;
+	if( !ok )
+		remove(name.c_str());
+	return ok;
+}
+
+
+
+//------------------------- Search ------------------------------------------------------
+
+// range [lo, hi] of a term over a block from its statistics (off: record offset of the
+// first component)
+static void termBounds(const mjlCondition& c, int off, const float* mn, const float* mx,
+					   const float* rt, float* lo, float* hi)
+{
+	float slo = 0, shi = 0;
+	for( int i=off; i<off+c.count; i++ )
+	{
+		float a = fabsf(mn[i]), b = fabsf(mx[i]);
+		float alo = (mn[i]<=0 && mx[i]>=0 ? 0 : (a<b ? a : b));
+		float ahi = (a>b ? a : b);
+		switch( c.term )
+		{
+		case mjlTERM_VALUE:	*lo = mn[i];	*hi = mx[i];	return;
+		case mjlTERM_ABS:	*lo = alo;		*hi = ahi;		return;
+		case mjlTERM_RATE:	*lo = -rt[i];	*hi = rt[i];	return;
+		case mjlTERM_NORM:	slo += alo*alo;	shi += ahi*ahi;	break;
+		default:			shi += rt[i]*rt[i];				break;
+		}
+	}
+
+	// norms: margin for rounding (bound and records are rounded separately)
+	*lo = sqrtf(slo)*(1-1e-5f);
+	*hi = sqrtf(shi)*(1+1e-5f);
+}
+
+
+
+// can a term in [lo, hi] satisfy the condition
+static bool canMatch(const mjlCondition& c, float lo, float hi)
+{
+	switch( c.op )
+	{
+	case mjlOP_LT:	return lo<c.value;
+	case mjlOP_LE:	return lo<=c.value;
+	case mjlOP_GT:	return hi>c.value;
+	case mjlOP_GE:	return hi>=c.value;
+	case mjlOP_EQ:	return lo<=c.value && c.value<=hi;
+	default:		return !(lo==c.value && hi==c.value);
+	}
+}
+
+
+
+// term of records 1..n of the columns (column 0: time; x: columns of the components,
+// each n+1 values with the previous record first) into val
+static void evalTerm(const mjlCondition& c, const float* t, const float* const* x, int n, float* val)
+{
+	switch( c.term )
+	{
+	case mjlTERM_VALUE:
+		memcpy(val, x[0]+1, sizeof(float)*n);
+		break;
+
+	case mjlTERM_ABS:
+		for( int r=0; r<n; r++ )
+			val[r] = fabsf(x[0][r+1]);
+		break;
+
+	case mjlTERM_RATE:
+		for( int r=0; r<n; r++ )
+			val[r] = rateOf(x[0][r], x[0][r+1], t[r], t[r+1]);
+		break;
+
+	case mjlTERM_NORM:
+	case mjlTERM_SPEED:
+		memset(val, 0, sizeof(float)*n);
+		for( int i=0; i<c.count; i++ )
+		{
+			if( c.term==mjlTERM_NORM )
+				for( int r=0; r<n; r++ )
+					val[r] += x[i][r+1]*x[i][r+1];
+			else
+				for( int r=0; r<n; r++ )
+				{
+					float v = rateOf(x[i][r], x[i][r+1], t[r], t[r+1]);
+					val[r] += v*v;
+				}
+		}
+		for( int r=0; r<n; r++ )
+			val[r] = sqrtf(val[r]);
+		break;
+	}
+}
+
+
+
+// clear mask where the term does not satisfy the condition
+static void applyOp(const mjlCondition& c, const float* val, int n, unsigned char* mask)
+{
+	float v = c.value;
+	switch( c.op )
+	{
+	case mjlOP_LT:	for( int r=0; r<n; r++ ) mask[r] &= (val[r]<v);		break;
+	case mjlOP_LE:	for( int r=0; r<n; r++ ) mask[r] &= (val[r]<=v);	break;
+	case mjlOP_GT:	for( int r=0; r<n; r++ ) mask[r] &= (val[r]>v);		break;
+	case mjlOP_GE:	for( int r=0; r<n; r++ ) mask[r] &= (val[r]>=v);	break;
+	case mjlOP_EQ:	for( int r=0; r<n; r++ ) mask[r] &= (val[r]==v);	break;
+	default:		for( int r=0; r<n; r++ ) mask[r] &= (val[r]!=v);	break;
+	}
+}
+
+
+
+// search a log
+bool mjl_query(const char* filename, const std::vector<mjlCondition>& cond,
+			   std::vector<mjlEvent>& events, mjlQueryInfo* info)
+{
+	events.clear();
+	mjlReader rd;
+	if( !rd.open(filename) )
+	{
+		printf("Could not open %s\n", filename);
+		return false;
+	}
+
+	// stream: the densest one with all the fields of the query
+	std::vector<int> fields;
+	for( size_t j=0; j<cond.size(); j++ )
+		fields.push_back(cond[j].field);
+	int s = rd.getMasterStream(fields.data(), (int)fields.size(), true);
+	if( s<0 )
+	{
+		printf("%s: no stream has all the fields of the query\n", filename);
+		return false;
+	}
+
+	// record offset of the first component of each condition
+	const mjlStream& st = rd.getStream(s);
+	std::vector<int> off(cond.size());
+	for( size_t j=0; j<cond.size(); j++ )
+	{
+		int adr = 1;
+		for( int i=0; i<st.nfield && st.field[i]!=cond[j].field; i++ )
+			adr += st.size[i];
+		int size = 0;
+		for( int i=0; i<st.nfield; i++ )
+			if( st.field[i]==cond[j].field )
+				size = st.size[i];
+		if( cond[j].first+cond[j].count>size )
+		{
+			printf("%s: %s has %d components\n", filename, mjlFIELDNAME[cond[j].field], size);
+			return false;
+		}
+		off[j] = adr + cond[j].first;
+	}
+
+	// statistics from the .mjs file, built if missing or out of date
+	std::vector<StreamStats> stats;
+	std::string sname = std::string(filename) + ".mjs";
+	bool built = !loadStats(sname, filename, rd, stats);
+	if( built )
+	{
+		buildStats(rd, stats);
+		if( !saveStats(sname, filename, rd, stats) )
+			printf("%s: could not save statistics to %s\n", filename, sname.c_str());
+	}
+
+	// search the blocks whose statistics allow a match
+	bool needprev = false;
+	for( size_t j=0; j<cond.size(); j++ )
+		needprev = needprev || cond[j].term==mjlTERM_RATE || cond[j].term==mjlTERM_SPEED;
+	const StreamStats& ss = stats[s];
+	int recsz = ss.recsz;
+	std::vector<float> rows, col, val;
+	std::vector<const float*> x;
+	std::vector<unsigned char> mask;
+	long long nread = 0, nmatch = 0;
+	for( size_t b=0; b<ss.block.size(); b++ )
+	{
+		const mjlBlockStats& bs = ss.block[b];
+		if( !bs.ok )
+			continue;
+		const float* mn = ss.stat.data() + (size_t)3*recsz*b;
+		bool can = true;
+		for( size_t j=0; j<cond.size() && can; j++ )
+		{
+			float lo, hi;
+			termBounds(cond[j], off[j], mn, mn+recsz, mn+2*recsz, &lo, &hi);
+			can = canMatch(cond[j], lo, hi);
+		}
+		if( !can )
+			continue;
+
+		// records as columns: time, then the components of the conditions
+		nread++;
+		rd.prefetch(bs.first, bs.nrec, s);
+		int n = readBlock(rd, s, bs.first, bs.nrec, rows, 0, needprev);
+		if( n<=0 )
+			continue;
+		int ncol = 1;
+		for( size_t j=0; j<cond.size(); j++ )
+			ncol += cond[j].count;
+		col.resize((size_t)ncol*(n+1));
+		for( int r=0; r<=n; r++ )
+		{
+			const float* rec = rows.data() + (size_t)r*recsz;
+			col[r] = rec[0];
+			for( size_t j=0, k=1; j<cond.size(); k+=cond[j].count, j++ )
+				for( int i=0; i<cond[j].count; i++ )
+					col[(k+i)*(n+1) + r] = rec[off[j]+i];
+		}
+
+		// all conditions, column by column
+		mask.assign(n, 1);
+		val.resize(n);
+		for( size_t j=0, k=1; j<cond.size(); k+=cond[j].count, j++ )
+		{
+			x.resize(cond[j].count);
+			for( int i=0; i<cond[j].count; i++ )
+				x[i] = col.data() + (k+i)*(n+1);
+			evalTerm(cond[j], col.data(), x.data(), n, val.data());
+			applyOp(cond[j], val.data(), n, mask.data());
+		}
+
+		// matching records as ranges, continued across blocks
+		for( int r=0; r<n; r++ )
+			if( mask[r] )
+			{
+				long long i = bs.first + r;
+				if( !events.empty() && events.back().last==i-1 )
+				{
+					events.back().last = i;
+					events.back().t1 = col[r+1];
+				}
+				else
+				{
+					mjlEvent e = {i, i, col[r+1], col[r+1]};
+					events.push_back(e);
+				}
+				nmatch++;
+			}
+	}
+
+	if( info )
+	{
+		info->stream = s;
+		info->nblock = (long long)ss.block.size();
+		info->nread = nread;
+		info->nmatch = nmatch;
+		info->built = built;
+	}
+	return true;
+}
+
+
+
+// file name without the directory
+static const char* baseName(const char* name)
+{
+	const char* p = name + strlen(name);
+	while( p>name && p[-1]!='/' && p[-1]!='\\' )
+		p--;
+	return p;
+}
+
+
+
+// events of logfile in a search result
+bool mjl_readEvents(const char* filename, const char* logfile, std::vector<mjlEvent>& events)
+{
+	events.clear();
+	FILE* fp = fopen(filename, "r");
+	if( !fp )
+		return false;
+
+	// lines: log <tab> first <tab> last <tab> t0 <tab> t1; '#': comments
+	char line[4096];
+	while( fgets(line, sizeof(line), fp) )
+	{
+		char* tab = strchr(line, '\t');
+		if( line[0]=='#' || !tab )
+			continue;
+		*tab = 0;
+
+		mjlEvent e;
+		if( !strcmp(baseName(line), baseName(logfile)) &&
+			sscanf(tab+1, "%lld %lld %f %f", &e.first, &e.last, &e.t0, &e.t1)==4 )
+			events.push_back(e);
+	}
+
+	fclose(fp);
+	return true;
+}
@@ -0,0 +1,121 @@
+//---------------------------------//
+//  Event search in puppet logs    //
+//  (.mjl / .mjc, see mjlog.h)     //
+//---------------------------------//
+
+#pragma once
+
+#include "mjlog.h"
+
+#include <vector>
+
+
+//------------------------- Conditions --------------------------------------------------
+//
+// A query is a list of conditions joined by "&&", each a term compared with a number:
+//
+//   ctrl[3] >= 0.99 && speed(mocap_pos[0:3]) > 0.5
+//
+// Terms: field[i] (the value), abs(field[i]), rate(field[i]) (change per second since
+// the previous record), norm(field[i:j]) and speed(field[i:j]) (norm of the values or
+// of the rates of components i..j-1). Fields are named as in log schemas; raw fields
+// cannot be queried. All the fields of a query must be in one stream of the log.
+
+typedef enum _mjlTerm
+{
+	mjlTERM_VALUE = 0,
+	mjlTERM_ABS,
+	mjlTERM_RATE,
+	mjlTERM_NORM,
+	mjlTERM_SPEED
+} mjlTerm;
+
+typedef enum _mjlOp
+{
+	mjlOP_LT = 0,
+	mjlOP_LE,
+	mjlOP_GT,
+	mjlOP_GE,
+	mjlOP_EQ,
+	mjlOP_NE
+} mjlOp;
+
+typedef struct _mjlCondition
+{
+	int term;							// mjlTerm
+	int field;							// mjlField
+	int first;							// first component
+	int count;							// components (1 unless norm/speed)
+	int op;								// mjlOp
+	float value;						// compared with
+} mjlCondition;
+
+// parse a query; false (with a message) on error
+bool mjl_parseQuery(const char* text, std::vector<mjlCondition>& cond);
+
+
+//------------------------- Search ------------------------------------------------------
+//
+// Records are searched block by block: a block is a chunk of a .mjc stream, or
+// mjlQBLOCK records of a .mjl file. The statistics of each block (min, max and
+// largest |rate| of every float of the record) are kept next to the log in
+// <log>.mjs; they are built by one pass over the log the first time it is searched,
+// and rebuilt when the log has changed: its size, modification time or the CRC of
+// its header and chunk index (.mjl: last record) differ. Each condition bounds its term over a block
+// from these statistics, so blocks that cannot match are skipped without being read
+// or decoded. The other blocks are copied into columns and every condition is
+// evaluated as a loop over whole columns.
+//
+// .mjs file: mjlStatsHeader, then for each stream: int recsz, long long nrec,
+// long long nblock, and nblock x { mjlBlockStats, float min[recsz], max[recsz],
+// rate[recsz] }.
+
+#define mjlMAGIC_STATS		0x534A4D4D		// "MMJS"
+#define mjlSTATS_VERSION	2
+#define mjlQBLOCK			256
+
+typedef struct _mjlStatsHeader
+{
+	int magic;							// mjlMAGIC_STATS
+	int version;						// mjlSTATS_VERSION
+	long long filesz;					// size of the log the statistics were built from
+	long long dataEnd;					// end of its last complete record/chunk
+	long long mtime;					// its modification time (sec since 1970)
+	int nstream;						// streams in the log
+	int block;							// records per block (.mjl), 0 for .mjc (chunks)
+	unsigned int crc;					// CRC-32C of its header, index (.mjl: last record)
+} mjlStatsHeader;
+
+typedef struct _mjlBlockStats
+{
+	long long first;					// first record of the block (counted in its stream)
+	int nrec;							// records in the block
+	int ok;								// 0: corrupt (never matches)
+} mjlBlockStats;
+
+typedef struct _mjlEvent
+{
+	long long first;					// first matching record (counted in its stream)
+	long long last;						// last matching record
+	float t0;							// time of first
+	float t1;							// time of last
+} mjlEvent;
+
+typedef struct _mjlQueryInfo
+{
+	int stream;							// stream searched
+	long long nblock;					// blocks in the stream
+	long long nread;					// blocks read (the others were skipped)
+	long long nmatch;					// matching records
+	bool built;							// statistics (re)built by this search
+} mjlQueryInfo;
+
+// records of a log matching all conditions, as ranges in time order; false (with a
+// message) on error
+bool mjl_query(const char* filename, const std::vector<mjlCondition>& cond,
+			   std::vector<mjlEvent>& events, mjlQueryInfo* info = 0);
+
+// events of logfile in a search result ('mjltool query' output: lines of other logs
+// are skipped, logs are matched by file name without the directory); false if the
+// result cannot be read
+bool mjl_readEvents(const char* filename, const char* logfile, std::vector<mjlEvent>& events);
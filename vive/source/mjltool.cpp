@@ -0,0 +1,832 @@
+//---------------------------------//
+//  Log utility for puppet logs    //
+//  (.mjl and chunked .mjc)        //
+//---------------------------------//
+
+#include "mjlog.h"
+#include "mjlquery.h"
+#include "mjlcatalog.h"
+#include "timing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#ifdef _WIN32
+	#include <io.h>
+	#include <direct.h>
+	#define mjl_truncate(fp, sz) _chsize_s(_fileno(fp), sz)
+	#define mjl_fseek _fseeki64
+	#define mjl_mkdir(name) _mkdir(name)
+#else
+	#include <unistd.h>
+	#include <dirent.h>
+	#include <sys/stat.h>
+	#define mjl_truncate(fp, sz) ftruncate(fileno(fp), sz)
+	#define mjl_fseek fseeko
+	#define mjl_mkdir(name) mkdir(name, 0755)
+#endif
+
+
+// Instructions
+const char* help =
+	"-----------------------------------------------------------------\n"
+	"mjltool: inspect and convert puppet logs (.mjl / .mjc)\n"
+	"Usage:\t mjltool info logfile\n"
+	"\t mjltool convert infile outfile [chunk]\n"
+	"\t mjltool index logfile.mjc\n"
+	"\t mjltool repair logfile\n"
+	"\t mjltool columns outdir logfile [logfile ...]\n"
+	"\t mjltool query \"conditions\" logfile [logfile ...]\n"
+	"\t mjltool catalog catalogfile [directory ...]\n"
+	"Note:\t outfile ending in .mjc is chunked/compressed (default chunk 256)\n"
+	"\t index rebuilds the seek index of a .mjc file without one\n"
+	"\t repair keeps every intact record/chunk of a crashed log (in place)\n"
+	"\t columns writes one .npy file per field to outdir/<log name>_<ext>/\n"
+	"\t (_2, _3 ... for logs of the same name; one subdirectory per stream\n"
+	"\t if there are several), logs in parallel\n"
+	"\t query prints the record ranges matching all conditions, e.g.\n"
+	"\t   \"ctrl[3] >= 0.99 && speed(mocap_pos[0:3]) > 0.5\"\n"
+	"\t (terms: field[i], abs(), rate(), norm(field[i:j]), speed(field[i:j]));\n"
+	"\t logs in parallel, block statistics cached in <log>.mjs, the output\n"
+	"\t is an events file for playlog\n"
+	"\t catalog adds the logs in the directories (and below) to catalogfile,\n"
+	"\t rereading only new or changed logs, and lists it; playlog opens\n"
+	"\t session N of a catalog with: playlog catalogfile N\n"
+	"-----------------------------------------------------------------\n\n";
+
+
+// does name end with ext
+static bool hasExt(const char* name, const char* ext)
+{
+	size_t n = strlen(name), e = strlen(ext);
+	return (n>=e && !strcmp(name+n-e, ext));
+}
+
+
+
+// stream description: fields (session fields with their size) and decimation
+static void printStream(const mjlStream& st)
+{
+	for( int i=0; i<st.nfield; i++ )
+		if( st.field[i]<mjlNDATAFIELD )
+			printf("%s%s", i ? "," : "", mjlFIELDNAME[st.field[i]]);
+		else
+			printf("%s%s[%d]", i ? "," : "", mjlFIELDNAME[st.field[i]], st.size[i]);
+	if( st.decimation )
+		printf("/%d", st.decimation);
+	else
+		printf(" (events)");
+}
+
+
+
+// print header and size information
+static int info(const char* filename)
+{
+	mjlReader log;
+	if( !log.open(filename) )
+		return 1;
+
+	const int* sz = log.getSizes();
+	long long raw = 0;
+	for( int s=0; s<log.getNStream(); s++ )
+		raw += (long long)sizeof(float)*log.getRecsz(s)*log.getNRecord(s);
+	if( log.isChunked() )
+		printf("file        : %s (chunked .mjc, version %d)\n", filename, log.getVersion());
+	else
+		printf("file        : %s (.mjl)\n", filename);
+	printf("sizes       : nq %d  nv %d  nu %d  nmocap %d  nsensordata %d  nuserdata %d\n",
+		sz[0], sz[1], sz[2], sz[3], sz[4], sz[5]);
+	if( log.isChunked() )
+		printf("chunks      : %lld (index %s)\n", log.getNChunk(),
+			log.hasIndex() ? "stored" : "missing, rebuilt by scanning");
+	printf("file size   : %.2f MB (records %.2f MB, ratio %.2fx)\n",
+		1e-6*(double)log.getFileSize(), 1e-6*(double)raw,
+		log.getFileSize()>0 ? (double)raw/(double)log.getFileSize() : 0.0);
+
+	// streams
+	for( int s=0; s<log.getNStream(); s++ )
+	{
+		long long n = log.getNRecord(s);
+		printf("stream %-4d : ", s);
+		printStream(log.getStream(s));
+		printf(", %lld records of %d floats", n, log.getRecsz(s));
+		const float* first = (n ? log.record(0, s) : 0);
+		double t0 = first ? first[0] : 0;
+		const float* last = (n ? log.record(n-1, s) : 0);
+		double t1 = last ? last[0] : 0;
+		if( n )
+			printf(", time %.4f to %.4f (%.2f sec)", t0, t1, t1-t0);
+		printf("\n");
+	}
+	return 0;
+}
+
+
+
+// convert between .mjl and .mjc, report compression and codec speed
+static int convert(const char* infile, const char* outfile, int chunk)
+{
+	mjlReader in;
+	if( !in.open(infile) )
+		return 1;
+
+	// .mjl header from the input
+	const int* sz = in.getSizes();
+	std::vector<char> header(7*sizeof(int) + sz[6]);
+	memcpy(header.data(), sz, 7*sizeof(int));
+	memcpy(header.data()+7*sizeof(int), in.getNames(), sz[6]);
+
+	// same streams; .mjl only holds one stream with all fields
+	int nstream = in.getNStream();
+	std::vector<mjlStream> streams;
+	for( int s=0; s<nstream; s++ )
+		streams.push_back(in.getStream(s));
+	bool chunked = hasExt(outfile, ".mjc");
+	mjlStream all = mjl_defaultStream();
+	if( !chunked && (nstream>1 || streams[0].nfield!=all.nfield) )
+	{
+		printf("%s has several streams or a subset of fields; convert it to .mjc\n", infile);
+		return 1;
+	}
+
+	mjlWriter out;
+	bool ok = (chunked ? out.open(outfile, header.data(), (int)header.size(), streams, 4096, chunk) :
+						 out.open(outfile, header.data(), (int)header.size(), in.getRecsz(), 4096, 0));
+	if( !ok )
+		return 1;
+
+	// copy all records in time order, streams interleaved (lossless: wait for ring space)
+	long long t0 = mjTimeNS();
+	std::vector<long long> next(nstream, 0);
+	long long nraw = 0;
+	while( true )
+	{
+		// stream with the earliest next record
+		int best = -1;
+		const float* rec = 0;
+		for( int s=0; s<nstream; s++ )
+		{
+			if( next[s]>=in.getNRecord(s) )
+				continue;
+			const float* r = in.record(next[s], s);
+			if( !r )
+			{
+				printf("Corrupt record %lld in stream %d, skipping the rest of the stream\n", next[s], s);
+				next[s] = in.getNRecord(s);
+				continue;
+			}
+			if( best<0 || r[0]<rec[0] )
+			{
+				best = s;
+				rec = r;
+			}
+		}
+		if( best<0 )
+			break;
+
+		float* slot = out.acquire(true, best);
+		memcpy(slot, rec, sizeof(float)*in.getRecsz(best));
+		out.commit();
+		nraw += sizeof(float)*in.getRecsz(best);
+		next[best]++;
+	}
+	out.close();
+	double sec = 1e-9*(double)(mjTimeNS()-t0);
+
+	// report
+	long long outsz = out.getNBytes();
+	long long tmEncode = out.getTmEncode();
+	printf("%s (%.2f MB) -> %s (%.2f MB): ratio %.2fx, %.2f sec\n",
+		infile, 1e-6*(double)in.getFileSize(), outfile, 1e-6*(double)outsz,
+		outsz>0 ? (double)in.getFileSize()/(double)outsz : 0.0, sec);
+	if( in.isChunked() && in.getTmDecode()>0 )
+		printf("decode: %.2f GB/s\n", (double)nraw/(double)in.getTmDecode());
+	if( tmEncode>0 )
+		printf("encode: %.2f GB/s\n", (double)nraw/(double)tmEncode);
+	return 0;
+}
+
+
+
+// truncate a log at end and, for .mjc, write the index trailer there
+static bool writeTail(const char* filename, const std::vector<mjlIndexEntry>* idx,
+					  long long nrec, long long end, int version)
+{
+	FILE* fp = fopen(filename, "r+b");
+	if( !fp )
+	{
+		printf("Could not open %s for writing\n", filename);
+		return false;
+	}
+
+	long long n = 0;
+	bool ok = true;
+	if( idx )
+	{
+		mjl_fseek(fp, end, SEEK_SET);
+		n = mjl_writeIndex(fp, *idx, nrec, version);
+		ok = (n==(long long)((version>=3 ? sizeof(mjlIndexEntry) : mjlINDEXENTRY_V2)*idx->size() +
+							 sizeof(mjlIndexFooter)));
+	}
+	fflush(fp);
+	ok = ok && !mjl_truncate(fp, end+n);
+	fclose(fp);
+
+	if( !ok )
+		printf("Could not write %s\n", filename);
+	return ok;
+}
+
+
+
+// append the index trailer to a .mjc file without one (drops any partial chunk)
+static int addIndex(const char* filename)
+{
+	mjlReader log;
+	if( !log.open(filename) )
+		return 1;
+	if( !log.isChunked() )
+	{
+		printf("%s is not a chunked log; .mjl records are at fixed offsets\n", filename);
+		return 1;
+	}
+	if( log.hasIndex() )
+	{
+		printf("%s already has an index (%lld chunks)\n", filename, log.getNChunk());
+		return 0;
+	}
+	std::vector<mjlIndexEntry> idx = log.getIndex();
+	long long nrec = 0;
+	for( int s=0; s<log.getNStream(); s++ )
+		nrec += log.getNRecord(s);
+	long long end = log.getDataEnd();
+	int version = log.getVersion();
+	log.close();
+
+	if( !writeTail(filename, &idx, nrec, end, version) )
+		return 1;
+
+	printf("%s: indexed %lld chunks, %lld records\n", filename, (long long)idx.size(), nrec);
+	return 0;
+}
+
+
+
+// check every chunk, cut the file after the last complete record/chunk, reindex
+static int repair(const char* filename)
+{
+	mjlReader log;
+	if( !log.open(filename) )
+		return 1;
+
+	// .mjl: drop a partial last record
+	if( !log.isChunked() )
+	{
+		long long end = log.getDataEnd(), nrec = log.getNRecord();
+		bool cut = (end!=log.getFileSize());
+		log.close();
+		if( cut && !writeTail(filename, 0, nrec, end, 0) )
+			return 1;
+		printf("%s: %lld records%s\n", filename, nrec, cut ? ", partial record removed" : ", nothing to repair");
+		return 0;
+	}
+
+	// .mjc: keep chunks that pass the check, renumber their records within each stream
+	const std::vector<mjlIndexEntry>& all = log.getIndex();
+	std::vector<mjlIndexEntry> idx;
+	std::vector<long long> snrec(log.getNStream(), 0);
+	long long nrec = 0, ndrop = 0, nlost = 0;
+	int version = log.getVersion();
+	for( long long c=0; c<(long long)all.size(); c++ )
+	{
+		long long n = all[c].nrec;
+		if( !log.checkChunk(c) || (version<2 && !log.record(all[c].first)) )
+		{
+			ndrop++;
+			nlost += n;
+			continue;
+		}
+
+		mjlIndexEntry e = all[c];
+		e.first = snrec[e.stream];
+		idx.push_back(e);
+		snrec[e.stream] += n;
+		nrec += n;
+	}
+
+	// cut after the last good chunk (damaged chunks before it stay in the file, unindexed)
+	long long end = (all.empty() ? log.getDataEnd() : all[0].offset);
+	for( size_t c=0; c<all.size() && !idx.empty(); c++ )
+		if( all[c].offset==idx.back().offset )
+			end = (c+1<all.size() ? all[c+1].offset : log.getDataEnd());
+	bool clean = log.hasIndex() && !ndrop;
+	log.close();
+
+	if( clean )
+	{
+		printf("%s: %lld chunks, %lld records, nothing to repair\n", filename, (long long)idx.size(), nrec);
+		return 0;
+	}
+	if( !writeTail(filename, &idx, nrec, end, version) )
+		return 1;
+
+	printf("%s: kept %lld chunks (%lld records), dropped %lld damaged chunks (%lld records)\n",
+		filename, (long long)idx.size(), nrec, ndrop, nlost);
+	return 0;
+}
+
+
+
+//------------------------- Column export -----------------------------------------------
+//
+// Each field of a stream becomes a .npy file (numpy format 1.0, little endian, C
+// order) holding an nrec x size array (time: a vector; raw fields: doubles), so
+// analysis code can np.load(mmap_mode='r') just the columns it needs. Records are
+// copied in blocks: memory per log is one block per column plus the reader's
+// prefetch window, whatever the log size. Every log gets a directory of its own,
+// named before the export starts: the file name with its extension (x.log -> x_log),
+// and a suffix for logs of the same name from different directories.
+
+static const int mjlCOLBLOCK = 4096;		// records per block
+static const int mjlNPYHEADER = 128;		// .npy header size, rewritten with the shape
+
+
+// write the .npy header of an nrec x ncol array, ncol<0: vector (padded to mjlNPYHEADER bytes)
+static bool npyHeader(FILE* fp, bool dbl, long long nrec, int ncol)
+{
+	char dict[mjlNPYHEADER], shape[40];
+	if( ncol<0 )
+		snprintf(shape, sizeof(shape), "(%lld,)", nrec);
+	else
+		snprintf(shape, sizeof(shape), "(%lld, %d)", nrec, ncol);
+	int n = snprintf(dict, sizeof(dict), "{'descr': '<%s', 'fortran_order': False, 'shape': %s, }",
+					 dbl ? "f8" : "f4", shape);
+	int len = mjlNPYHEADER - 10;
+	if( n<0 || n>=len )
+		return false;
+	memset(dict+n, ' ', len-n-1);
+	dict[len-1] = '\n';
+
+	unsigned char pre[10] = {0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0,
+							 (unsigned char)(len & 0xFF), (unsigned char)(len >> 8)};
+	return mjl_fseek(fp, 0, SEEK_SET)==0 && fwrite(pre, 1, 10, fp)==10 &&
+		   fwrite(dict, 1, len, fp)==(size_t)len;
+}
+
+
+
+// one output column: a field of a stream
+struct Column
+{
+	std::string name;				// file name
+	int offset;						// position in the record (floats)
+	int size;						// floats per record
+	bool raw;						// exact doubles: written as f8, size/2 per record
+	FILE* fp;
+	std::vector<float> block;		// buffered records of this column
+};
+
+
+
+// output directory name of a log: file name with the extension, x.log -> x_log
+static std::string columnDir(const char* filename)
+{
+	std::string base(filename);
+	size_t slash = base.find_last_of("/\\");
+	if( slash!=std::string::npos )
+		base = base.substr(slash+1);
+	size_t dot = base.find_last_of('.');
+	if( dot!=std::string::npos && dot>0 )
+		base[dot] = '_';
+	return base;
+}
+
+
+
+// same name, ignoring case (Windows file names)
+static bool sameNoCase(const std::string& a, const std::string& b)
+{
+	if( a.size()!=b.size() )
+		return false;
+	for( size_t i=0; i<a.size(); i++ )
+		if( tolower((unsigned char)a[i])!=tolower((unsigned char)b[i]) )
+			return false;
+	return true;
+}
+
+
+
+// export the streams of one log to dir; false on error
+static bool exportColumns(const std::string& dir, const char* filename)
+{
+	mjlReader log;
+	if( !log.open(filename) )
+		return false;
+	mjl_mkdir(dir.c_str());
+
+	bool ok = true;
+	long long nbytes = 0;
+	for( int s=0; s<log.getNStream() && ok; s++ )
+	{
+		std::string sdir = dir;
+		if( log.getNStream()>1 )
+		{
+			char sname[20];
+			sprintf(sname, "/stream%d", s);
+			sdir += sname;
+			mjl_mkdir(sdir.c_str());
+		}
+
+		// columns: time, then the fields in record order
+		const mjlStream& st = log.getStream(s);
+		std::vector<Column> col(st.nfield+1);
+		col[0].name = "time";
+		col[0].offset = 0;
+		col[0].size = 1;
+		col[0].raw = false;
+		for( int i=0; i<st.nfield; i++ )
+		{
+			col[i+1].name = mjlFIELDNAME[st.field[i]];
+			col[i+1].offset = col[i].offset + col[i].size;
+			col[i+1].size = st.size[i];
+			col[i+1].raw = (st.field[i]==mjlFIELD_INPUT || st.field[i]==mjlFIELD_RESET);
+		}
+		for( size_t c=0; c<col.size(); c++ )
+		{
+			std::string fname = sdir + "/" + col[c].name + ".npy";
+			col[c].fp = fopen(fname.c_str(), "wb");
+			col[c].block.resize((size_t)mjlCOLBLOCK*col[c].size);
+			if( !col[c].fp || !npyHeader(col[c].fp, col[c].raw, 0, 0) )
+			{
+				printf("Could not create %s\n", fname.c_str());
+				ok = false;
+			}
+		}
+
+		// copy records in blocks; a corrupt chunk ends the stream
+		long long nrec = log.getNRecord(s), ahead = 2*mjlCOLBLOCK, n = 0;
+		while( ok && n<nrec )
+		{
+			int nb = (int)(nrec-n<mjlCOLBLOCK ? nrec-n : mjlCOLBLOCK), b;
+			log.prefetch(n, ahead, s);
+			for( b=0; b<nb; b++ )
+			{
+				const float* rec = log.record(n+b, s);
+				if( !rec )
+				{
+					printf("%s: corrupt record %lld in stream %d, exporting the %lld records before it\n",
+						filename, n+b, s, n+b);
+					nrec = n+b;
+					break;
+				}
+				for( size_t c=0; c<col.size(); c++ )
+					memcpy(col[c].block.data() + (size_t)b*col[c].size, rec + col[c].offset,
+						   sizeof(float)*col[c].size);
+			}
+			for( size_t c=0; c<col.size() && ok; c++ )
+				ok = (!col[c].size || fwrite(col[c].block.data(), sizeof(float)*col[c].size, b, col[c].fp)==(size_t)b);
+			n += b;
+		}
+
+		// shape known now: rewrite the headers
+		for( size_t c=0; c<col.size(); c++ )
+			if( col[c].fp )
+			{
+				ok = ok && npyHeader(col[c].fp, col[c].raw, n, c==0 ? -1 : col[c].raw ? col[c].size/2 : col[c].size);
+				ok = (fclose(col[c].fp)==0) && ok;
+				nbytes += sizeof(float)*col[c].size*n;
+			}
+		if( !ok )
+			printf("Could not write columns of %s\n", filename);
+	}
+
+	if( ok )
+		printf("%s -> %s (%d stream%s, %.2f MB)\n", filename, dir.c_str(), log.getNStream(),
+			log.getNStream()>1 ? "s" : "", 1e-6*(double)nbytes);
+	return ok;
+}
+
+
+
+// export many logs, one per thread at a time
+static int columns(const char* outdir, int nfile, char** files)
+{
+	mjl_mkdir(outdir);
+
+	// unique directories, chosen before any thread writes
+	std::vector<std::string> dirs(nfile);
+	for( int i=0; i<nfile; i++ )
+	{
+		std::string base = columnDir(files[i]), name = base;
+		for( int k=2; ; k++ )
+		{
+			bool taken = false;
+			for( int j=0; j<i && !taken; j++ )
+				taken = sameNoCase(dirs[j], std::string(outdir) + "/" + name);
+			if( !taken )
+				break;
+			name = base + "_" + std::to_string(k);
+		}
+		dirs[i] = std::string(outdir) + "/" + name;
+	}
+
+	std::atomic<int> next(0), nfail(0);
+	int nthread = (int)std::thread::hardware_concurrency();
+	nthread = (nthread<1 ? 1 : nthread>nfile ? nfile : nthread);
+	std::vector<std::thread> pool;
+	long long t0 = mjTimeNS();
+	for( int t=0; t<nthread; t++ )
+		pool.push_back(std::thread([&]()
+		{
+			int i;
+			while( (i = next++)<nfile )
+				if( !exportColumns(dirs[i], files[i]) )
+					nfail++;
+		}));
+	for( int t=0; t<nthread; t++ )
+		pool[t].join();
+
+	printf("%d logs exported (%d failed), %d threads, %.2f sec\n", nfile-nfail, (int)nfail,
+		nthread, 1e-9*(double)(mjTimeNS()-t0));
+	return (nfail ? 1 : 0);
+}
+
+
+
+//------------------------- Event search ------------------------------------------------
+//
+// The conditions are parsed once and the logs searched in parallel, one per thread
+// at a time (see mjlquery.h). Results are printed in command line order, one line
+// per range of matching records: log, first, last, t0, t1 (tab separated); lines
+// starting with '#' are comments. playlog reads this as an events file.
+
+static int query(const char* text, int nfile, char** files)
+{
+	std::vector<mjlCondition> cond;
+	if( !mjl_parseQuery(text, cond) )
+		return 1;
+
+	std::vector<std::string> out(nfile);
+	std::atomic<int> next(0), nfail(0);
+	std::atomic<long long> nrange(0);
+	int nthread = (int)std::thread::hardware_concurrency();
+	nthread = (nthread<1 ? 1 : nthread>nfile ? nfile : nthread);
+	std::vector<std::thread> pool;
+	long long t0 = mjTimeNS();
+	for( int t=0; t<nthread; t++ )
+		pool.push_back(std::thread([&]()
+		{
+			int i;
+			std::vector<mjlEvent> events;
+			mjlQueryInfo info;
+			char line[1000];
+			while( (i = next++)<nfile )
+			{
+				if( !mjl_query(files[i], cond, events, &info) )
+				{
+					nfail++;
+					continue;
+				}
+				for( size_t e=0; e<events.size(); e++ )
+				{
+					snprintf(line, sizeof(line), "%s\t%lld\t%lld\t%.9g\t%.9g\n", files[i],
+						events[e].first, events[e].last, events[e].t0, events[e].t1);
+					out[i] += line;
+				}
+				snprintf(line, sizeof(line), "# %s: %d ranges, %lld records (stream %d, %lld of %lld blocks read%s)\n",
+					files[i], (int)events.size(), info.nmatch, info.stream, info.nread, info.nblock,
+					info.built ? ", statistics built" : "");
+				out[i] += line;
+				nrange += (long long)events.size();
+			}
+		}));
+	for( int t=0; t<nthread; t++ )
+		pool[t].join();
+
+	printf("# query: %s\n", text);
+	for( int i=0; i<nfile; i++ )
+		printf("%s", out[i].c_str());
+	printf("# %d logs searched (%d failed), %lld ranges, %d threads, %.2f sec\n", nfile-nfail,
+		(int)nfail, (long long)nrange, nthread, 1e-9*(double)(mjTimeNS()-t0));
+	return (nfail ? 1 : 0);
+}
+
+
+
+//------------------------- Catalog -----------------------------------------------------
+//
+// The directories are walked first (names only), then the logs that are new or whose
+// size or modification time changed are read in parallel, one per thread at a time;
+// the others keep their entry. Entries of logs that no longer exist are dropped.
+
+// does name end with ext, ignoring case
+static bool hasExtNoCase(const char* name, const char* ext)
+{
+	size_t n = strlen(name), e = strlen(ext);
+	if( n<e )
+		return false;
+	for( size_t i=0; i<e; i++ )
+		if( tolower((unsigned char)name[n-e+i])!=ext[i] )
+			return false;
+	return true;
+}
+
+
+
+// log files (.log, .mjl, .mjc) in dir and its subdirectories
+static void findLogs(const std::string& dir, std::vector<std::string>& logs)
+{
+	std::vector<std::string> names, subdirs;
+#ifdef _WIN32
+	struct __finddata64_t fd;
+	intptr_t h = _findfirst64((dir + "/*").c_str(), &fd);
+	if( h==-1 )
+		return;
+	do
+	{
+		if( fd.attrib & _A_SUBDIR )
+		{
+			if( strcmp(fd.name, ".") && strcmp(fd.name, "..") )
+				subdirs.push_back(dir + "/" + fd.name);
+		}
+		else
+			names.push_back(fd.name);
+	}
+	while( _findnext64(h, &fd)==0 );
+	_findclose(h);
+#else
+	DIR* dp = opendir(dir.c_str());
+	if( !dp )
+		return;
+	struct dirent* de;
+	while( (de = readdir(dp)) )
+	{
+		if( !strcmp(de->d_name, ".") || !strcmp(de->d_name, "..") )
+			continue;
+		struct stat st;
+		std::string path = dir + "/" + de->d_name;
+		if( !stat(path.c_str(), &st) && S_ISDIR(st.st_mode) )
+			subdirs.push_back(path);
+		else
+			names.push_back(de->d_name);
+	}
+	closedir(dp);
+#endif
+
+	for( size_t i=0; i<names.size(); i++ )
+		if( hasExtNoCase(names[i].c_str(), ".log") || hasExtNoCase(names[i].c_str(), ".mjl") ||
+			hasExtNoCase(names[i].c_str(), ".mjc") )
+			logs.push_back(dir + "/" + names[i]);
+	for( size_t i=0; i<subdirs.size(); i++ )
+		findLogs(subdirs[i], logs);
+}
+
+
+
+// print the entries of a catalog
+static void listCatalog(const std::vector<mjlCatalogEntry>& entries)
+{
+	printf("%5s  %-16s %8s  %-12s %9s %10s  %8s %5s  %s\n", "#", "model", "xml crc", "nq/nv/nu/mc",
+		   "records", "duration", "MB", "thumb", "log");
+	for( size_t i=0; i<entries.size(); i++ )
+	{
+		const mjlCatalogEntry& e = entries[i];
+		char sizes[50];
+		snprintf(sizes, sizeof(sizes), "%d/%d/%d/%d", e.sizes[0], e.sizes[1], e.sizes[2], e.sizes[3]);
+		printf("%5d  %-16.16s %08x  %-12s %9lld %9.1fs  %8.2f %5s  %s\n", (int)i, e.model, e.hash,
+			   sizes, e.nrec, e.t1-e.t0, 1e-6*(double)e.filesz, e.thumb ? "yes" : "-", e.path);
+	}
+}
+
+
+
+// update the catalog from the logs in the directories, list it
+static int catalog(const char* filename, int ndir, char** dirs)
+{
+	std::vector<mjlCatalogEntry> entries;
+	bool exists = mjl_readCatalog(filename, entries);
+	if( !ndir )
+	{
+		if( !exists )
+		{
+			printf("Could not read catalog %s\n", filename);
+			return 1;
+		}
+		listCatalog(entries);
+		return 0;
+	}
+
+	// logs on disk by full path (no trailing separator, the root becomes "")
+	long long t0 = mjTimeNS();
+	std::vector<std::string> logs;
+	for( int i=0; i<ndir; i++ )
+	{
+		std::string dir = mjl_fullPath(dirs[i]);
+		while( !dir.empty() && (dir[dir.size()-1]=='/' || dir[dir.size()-1]=='\\') )
+			dir.erase(dir.size()-1);
+		findLogs(dir, logs);
+	}
+
+	// entries of logs that still exist, once per full path (older catalogs may hold
+	// relative paths and several spellings of one log); unchanged ones are kept
+	std::vector<mjlCatalogEntry> keep;
+	for( size_t i=0; i<entries.size(); i++ )
+	{
+		long long size, mtime;
+		if( !mjl_fileInfo(entries[i].path, &size, &mtime) )
+			continue;
+		std::string full = mjl_fullPath(entries[i].path);
+		if( full.size()>=sizeof(entries[i].path) )
+			continue;
+		strcpy(entries[i].path, full.c_str());
+		bool dup = false;
+		for( size_t k=0; k<keep.size() && !dup; k++ )
+			dup = !strcmp(keep[k].path, entries[i].path);
+		if( !dup )
+			keep.push_back(entries[i]);
+	}
+	std::vector<std::string> todo;
+	for( size_t i=0; i<logs.size(); i++ )
+	{
+		long long size = -1, mtime = -1;
+		mjl_fileInfo(logs[i].c_str(), &size, &mtime);
+		bool known = false;
+		for( size_t k=0; k<keep.size() && !known; k++ )
+			if( !strcmp(keep[k].path, logs[i].c_str()) )
+			{
+				known = (keep[k].filesz==size && keep[k].mtime==mtime);
+				if( !known )
+					keep.erase(keep.begin()+k);
+				break;
+			}
+		if( !known )
+			todo.push_back(logs[i]);
+	}
+
+	// read the new and changed logs in parallel
+	int nfile = (int)todo.size();
+	std::vector<mjlCatalogEntry> added(nfile);
+	std::vector<char> ok(nfile, 0);
+	std::atomic<int> next(0);
+	int nthread = (int)std::thread::hardware_concurrency();
+	nthread = (nthread<1 || nfile<1 ? 1 : nthread>nfile ? nfile : nthread);
+	std::vector<std::thread> pool;
+	for( int t=0; t<nthread; t++ )
+		pool.push_back(std::thread([&]()
+		{
+			int i;
+			while( (i = next++)<nfile )
+				ok[i] = mjl_catalogLog(todo[i].c_str(), added[i]);
+		}));
+	for( int t=0; t<nthread; t++ )
+		pool[t].join();
+
+	int nadded = 0;
+	for( int i=0; i<nfile; i++ )
+		if( ok[i] )
+		{
+			keep.push_back(added[i]);
+			nadded++;
+		}
+	if( !mjl_writeCatalog(filename, keep) )
+	{
+		printf("Could not write catalog %s\n", filename);
+		return 1;
+	}
+
+	listCatalog(keep);
+	printf("%s: %d logs (%d read, %d unchanged, %d failed), %d threads, %.2f sec\n", filename,
+		(int)keep.size(), nadded, (int)keep.size()-nadded, nfile-nadded, nthread,
+		1e-9*(double)(mjTimeNS()-t0));
+	return (nadded<nfile ? 1 : 0);
+}
+
+
+
+int main(int argc, char** argv)
+{
+	if( argc==3 && !strcmp(argv[1], "info") )
+		return info(argv[2]);
+	else if( (argc==4 || argc==5) && !strcmp(argv[1], "convert") )
+		return convert(argv[2], argv[3], argc==5 ? atoi(argv[4]) : 256);
+	else if( argc==3 && !strcmp(argv[1], "index") )
+		return addIndex(argv[2]);
+	else if( argc==3 && !strcmp(argv[1], "repair") )
+		return repair(argv[2]);
+	else if( argc>=4 && !strcmp(argv[1], "columns") )
+		return columns(argv[2], argc-3, argv+3);
+	else if( argc>=4 && !strcmp(argv[1], "query") )
+		return query(argv[2], argc-3, argv+3);
+	else if( argc>=3 && !strcmp(argv[1], "catalog") )
+		return catalog(argv[2], argc-3, argv+3);
+
+	printf("%s", help);
+	return 1;
+}
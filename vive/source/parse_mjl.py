@@ -1,7 +1,9 @@
 DESC = '''
-Parse mujoco (.mjl) logs\n
+Parse mujoco (.mjl) and puppet chunked (.mjc) logs\n
 mjl format: http://www.mujoco.org/book/haptix.html#uiRecord
+mjc format: see mjlog.h
 '''
+import os
 import struct
 import numpy as np
 import matplotlib as mpl
@@ -59,13 +61,136 @@ def parse_mjl_logs(read_filename, skipamount):
                )
     return data
 
+# field names and sizes in record order (mjlField in mjlog.h), then session fields
+FIELDS = ['qpos', 'qvel', 'ctrl', 'mocap_pos', 'mocap_quat', 'sensordata', 'userdata',
+          'clock', 'controller', 'hmd', 'scene', 'glove', 'input', 'reset']
+RAW_FIELDS = ['input', 'reset']     # exact doubles
+def field_sizes(nq, nv, nu, nmocap, nsensordata, nuserdata):
+    return [nq, nv, nu, 3*nmocap, 4*nmocap, nsensordata, nuserdata]
+
+# decode one .mjc chunk (mjl_decode): zero-RLE, 4 byte planes, zigzag, linear prediction
+def decode_mjc_chunk(buf, nrec, recsz):
+    n = nrec*recsz
+    planes = np.empty(4*n, dtype=np.uint8)
+    i = o = 0
+    while i < len(buf):
+        c = buf[i]
+        i += 1
+        if c >= 128:
+            planes[o:o+c-127] = 0
+            o += c-127
+        else:
+            planes[o:o+c+1] = np.frombuffer(buf, np.uint8, c+1, i)
+            o += c+1
+            i += c+1
+    if o != 4*n:
+        raise ValueError('corrupt chunk')
+    planes = planes.reshape(4, recsz, nrec).astype(np.uint32)
+    x = planes[0] | (planes[1] << 8) | (planes[2] << 16) | (planes[3] << 24)
+    e = (x >> 1) ^ (np.uint32(0) - (x & 1))
+    # v[0] = e[0]; v[r]-v[r-1] = e[r] + v[r-1]-v[r-2] (wrapping uint32)
+    v = e.copy()
+    if nrec > 1:
+        d = np.cumsum(e[:, 1:], axis=1, dtype=np.uint32)
+        v[:, 1:] = e[:, :1] + np.cumsum(d, axis=1, dtype=np.uint32)
+    return v.T.copy().view(np.float32)
+
+# parse mjc chunked logs into python dictionary, one entry per stream in 'streams'
+def parse_mjc_logs(read_filename, skipamount):
+    with open(read_filename, mode='rb') as file:
+        fileContent = file.read()
+    magic, version, recsz, chunk, headersz = struct.unpack('iiiii', fileContent[:20])
+    if magic != 0x314A434D:
+        raise ValueError(read_filename + ' is not a .mjc log')
+    pos = 20 if version < 2 else 24
+    nq, nv, nu, nmocap, nsensordata, nuserdata, name_len = struct.unpack('iiiiiii', fileContent[pos:pos+28])
+    name = fileContent[pos+28:pos+28+name_len]
+    sizes = field_sizes(nq, nv, nu, nmocap, nsensordata, nuserdata)
+
+    # streams (version 3, field sizes from version 4), older logs: one stream with all fields
+    streams = [dict(decimation=1, fields=list(range(len(sizes))), sizes=sizes)]
+    if version >= 3:
+        p = pos+28+name_len
+        nstream = struct.unpack('i', fileContent[p:p+4])[0]
+        p += 4
+        streams = []
+        for s in range(nstream):
+            decimation, nfield = struct.unpack('ii', fileContent[p:p+8])
+            if version >= 4:
+                pairs = struct.unpack(str(2*nfield) + 'i', fileContent[p+8:p+8+8*nfield])
+                fields, fsizes = list(pairs[0::2]), list(pairs[1::2])
+                p += 8+8*nfield
+            else:
+                fields = list(struct.unpack(str(nfield) + 'i', fileContent[p+8:p+8+4*nfield]))
+                fsizes = [sizes[f] for f in fields]
+                p += 8+4*nfield
+            streams.append(dict(decimation=decimation, fields=fields, sizes=fsizes))
+    for st in streams:
+        st['recsz'] = 1 + sum(st['sizes'])
+        st['records'] = []
+
+    # chunks in file order, up to the index trailer or a torn tail
+    pos += headersz
+    chsz = 20 if version < 2 else (24 if version < 3 else 28)
+    while pos + chsz <= len(fileContent):
+        cmagic, nrec, size = struct.unpack('iii', fileContent[pos:pos+12])
+        stream = struct.unpack('i', fileContent[pos+24:pos+28])[0] if version >= 3 else 0
+        if cmagic != 0x4B4E4843 or pos + chsz + size > len(fileContent):
+            break
+        st = streams[stream]
+        st['records'].append(decode_mjc_chunk(fileContent[pos+chsz:pos+chsz+size], nrec, st['recsz']))
+        pos += chsz + size
+
+    # split records into fields
+    for st in streams:
+        dat = np.concatenate(st.pop('records')) if st['records'] else np.zeros((0, st['recsz']), np.float32)
+        st['time'] = dat[::skipamount, 0]
+        adr = 1
+        for f, n in zip(st['fields'], st['sizes']):
+            st[FIELDS[f]] = dat[::skipamount, adr:adr+n]
+            if FIELDS[f] in RAW_FIELDS:
+                st[FIELDS[f]] = st[FIELDS[f]].copy().view(np.float64)
+            adr += n
+
+    data = dict(nq=nq,
+               nv=nv,
+               nu=nu,
+               nmocap=nmocap,
+               nsensordata=nsensordata,
+               name=name,
+               streams=streams,
+               logName = read_filename
+               )
+    # single stream: same keys as parse_mjl_logs
+    if len(streams) == 1:
+        data.update((k, v) for k, v in streams[0].items() if k == 'time' or k in FIELDS)
+    return data
+
+# columns exported by 'mjltool columns': memory-mapped, only the pages used are read
+def load_columns(directory):
+    def load_dir(d):
+        return dict((f[:-4], np.load(os.path.join(d, f), mmap_mode='r'))
+                    for f in sorted(os.listdir(d)) if f.endswith('.npy'))
+    subdirs = sorted((d for d in os.listdir(directory) if d.startswith('stream')), key=lambda d: int(d[6:]))
+    streams = [load_dir(os.path.join(directory, d)) for d in subdirs] or [load_dir(directory)]
+    data = dict(streams=streams, logName=directory.rstrip('/\\')+'.npy')
+    if len(streams) == 1:
+        data.update(streams[0])
+    return data
+
 # visualize parsed logs
 def viz_parsed_mjl_logs(data):
+    # each field against the time of the stream holding it
+    def series(field):
+        for st in data.get('streams', [data]):
+            if field in st:
+                return st['time'], st[field]
+        return [], []
     f, axarr = plt.subplots(2, sharex=True)
-    axarr[0].plot(data['time'], data['qpos'])
+    axarr[0].plot(*series('qpos'))
     axarr[0].set_ylabel('qpos')
     axarr[0].set_title(data['logName'])
-    axarr[1].plot(data['time'], data['ctrl'])
+    axarr[1].plot(*series('ctrl'))
     axarr[1].set_ylabel('ctrl')
     axarr[1].set_xlabel('time')
     plt.savefig(data['logName'][:-4]+".png")
@@ -75,12 +200,17 @@ def viz_parsed_mjl_logs(data):
 
 # MAIN =========================================================
 @click.command(help=DESC)
-@click.option('--log', '-l', type=str, help='.mjl log to parse', required= True)
+@click.option('--log', '-l', type=str, help='.mjl or .mjc log, or directory from mjltool columns', required= True)
 @click.option('--skip', '-s', type=int, help='number of frames to skip (1:no skip)', default=1)
 @click.option('--plot', '-p', type=bool, help='plot parsed logs', default=False)
 def main(log, skip, plot):
     print("Loading log file: %s" % log)
-    data = parse_mjl_logs(log, skip)
+    if os.path.isdir(log):
+        data = load_columns(log)
+    elif log.endswith('.mjc'):
+        data = parse_mjc_logs(log, skip)
+    else:
+        data = parse_mjl_logs(log, skip)
     print("file successfully parsed")
 
 
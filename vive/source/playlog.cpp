@@ -5,9 +5,25 @@
 //---------------------------------//
 
 #include "mujoco.h"
+#include "GL/glew.h"
 #include "glfw3.h"
+#include "timing.h"
+#include "mjlog.h"
+#include "mjlquery.h"
+#include "mjlcatalog.h"
 #include "stdio.h"
+#include "float.h"
 #include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#ifdef _WIN32
+    #define popen _popen
+    #define pclose _pclose
+#endif
 
 
 //-------------------------------- global variables -------------------------------------
@@ -15,10 +31,16 @@
 // model and data
 mjModel* m = 0;
 mjData* d = 0;
-float* data = 0;
+mjlReader logReader;
 int recsz = 0;
+int master = 0;                 // log stream with the smallest decimation, drives the frame counter
 long long numrec = 0;
+long long readahead = 0;        // records prefetched around the current frame
 long long frame = 0;
+bool follow = false;            // log still being written: pick up new records while playing
+const char* events_name = 0;    // search result (mjltool query) with events of this log, 0: none
+std::vector<mjlEvent> events;   // events of this log, in time order
+std::vector<long long> evframe; // frame of each event
 mjtNum timestep = 0;
 float* rgb = 0;
 mjtNum* pointxy = 0;
@@ -26,6 +48,8 @@ int* npoints = 0;
 
 // user state
 bool paused = true;
+double speed = 1;                   // playback speed (log time / real time)
+double playtime = 0;                // log time being played
 bool jumped = false;
 bool showoption = false;
 bool showinfo = true;
@@ -33,6 +57,10 @@ bool showsensor = true;
 bool showfullscreen = false;
 int showhelp = 1;                   // 0: none; 1: brief; 2: full
 bool recording = false;
+const char* video_name = 0;         // video file (raw rgb24, or encoded: see openVideo), 0: no video
+double video_fps = 30;
+bool video_depth = false;           // also write the depth buffer (video_name.depth)
+bool capturenext = false;           // next render is a new frame (not a window refresh)
 
 // abstract visualization
 mjvScene scn;
@@ -40,6 +68,7 @@ mjvCamera cam;
 mjvOption vopt;
 char status[1000] = "";
 mjvFigure figsensor;
+mjvFigure figtimeline;
 
 // OpenGL rendering
 GLFWwindow* window = 0;
@@ -70,8 +99,15 @@ const char help_title[] =
 "Back\n"
 "Forward 100\n"
 "Back 100\n"
+"+/- 1 sec\n"
+"+/- 10 sec\n"
+"Speed\n"
 "Start\n"
-"End\n"
+"End (live)\n"
+"Follow log\n"
+"Next/prev event\n"
+"Timeline\n"
+"Timeline zoom\n"
 "Geoms\n"
 "Sites\n"
 "Zoom\n"
@@ -97,8 +133,15 @@ const char help_content[] =
 "Up arrow\n"
 "Right arrow\n"
 "Left arrow\n"
+"Shift Right/Left\n"
+"Shift Down/Up\n"
+"= -\n"
 "Home\n"
 "End\n"
+"F6\n"
+"PgDn PgUp\n"
+"F7\n"
+"Scroll on timeline\n"
 "0 - 4\n"
 "Shift 0 - 4\n"
 "Scroll or M drag\n"
@@ -141,6 +184,8 @@ void initOpenGL(const char* filename, const char* logfile, const int W, const in
     // make context current, request v-sync on swapbuffers
     glfwMakeContextCurrent(window);
     glfwSwapInterval(1);
+    if( glewInit()!=GLEW_OK )
+        mju_error("Could not initialize GLEW");
 
     // save window-to-framebuffer pixel scaling (needed for OSX scaling)
     int width, width1, height;
@@ -170,16 +215,582 @@ void initOpenGL(const char* filename, const char* logfile, const int W, const in
 }
 
 
+// mjData array of a log field
+mjtNum* fieldData(mjData* dd, int field)
+{
+    switch( field )
+    {
+    case mjlFIELD_QPOS:         return dd->qpos;
+    case mjlFIELD_QVEL:         return dd->qvel;
+    case mjlFIELD_CTRL:         return dd->ctrl;
+    case mjlFIELD_MOCAP_POS:    return dd->mocap_pos;
+    case mjlFIELD_MOCAP_QUAT:   return dd->mocap_quat;
+    case mjlFIELD_SENSORDATA:   return dd->sensordata;
+    default:                    return dd->userdata;
+    }
+}
+
+
+// copy the mjData fields of a record of stream s (after its time) into dd
+void setStream(mjlReader& rd, mjData* dd, int s, const float* data)
+{
+    const mjlStream& st = rd.getStream(s);
+    const float* src = data+1;
+    for( int i=0; i<st.nfield; i++ )
+    {
+        if( st.field[i]<mjlNDATAFIELD )
+            mju_f2n(fieldData(dd, st.field[i]), src, st.size[i]);
+        src += st.size[i];
+    }
+}
+
+
+// stream has mjData fields to show
+bool hasData(int s)
+{
+    const mjlStream& st = logReader.getStream(s);
+    for( int i=0; i<st.nfield; i++ )
+        if( st.field[i]<mjlNDATAFIELD )
+            return true;
+    return false;
+}
+
+
+// load record f of the master stream into dd, hold the other streams at its time
+bool loadFrame(mjlReader& rd, mjData* dd, long long f)
+{
+    // read ahead around f; .mjc: decodes the chunk containing f if not cached
+    rd.prefetch(f, readahead, master);
+    const float* data = rd.record(f, master);
+    if( !data )
+        return false;
+
+    dd->time = (mjtNum)data[0];
+    setStream(rd, dd, master, data);
+
+    // decimated streams: hold their last record at or before this time, in the time
+    // segment of their record of the same step (time restarts at a reset)
+    long long step = f*rd.getStream(master).decimation;
+    for( int s=0; s<rd.getNStream(); s++ )
+        if( s!=master && hasData(s) )
+        {
+            int dec = rd.getStream(s).decimation;
+            long long fs = rd.find(dd->time, s, dec>0 ? step/dec : -1);
+            const float* sdata = (fs>=0 ? rd.record(fs, s) : 0);
+            if( sdata )
+                setStream(rd, dd, s, sdata);
+        }
+    return true;
+}
+
+
 // set one frame, from global frame counter
 void setFrame(void)
 {
-    d->time = (mjtNum)data[recsz*frame];
-    mju_f2n(d->qpos, data+recsz*frame+1, m->nq);
-    mju_f2n(d->qvel, data+recsz*frame+1+m->nq, m->nv);
-    mju_f2n(d->ctrl, data+recsz*frame+1+m->nq+m->nv, m->nu);
-    mju_f2n(d->mocap_pos, data+recsz*frame+1+m->nq+m->nv+m->nu, 3*m->nmocap);
-    mju_f2n(d->mocap_quat, data+recsz*frame+1+m->nq+m->nv+m->nu+3*m->nmocap, 4*m->nmocap);
-    mju_f2n(d->sensordata, data+recsz*frame+1+m->nq+m->nv+m->nu+7*m->nmocap, m->nsensordata);
+    loadFrame(logReader, d, frame);
+}
+
+
+
+//-------------------------------- kinematics cache -------------------------------------
+//
+// Rendering a frame needs the poses of bodies, geoms, sites, cameras and lights,
+// not a full mj_forward. A worker thread with its own reader and mjData computes
+// them for every 'stride'-th frame (stride keeps the cache within kinBUDGET) and
+// stores them as float position + quaternion, with the subtree centers of mass
+// that a tracking camera follows. Frames in the cache are shown by
+// copying the poses into d (scrubbing snaps to them); other frames run the
+// kinematics only, and only when the frame changes. mj_forward runs only when the
+// scene shows what it computes: contacts, or sensors not in the log.
+
+const long long kinBUDGET = 256<<20;    // cache size limit (bytes)
+
+struct
+{
+    std::thread worker;
+    std::atomic<bool> stop;
+    std::atomic<long long> done;        // cached frames: 0, stride, ..., (done-1)*stride
+    long long stride;
+    long long ncache;                   // frames to cache
+    int framesz;                        // floats per cached frame
+    float* data;
+} kin;
+
+
+// pack/unpack position and orientation (3x3 matrix) as 7 floats
+static void packPose(float* dst, const mjtNum* pos, const mjtNum* mat)
+{
+    mjtNum quat[4];
+    mju_mat2Quat(quat, mat);
+    mju_n2f(dst, pos, 3);
+    mju_n2f(dst+3, quat, 4);
+}
+
+static void unpackPose(mjtNum* pos, mjtNum* mat, const float* src)
+{
+    mjtNum quat[4];
+    mju_f2n(pos, src, 3);
+    mju_f2n(quat, src+3, 4);
+    mju_normalize4(quat);
+    mju_quat2Mat(mat, quat);
+}
+
+
+// scene poses of dd into dst (framesz floats), or from src into dd
+static void kinPack(float* dst, const mjData* dd)
+{
+    for( int i=0; i<m->nbody; i++, dst+=10 )
+    {
+        packPose(dst, dd->xpos+3*i, dd->xmat+9*i);
+        mju_n2f(dst+7, dd->subtree_com+3*i, 3);
+    }
+    for( int i=0; i<m->ngeom; i++, dst+=7 )
+        packPose(dst, dd->geom_xpos+3*i, dd->geom_xmat+9*i);
+    for( int i=0; i<m->nsite; i++, dst+=7 )
+        packPose(dst, dd->site_xpos+3*i, dd->site_xmat+9*i);
+    for( int i=0; i<m->ncam; i++, dst+=7 )
+        packPose(dst, dd->cam_xpos+3*i, dd->cam_xmat+9*i);
+    for( int i=0; i<m->nlight; i++, dst+=6 )
+    {
+        mju_n2f(dst, dd->light_xpos+3*i, 3);
+        mju_n2f(dst+3, dd->light_xdir+3*i, 3);
+    }
+}
+
+static void kinUnpack(mjData* dd, const float* src)
+{
+    for( int i=0; i<m->nbody; i++, src+=10 )
+    {
+        unpackPose(dd->xpos+3*i, dd->xmat+9*i, src);
+        mju_f2n(dd->xquat+4*i, src+3, 4);
+        mju_f2n(dd->subtree_com+3*i, src+7, 3);
+    }
+    for( int i=0; i<m->ngeom; i++, src+=7 )
+        unpackPose(dd->geom_xpos+3*i, dd->geom_xmat+9*i, src);
+    for( int i=0; i<m->nsite; i++, src+=7 )
+        unpackPose(dd->site_xpos+3*i, dd->site_xmat+9*i, src);
+    for( int i=0; i<m->ncam; i++, src+=7 )
+        unpackPose(dd->cam_xpos+3*i, dd->cam_xmat+9*i, src);
+    for( int i=0; i<m->nlight; i++, src+=6 )
+    {
+        mju_f2n(dd->light_xpos+3*i, src, 3);
+        mju_f2n(dd->light_xdir+3*i, src+3, 3);
+    }
+}
+
+
+// positions computed from qpos/mocap: what the scene needs besides contacts
+static void kinematics(mjData* dd)
+{
+    mj_kinematics(m, dd);
+    mj_comPos(m, dd);
+    mj_camlight(m, dd);
+    mj_tendon(m, dd);
+    mj_transmission(m, dd);
+}
+
+
+// worker thread: fill the cache in frame order
+static void kinWorker(std::string logfile)
+{
+    mjlReader rd;
+    mjData* dd = mj_makeData(m);
+    if( !dd || !rd.open(logfile.c_str()) )
+    {
+        mj_deleteData(dd);
+        return;
+    }
+
+    double tm = mjTimeSec();
+    for( long long j=0; j<kin.ncache && !kin.stop; j++ )
+    {
+        if( !loadFrame(rd, dd, j*kin.stride) )
+            break;
+        kinematics(dd);
+        kinPack(kin.data + j*kin.framesz, dd);
+        kin.done = j+1;
+    }
+    if( !kin.stop )
+        printf("Kinematics cache: %lld frames (every %lld), %.1f MB, %.1f sec\n", (long long)kin.done,
+               kin.stride, 1e-6*sizeof(float)*kin.framesz*(double)kin.done, mjTimeSec()-tm);
+
+    rd.close();
+    mj_deleteData(dd);
+}
+
+
+// start filling the cache for the frames in the log now
+void kinStart(const char* logfile)
+{
+    kin.framesz = 10*m->nbody + 7*(m->ngeom + m->nsite + m->ncam) + 6*m->nlight;
+    long long persize = (long long)sizeof(float)*kin.framesz;
+    kin.stride = mjMAX(1, (numrec*persize + kinBUDGET-1)/kinBUDGET);
+    kin.ncache = (numrec + kin.stride-1)/kin.stride;
+    kin.done = 0;
+    kin.stop = false;
+    kin.data = (float*)malloc(persize*mjMAX(1, kin.ncache));
+    if( !kin.data )
+    {
+        kin.ncache = 0;
+        return;
+    }
+    kin.worker = std::thread(kinWorker, std::string(logfile));
+}
+
+
+// stop the worker, free the cache
+void kinStop(void)
+{
+    kin.stop = true;
+    if( kin.worker.joinable() )
+        kin.worker.join();
+    free(kin.data);
+    kin.data = 0;
+    kin.ncache = 0;
+    kin.done = 0;
+}
+
+
+// some stream of the log has the field
+bool isLogged(int field)
+{
+    for( int s=0; s<logReader.getNStream(); s++ )
+    {
+        const mjlStream& st = logReader.getStream(s);
+        for( int i=0; i<st.nfield; i++ )
+            if( st.field[i]==field )
+                return true;
+    }
+    return false;
+}
+
+
+// what the scene needs: 2: mj_forward (contacts, constraints, sensors shown that are
+// not in the log), 1: kinematics (joints, inertia, com, actuators, tendons), 0: poses
+int sceneNeeds(void)
+{
+    if( vopt.flags[mjVIS_CONTACTPOINT] || vopt.flags[mjVIS_CONTACTFORCE] || vopt.flags[mjVIS_CONSTRAINT] )
+        return 2;
+    if( showsensor && m->nsensordata && !isLogged(mjlFIELD_SENSORDATA) )
+        return 2;
+    if( vopt.flags[mjVIS_JOINT] || vopt.flags[mjVIS_INERTIA] || vopt.flags[mjVIS_COM] ||
+        vopt.flags[mjVIS_ACTUATOR] || (m->ntendon && vopt.flags[mjVIS_TENDON]) )
+        return 1;
+    return 0;
+}
+
+
+// update d for rendering the current frame: cached poses, kinematics or mj_forward
+void updateFrame(void)
+{
+    static long long last = -1;
+    static int lastneeds = -1;
+    int needs = sceneNeeds();
+    if( frame==last && needs==lastneeds )
+        return;
+    last = frame;
+    lastneeds = needs;
+
+    if( needs==2 )
+        mj_forward(m, d);
+    else
+    {
+        if( needs==0 && frame%kin.stride==0 && frame/kin.stride<kin.done )
+            kinUnpack(d, kin.data + (frame/kin.stride)*kin.framesz);
+        else
+            kinematics(d);
+        d->ncon = 0;
+        d->nefc = 0;
+    }
+}
+
+
+//-------------------------------- timeline pyramid -------------------------------------
+//
+// The timeline above the scroll bar plots ctrl, qpos or sensordata over a window of
+// frames centered on the current one. A worker thread with its own reader and mjData
+// builds a min/max pyramid over these channels: level 0 holds the range of each block
+// of 'base' frames (base keeps the pyramid within tlBUDGET; short logs get base 1),
+// each level above holds the range of two blocks of the level below. A plot column
+// spanning n frames reads the level whose blocks are at most n frames long, i.e. two
+// or three blocks, so plotting costs the same per column at any zoom and log length.
+// Levels are merged as the blocks come in, so the plot fills in while it is built.
+// A followed log grows the pyramid: the blocks built so far are kept (merged when
+// the blocks get longer) and the worker continues with the new frames.
+
+const long long tlBUDGET = 64<<20;          // pyramid size limit (bytes)
+const int tlNCOLUMN = mjMAXLINEPNT/2-1;     // plot columns (a min and a max point each)
+const int tlNLEVEL = 64;
+
+struct
+{
+    std::thread worker;
+    std::atomic<bool> stop;
+    std::atomic<long long> done;        // level-0 blocks built
+    std::string logfile;                // log the worker reads
+    int nch;                            // channels: ctrl, qpos, sensordata (logged ones)
+    int adr[4];                         // first channel of each group (1: ctrl, 2: qpos, 3: sensordata)
+    int size[4];                        // channels in each group
+    long long nframe;                   // frames covered (in the log at open or last growth)
+    long long base;                     // frames per level-0 block
+    int nlevel;
+    long long nblock[tlNLEVEL];         // blocks in each level
+    float* level[tlNLEVEL];             // blocks of each level: [(b*nch+c)*2]: min, max
+    float* data;                        // all levels
+    int group;                          // shown: 0: none, 1: ctrl, 2: qpos, 3: sensordata
+    double zoom;                        // frames per plot column
+} tl;
+
+
+// channels of group g in dd
+static const mjtNum* tlChannels(const mjData* dd, int g)
+{
+    return (g==1 ? dd->ctrl : (g==2 ? dd->qpos : dd->sensordata));
+}
+
+
+// merge the ranges of channels [c0, c0+nc) of blocks b0..b1 of level L into dst
+static void tlMerge(float* dst, int L, long long b0, long long b1, int c0, int nc)
+{
+    for( int c=0; c<nc; c++ )
+    {
+        dst[2*c] = FLT_MAX;
+        dst[2*c+1] = -FLT_MAX;
+    }
+    for( long long b=b0; b<=b1 && b<tl.nblock[L]; b++ )
+    {
+        const float* src = tl.level[L] + (b*tl.nch+c0)*2;
+        for( int c=0; c<nc; c++ )
+        {
+            dst[2*c] = mjMIN(dst[2*c], src[2*c]);
+            dst[2*c+1] = mjMAX(dst[2*c+1], src[2*c+1]);
+        }
+    }
+}
+
+
+// blocks above level-0 block b now cover it
+static void tlUp(long long b)
+{
+    for( int L=1; L<tl.nlevel; L++ )
+    {
+        long long k = b>>L;
+        tlMerge(tl.level[L] + k*tl.nch*2, L-1, 2*k, 2*k+1, 0, tl.nch);
+    }
+}
+
+
+// worker thread: level-0 blocks in frame order from the first one not built, then
+// their ancestors
+static void tlWorker(std::string logfile)
+{
+    mjlReader rd;
+    mjData* dd = mj_makeData(m);
+    if( !dd || !rd.open(logfile.c_str()) )
+    {
+        mj_deleteData(dd);
+        return;
+    }
+
+    double tm = mjTimeSec();
+    long long first = tl.done;
+    for( long long b=first; b<tl.nblock[0] && !tl.stop; b++ )
+    {
+        // range of the frames in block b
+        float* blk = tl.level[0] + b*tl.nch*2;
+        long long last = mjMIN((b+1)*tl.base, tl.nframe);
+        for( long long f=b*tl.base; f<last; f++ )
+        {
+            if( !loadFrame(rd, dd, f) )
+                break;
+            for( int g=1; g<4; g++ )
+            {
+                const mjtNum* src = tlChannels(dd, g);
+                float* dst = blk + 2*tl.adr[g];
+                for( int i=0; i<tl.size[g]; i++ )
+                {
+                    dst[2*i] = mjMIN(dst[2*i], (float)src[i]);
+                    dst[2*i+1] = mjMAX(dst[2*i+1], (float)src[i]);
+                }
+            }
+        }
+
+        tlUp(b);
+        tl.done = b+1;
+    }
+    if( !tl.stop && !first )
+        printf("Timeline: %lld frames (blocks of %lld), %d levels, %.1f MB, %.1f sec\n", tl.nframe,
+               tl.base, tl.nlevel, 1e-6*sizeof(float)*(tl.level[tl.nlevel-1]-tl.data+2*tl.nch),
+               mjTimeSec()-tm);
+
+    rd.close();
+    mj_deleteData(dd);
+}
+
+
+// pyramid for tl.nframe frames with level-0 blocks of at least base frames, empty
+// ranges; false if it cannot be allocated
+static bool tlLayout(long long base)
+{
+    // smallest base (power of 2) within budget: all levels hold < 2 x level 0
+    long long blocksz = (long long)sizeof(float)*2*tl.nch;
+    tl.base = base;
+    while( tl.base<tl.nframe && (2*((tl.nframe+tl.base-1)/tl.base)+tlNLEVEL)*blocksz>tlBUDGET )
+        tl.base *= 2;
+
+    // level sizes, up to a single block
+    long long total = 0;
+    tl.nlevel = 0;
+    for( long long n=(tl.nframe+tl.base-1)/tl.base; tl.nlevel<tlNLEVEL; n=(n+1)/2 )
+    {
+        tl.nblock[tl.nlevel++] = n;
+        total += n;
+        if( n==1 )
+            break;
+    }
+
+    // allocate, empty ranges (min>max) until built
+    tl.data = (float*)malloc(blocksz*total);
+    if( !tl.data )
+        return false;
+    tl.level[0] = tl.data;
+    for( int L=1; L<tl.nlevel; L++ )
+        tl.level[L] = tl.level[L-1] + tl.nblock[L-1]*tl.nch*2;
+    for( long long i=0; i<total*tl.nch; i++ )
+    {
+        tl.data[2*i] = FLT_MAX;
+        tl.data[2*i+1] = -FLT_MAX;
+    }
+    return true;
+}
+
+
+// start building the pyramid for the frames in the log now
+void tlStart(const char* logfile)
+{
+    // channels of the logged groups
+    const int field[4] = {0, mjlFIELD_CTRL, mjlFIELD_QPOS, mjlFIELD_SENSORDATA};
+    const int size[4] = {0, m->nu, m->nq, m->nsensordata};
+    tl.nch = 0;
+    for( int g=1; g<4; g++ )
+    {
+        tl.adr[g] = tl.nch;
+        tl.size[g] = (isLogged(field[g]) ? size[g] : 0);
+        tl.nch += tl.size[g];
+    }
+    tl.group = 0;
+    for( int g=3; g>0; g-- )
+        if( tl.size[g] )
+            tl.group = g;
+    tl.nframe = numrec;
+    tl.done = 0;
+    tl.stop = false;
+    tl.logfile = logfile;
+    if( !tl.nch || !tl.nframe )
+        return;
+    if( !tlLayout(1) )
+    {
+        tl.nch = 0;
+        tl.group = 0;
+        return;
+    }
+
+    // whole log in the plot
+    tl.zoom = mjMAX(1, (double)tl.nframe/tlNCOLUMN);
+    tl.worker = std::thread(tlWorker, tl.logfile);
+}
+
+
+// follow: extend the pyramid to the frames in the log now, keep the level-0 blocks
+// of whole frames built so far
+void tlGrow(void)
+{
+    if( !tl.data )
+    {
+        if( numrec>0 && !tl.logfile.empty() )
+            tlStart(tl.logfile.c_str());
+        return;
+    }
+    if( numrec<=tl.nframe )
+        return;
+
+    tl.stop = true;
+    if( tl.worker.joinable() )
+        tl.worker.join();
+
+    // blocks built so far (the last one of the old frames may be partial)
+    float* old = tl.data;
+    long long oldbase = tl.base, nfull = mjMIN((long long)tl.done, tl.nframe/tl.base);
+    bool whole = (tl.zoom>=(double)tl.nframe/tlNCOLUMN);
+    tl.nframe = numrec;
+    if( !tlLayout(oldbase) )
+    {
+        free(old);
+        tl.nch = 0;
+        tl.group = 0;
+        tl.done = 0;
+        return;
+    }
+
+    // merge them into the new level-0 blocks (r old blocks each), then their ancestors
+    long long r = tl.base/oldbase, n = nfull/r;
+    for( long long k=0; k<n; k++ )
+    {
+        float* dst = tl.level[0] + k*tl.nch*2;
+        for( long long j=k*r; j<(k+1)*r; j++ )
+        {
+            const float* src = old + j*tl.nch*2;
+            for( int c=0; c<tl.nch; c++ )
+            {
+                dst[2*c] = mjMIN(dst[2*c], src[2*c]);
+                dst[2*c+1] = mjMAX(dst[2*c+1], src[2*c+1]);
+            }
+        }
+        tlUp(k);
+    }
+    free(old);
+
+    // keep showing the whole log if it was
+    if( whole )
+        tl.zoom = mjMAX(1, (double)tl.nframe/tlNCOLUMN);
+    tl.done = n;
+    tl.stop = false;
+    tl.worker = std::thread(tlWorker, tl.logfile);
+}
+
+
+// stop the worker, free the pyramid
+void tlStop(void)
+{
+    tl.stop = true;
+    if( tl.worker.joinable() )
+        tl.worker.join();
+    free(tl.data);
+    tl.data = 0;
+    tl.nch = 0;
+    tl.done = 0;
+}
+
+
+// range of group channels over frames [f0, f1) into dst (min/max pairs): from the
+// level with the longest blocks not longer than the span; false if not built yet
+bool tlRange(float* dst, long long f0, long long f1)
+{
+    f0 = mjMAX(0, f0);
+    f1 = mjMIN(tl.nframe, f1);
+    if( f0>=f1 )
+        return false;
+
+    int L = 0;
+    while( L<tl.nlevel-1 && (tl.base<<(L+1))<=f1-f0 )
+        L++;
+    long long b0 = f0/(tl.base<<L);
+    long long b1 = (f1-1)/(tl.base<<L);
+    if( (((b1+1)<<L)-1)>=tl.done && tl.done<tl.nblock[0] )
+        return false;
+
+    tlMerge(dst, L, b0, b1, tl.adr[tl.group], tl.size[tl.group]);
+    return true;
 }
 
 
@@ -213,55 +824,29 @@ void initMuJoCo(const char* filename, const char* logfile)
     // copy timestep, adjust later
     timestep = m->opt.timestep;
 
-    // open logfile
-    FILE* fp = fopen(logfile, "rb");
-    if( !fp )
+    // map logfile (.mjl or chunked .mjc), records are read on demand
+    if( !logReader.open(logfile) )
         mju_error("Could not open logfile");
 
-    // get header with sizes, check
-    int header[7];
-    if( fread(header, sizeof(int), 7, fp) != 7 )
-        mju_error("Could not read logfile header");
+    // check sizes from header
+    const int* header = logReader.getSizes();
     if( m->nq!=header[0] || m->nv!=header[1] || m->nu!=header[2] ||
-        m->nmocap!=header[3] || m->nsensordata!=header[4] )
+        m->nmocap!=header[3] || m->nsensordata!=header[4] || m->nuserdata!=header[5] )
         mju_error("Model sizes incompatible with sizes found in logfile header");
 
     // warn on name mismatch
-    int namewarning = 0;
-    if( strlen(m->names)!=header[6] )
-        namewarning = 1;
-
-    // skip name, compare
-    char c;
-    for( int n=0; n<header[6]; n++ )
-    {
-        fread(&c, 1, 1, fp);
-
-        if( n<strlen(m->names) && c!=m->names[n] )
-            namewarning = 1;
-    }
-
-    // warn about name
-    if( namewarning )
+    if( (int)strlen(m->names)!=header[6] || strncmp(m->names, logReader.getNames(), header[6]) )
         mju_warning("Logfile and model contain different model names");
 
-    // compute record size
-    recsz = 1 + m->nq + m->nv + m->nu + 7*m->nmocap + m->nsensordata + m->nuserdata;
-
-    // get remaining file size and number of records (Visual Studio)
-    //  on Posix use feeko, ftello, #define _FILE_OFFSET_BITS 64
-    long long startpos = _ftelli64(fp);
-    _fseeki64(fp, 0, SEEK_END);
-    long long filesz = _ftelli64(fp) - startpos;
-    _fseeki64(fp, startpos, SEEK_SET);
-    numrec = filesz/recsz/sizeof(float);
-    if( numrec*recsz*sizeof(float)!=filesz )
-        mju_error("Logfile size is not divisible by frame size");
+    // frames follow the densest stream with mjData fields, the others are sampled at its times
+    master = logReader.getMasterStream();
+    if( master<0 )
+        mju_error("Logfile has no qpos/qvel/ctrl/... stream to play");
+    recsz = logReader.getRecsz(master);
+    numrec = logReader.getNRecord(master);
+    readahead = mjMAX(256, (long long)((16<<20)/(sizeof(float)*recsz)));
 
     // allocate buffers
-    data = (float*) malloc(filesz);
-    if( !data )
-        mju_error("Could not allocate memory buffer for logfile data");
     if( m->nsensordata )
     {
         rgb = (float*) malloc(sizeof(float)*3*(5+m->nsensordata));
@@ -271,19 +856,36 @@ void initMuJoCo(const char* filename, const char* logfile)
             mju_error("Could not allocate memory buffer for 2d plot");
     }
 
-    // read data, print size
-    size_t nn = fread(data, recsz*sizeof(float), numrec, fp);
-    if( nn!=numrec )
-        mju_error("Unexpected amount of data read");
-    fclose(fp);
-    printf("Loaded %lld data frames from logfile\n\n", numrec);
+    printf("Loaded %lld data frames from logfile%s", numrec,
+           logReader.isChunked() ? " (chunked)" : "");
+    if( logReader.getNStream()>1 )
+        printf(", %d streams", logReader.getNStream());
+    if( follow )
+        printf(", following");
+    printf("\n\n");
 
-    // make data, set first frame
+    // events from the search result: frames to jump to
+    if( events_name )
+    {
+        if( !mjl_readEvents(events_name, logfile, events) )
+            mju_error_s("Could not read events file %s", events_name);
+        for( size_t e=0; e<events.size(); e++ )
+            evframe.push_back(mjMAX(0, logReader.find(events[e].t0, master, events[e].first)));
+        printf("%d events of this log in %s\n\n", (int)events.size(), events_name);
+    }
+
+    // make data, set first frame (follow: newest frame)
     d = mj_makeData(m);
-    frame = 0;
+    frame = (follow ? mjMAX(0, numrec-1) : 0);
     setFrame();
     mj_forward(m, d);
 
+    // poses of all frames for scrubbing, computed in the background
+    kinStart(logfile);
+
+    // min/max pyramid for the timeline, also in the background
+    tlStart(logfile);
+
     // initialize MuJoCo visualization
     mjv_makeScene(m, &scn, 1000);
     mjv_defaultCamera(&cam);
@@ -303,10 +905,12 @@ void initMuJoCo(const char* filename, const char* logfile)
 // deallocate everything
 void closeMuJoCo(void)
 {
+    kinStop();
+    tlStop();
     free(npoints);
     free(pointxy);
     free(rgb);
-    free(data);
+    logReader.close();
     mj_deleteData(d);
     mj_deleteModel(m);
     mjr_freeContext(&con);
@@ -325,6 +929,7 @@ typedef struct
     int cwidth;         // cursor width
     int cheight;        // cursor height
     int lwidth;         // line width
+    int plot;           // timeline height (above the bar), 0: hidden
 } Bar;
 
 
@@ -335,10 +940,11 @@ Bar getBar(int width)
 
     b.width = width;
     b.bar = (int)(40*fontscale);
-    b.cpos = (int)(width/2*(double)frame/(double)numrec);
+    b.cpos = (numrec>0 ? (int)(width/2*(double)frame/(double)numrec) : 0);
     b.cwidth = (int)(10*fontscale);
     b.cheight = (int)(20*fontscale);
     b.lwidth = (int)(4*fontscale);
+    b.plot = (tl.group ? (int)(100*fontscale) : 0);
 
     return b;
 }
@@ -354,11 +960,80 @@ void repositionFrame(Bar b, int x)
     else if( frame>numrec-1 )
         frame = numrec-1;
 
+    // snap to a cached frame
+    if( kin.stride>1 )
+        frame = mjMIN(((frame + kin.stride/2)/kin.stride)*kin.stride, mjMAX(0, numrec-1));
+
     setFrame();
     jumped = true;
 }
 
 
+// jump by dt seconds of log time within the time segment of the frame (index lookup,
+// decodes one chunk); at its end, the next frame starts the next segment
+void jumpTime(double dt)
+{
+    long long f = logReader.find(d->time + dt, master, frame);
+    if( f<0 )
+        return;
+
+    // always move at least one frame in the requested direction
+    if( dt>0 && f<=frame )
+        f = mjMIN(frame+1, numrec-1);
+    else if( dt<0 && f>=frame )
+        f = mjMAX(frame-1, 0);
+
+    frame = f;
+    setFrame();
+    jumped = true;
+}
+
+
+// jump to the next (dir>0) or previous event
+void jumpEvent(int dir)
+{
+    int e = -1;
+    for( int i=0; i<(int)evframe.size(); i++ )
+        if( dir>0 ? (evframe[i]>frame && e<0) : evframe[i]<frame )
+            e = i;
+    if( e<0 )
+        return;
+
+    frame = evframe[e];
+    setFrame();
+    jumped = true;
+    printf("Event %d / %d: %.3f to %.3f sec\n", e+1, (int)events.size(), events[e].t0, events[e].t1);
+}
+
+
+// follow: poll the log for new records; at the end (live) playback runs into them
+void followLog(void)
+{
+    static double lastpoll = 0;
+    if( !follow || mjTimeSec()-lastpoll<0.1 )
+        return;
+    lastpoll = mjTimeSec();
+
+    // records are copied into d by setFrame, so moving the mapping is safe
+    if( logReader.refresh()>0 )
+    {
+        numrec = logReader.getNRecord(master);
+        if( frame==0 && numrec>0 )
+            setFrame();
+    }
+    else if( !logReader.getNStream() )
+        mju_error("Could not follow logfile");
+
+    // timeline over the new frames (at most once a second: growing copies the pyramid)
+    static double lastgrow = 0;
+    if( numrec>tl.nframe && mjTimeSec()-lastgrow>=1 )
+    {
+        lastgrow = mjTimeSec();
+        tlGrow();
+    }
+}
+
+
 //--------------------------------- GLFW callbacks --------------------------------------
 
 // keyboard
@@ -399,6 +1074,23 @@ void keyboard(GLFWwindow* window, int key, int scancode, int act, int mods)
             glfwRestoreWindow(window);
         break;
 
+    case GLFW_KEY_F7:                   // timeline: none, ctrl, qpos, sensordata (logged ones)
+        do
+            tl.group = (tl.group+1)%4;
+        while( tl.group && !tl.size[tl.group] );
+        break;
+
+    case GLFW_KEY_F6:                   // follow log being written
+        follow = !follow;
+        if( follow )
+        {
+            frame = mjMAX(0, numrec-1);
+            paused = false;
+            jumped = true;
+            setFrame();
+        }
+        break;
+
 	case GLFW_KEY_F9:
 		recording = !recording;
 		if(recording)
@@ -407,34 +1099,75 @@ void keyboard(GLFWwindow* window, int key, int scancode, int act, int mods)
 			printf("stop\n");
 		break;
 
+    case GLFW_KEY_EQUAL:                // faster, up to 50x
+    case GLFW_KEY_MINUS:                // slower, down to 0.1x
+        {
+            const double steps[] = {0.1, 0.2, 0.5, 1, 2, 5, 10, 20, 50};
+            int i = 0;
+            while( i<8 && steps[i]<speed )
+                i++;
+            i = (key==GLFW_KEY_EQUAL ? mjMIN(i+1, 8) : mjMAX(i-1, 0));
+            speed = steps[i];
+            printf("Playback speed %gx\n", speed);
+        }
+        break;
+
     case GLFW_KEY_SPACE:                // pause
         paused = !paused;
         break;
 
-    case GLFW_KEY_RIGHT:                // step forward
+    case GLFW_KEY_RIGHT:                // step forward (Shift: 1 sec)
+        if( mods & GLFW_MOD_SHIFT )
+        {
+            jumpTime(1);
+            break;
+        }
         frame = mjMIN(frame+1, numrec-1);
         jumped = true;
         setFrame();
         break;
 
-    case GLFW_KEY_LEFT:                 // step back
+    case GLFW_KEY_LEFT:                 // step back (Shift: 1 sec)
+        if( mods & GLFW_MOD_SHIFT )
+        {
+            jumpTime(-1);
+            break;
+        }
         frame = mjMAX(frame-1, 0);
         jumped = true;
         setFrame();
         break;
 
-    case GLFW_KEY_DOWN:                 // step forward 100
+    case GLFW_KEY_DOWN:                 // step forward 100 (Shift: 10 sec)
+        if( mods & GLFW_MOD_SHIFT )
+        {
+            jumpTime(10);
+            break;
+        }
         frame = mjMIN(frame+100, numrec-1);
         jumped = true;
         setFrame();
         break;
 
-    case GLFW_KEY_UP:                   // step back 100
+    case GLFW_KEY_UP:                   // step back 100 (Shift: 10 sec)
+        if( mods & GLFW_MOD_SHIFT )
+        {
+            jumpTime(-10);
+            break;
+        }
         frame = mjMAX(frame-100, 0);
         jumped = true;
         setFrame();
         break;
 
+    case GLFW_KEY_PAGE_DOWN:            // next event
+        jumpEvent(1);
+        break;
+
+    case GLFW_KEY_PAGE_UP:              // previous event
+        jumpEvent(-1);
+        break;
+
     case GLFW_KEY_HOME:                 // start
         frame  = 0;
         jumped = true;
@@ -442,7 +1175,7 @@ void keyboard(GLFWwindow* window, int key, int scancode, int act, int mods)
         break;
 
     case GLFW_KEY_END:                  // end
-        frame = numrec-1;
+        frame = mjMAX(0, numrec-1);
         jumped = true;
         setFrame();
         break;
@@ -547,7 +1280,7 @@ void mouse_button(GLFWwindow* window, int button, int act, int mods)
         reposition = false;
 
     // detect double-click (250 msec)
-    if( act==GLFW_PRESS && glfwGetTime()-lastclicktm<0.25 && 
+    if( act==GLFW_PRESS && mjTimeSec()-lastclicktm<0.25 && 
         button==lastbutton && !reposition )
     {
         if( button_right )
@@ -560,7 +1293,7 @@ void mouse_button(GLFWwindow* window, int button, int act, int mods)
     if( act==GLFW_PRESS )
     {
         lastbutton = button;
-        lastclicktm = glfwGetTime();
+        lastclicktm = mjTimeSec();
     }
 }
 
@@ -618,11 +1351,292 @@ void scroll(GLFWwindow* window, double xoffset, double yoffset)
     if( !m )
         return;
 
+    // over the timeline: zoom it (frames per column), whole log at most
+    double x, y;
+    int width, height;
+    glfwGetCursorPos(window, &x, &y);
+    glfwGetFramebufferSize(window, &width, &height);
+    Bar b = getBar(width);
+    int ybuf = height - (int)(y*window2buffer);
+    if( b.plot && ybuf>=b.bar && ybuf<b.bar+b.plot )
+    {
+        tl.zoom = mju_pow(1.25, -yoffset) * tl.zoom;
+        tl.zoom = mjMAX(1, mjMIN(tl.zoom, (double)tl.nframe/tlNCOLUMN));
+        return;
+    }
+
     // emulate vertical mouse motion = 5% of window height
     mjv_moveCamera(m, mjMOUSE_ZOOM, 0, -0.05*yoffset, &scn, &cam);
 }
 
 
+//-------------------------------- video capture ----------------------------------------
+//
+// Frames are read back asynchronously: glReadPixels into a pixel buffer object
+// returns at once, and the buffer is mapped capNPBO-1 frames later, when the GPU
+// has long finished the transfer. Mapped frames are copied into a ring drained by a
+// writer thread, so neither the readback nor the disk stalls the render loop (the
+// loop only waits when the disk falls capNSLOT frames behind; no frame is dropped).
+
+const int capNPBO = 3;              // frames in flight on the GPU
+const int capNSLOT = 16;            // frames queued for the writer
+
+struct
+{
+    bool open;
+    int W, H;
+    size_t rgbsz, depthsz;          // bytes per frame
+    FILE* fp;                       // rgb24 frames
+    FILE* fpdepth;                  // float depth frames (video_depth)
+    GLuint pbo[capNPBO];            // rgb readback
+    GLuint pbodepth[capNPBO];       // depth readback (video_depth)
+    long long issued;               // frames read into PBOs
+    long long queued;               // frames copied into the ring
+    long long written;              // frames written by the writer thread
+    unsigned char* slot[capNSLOT];  // ring: rgb, then depth
+    std::thread writer;
+    std::mutex mtx;
+    std::condition_variable cond;
+    bool stop;
+    long long tmFirst, tmLast;      // first and last capture (ns)
+    long long tmWait;               // render loop waiting for ring space (ns)
+} cap;
+
+
+// name asks for an encoded video
+bool isEncoded(const char* name)
+{
+    const char* ext[] = {".mp4", ".mkv", ".mov", ".avi"};
+    size_t n = strlen(name);
+    for( int i=0; i<4; i++ )
+        if( n>4 && !strcmp(name+n-4, ext[i]) )
+            return true;
+    return false;
+}
+
+
+// open raw file, or start ffmpeg encoding W x H rgb24 frames at fps from a pipe
+// (H.264, flipped upright, encoded on ffmpeg's threads)
+FILE* openVideo(const char* name, int W, int H, double fps)
+{
+    if( !isEncoded(name) )
+        return fopen(name, "wb");
+
+    // odd sizes are padded: yuv420p needs even width and height
+    char cmd[1000];
+    snprintf(cmd, sizeof(cmd), "ffmpeg -loglevel error -y -f rawvideo -pixel_format rgb24 "
+             "-video_size %dx%d -framerate %g -i - -vf \"vflip,pad=ceil(iw/2)*2:ceil(ih/2)*2\" "
+             "-c:v libx264 -preset fast -crf 18 -pix_fmt yuv420p \"%s\"", W, H, fps, name);
+#ifdef _WIN32
+    return popen(cmd, "wb");
+#else
+    return popen(cmd, "w");
+#endif
+}
+
+
+// writer thread: write queued frames in order
+void captureWriter(void)
+{
+    std::unique_lock<std::mutex> lock(cap.mtx);
+    while( true )
+    {
+        cap.cond.wait(lock, []{ return cap.stop || cap.written<cap.queued; });
+        if( cap.written==cap.queued )
+            return;
+
+        // write outside the lock; the render thread does not touch queued slots
+        unsigned char* frame = cap.slot[cap.written%capNSLOT];
+        lock.unlock();
+        fwrite(frame, 1, cap.rgbsz, cap.fp);
+        if( cap.fpdepth )
+            fwrite(frame+cap.rgbsz, 1, cap.depthsz, cap.fpdepth);
+        lock.lock();
+
+        cap.written++;
+        cap.cond.notify_all();
+    }
+}
+
+
+// create files, buffers and writer thread
+void captureOpen(void)
+{
+    mjrRect viewport = mjr_maxViewport(&con);
+    cap.W = viewport.width;
+    cap.H = viewport.height;
+    cap.rgbsz = (size_t)3*cap.W*cap.H;
+    cap.depthsz = (video_depth ? sizeof(float)*cap.W*cap.H : 0);
+
+    cap.fp = openVideo(video_name, cap.W, cap.H, video_fps);
+    cap.fpdepth = 0;
+    if( video_depth )
+    {
+        std::string name = std::string(video_name) + ".depth";
+        cap.fpdepth = fopen(name.c_str(), "wb");
+    }
+    if( !cap.fp || (video_depth && !cap.fpdepth) )
+        mju_error("Could not create video file");
+
+    for( int i=0; i<capNSLOT; i++ )
+        if( !(cap.slot[i] = (unsigned char*)malloc(cap.rgbsz + cap.depthsz)) )
+            mju_error("Could not allocate video buffers");
+
+    glGenBuffers(capNPBO, cap.pbo);
+    for( int i=0; i<capNPBO; i++ )
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, cap.pbo[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, cap.rgbsz, 0, GL_STREAM_READ);
+    }
+    if( video_depth )
+    {
+        glGenBuffers(capNPBO, cap.pbodepth);
+        for( int i=0; i<capNPBO; i++ )
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, cap.pbodepth[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, cap.depthsz, 0, GL_STREAM_READ);
+        }
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    cap.issued = cap.queued = cap.written = 0;
+    cap.tmFirst = cap.tmLast = cap.tmWait = 0;
+    cap.stop = false;
+    cap.writer = std::thread(captureWriter);
+    cap.open = true;
+    printf("Recording %dx%d to %s%s\n", cap.W, cap.H, video_name, video_depth ? " (and depth)" : "");
+}
+
+
+// copy the oldest frame in flight from its PBO into the ring
+void captureCollect(void)
+{
+    long long f = cap.queued;
+    unsigned char* dst = cap.slot[f%capNSLOT];
+
+    // wait for the writer if the ring is full
+    {
+        std::unique_lock<std::mutex> lock(cap.mtx);
+        if( f-cap.written>=capNSLOT )
+        {
+            long long tm = mjTimeNS();
+            cap.cond.wait(lock, [f]{ return f-cap.written<capNSLOT; });
+            cap.tmWait += mjTimeNS()-tm;
+        }
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, cap.pbo[f%capNPBO]);
+    const void* src = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if( src )
+    {
+        memcpy(dst, src, cap.rgbsz);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    if( video_depth )
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, cap.pbodepth[f%capNPBO]);
+        src = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+        if( src )
+        {
+            memcpy(dst+cap.rgbsz, src, cap.depthsz);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // hand over to the writer
+    std::lock_guard<std::mutex> lock(cap.mtx);
+    cap.queued++;
+    cap.cond.notify_all();
+}
+
+
+// start the readback of the frame in the back buffer (call before swapping)
+void captureFrame(void)
+{
+    if( !cap.open )
+        captureOpen();
+
+    // frame read capNPBO-1 frames ago is ready
+    if( cap.issued-cap.queued>=capNPBO )
+        captureCollect();
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadBuffer(GL_BACK);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, cap.pbo[cap.issued%capNPBO]);
+    glReadPixels(0, 0, cap.W, cap.H, GL_RGB, GL_UNSIGNED_BYTE, 0);
+    if( video_depth )
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, cap.pbodepth[cap.issued%capNPBO]);
+        glReadPixels(0, 0, cap.W, cap.H, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    cap.tmLast = mjTimeNS();
+    if( !cap.issued )
+        cap.tmFirst = cap.tmLast;
+
+    // print every 10 frames: '.' if ok, 'x' if OpenGL error
+    if( ((cap.issued++)%10)==0 )
+    {
+        if( glGetError()!=GL_NO_ERROR )
+            printf("x");
+        else
+            printf(".");
+    }
+}
+
+
+// collect the frames in flight, stop the writer, report throughput
+void captureClose(void)
+{
+    if( !cap.open )
+        return;
+
+    while( cap.queued<cap.issued )
+        captureCollect();
+    {
+        std::lock_guard<std::mutex> lock(cap.mtx);
+        cap.stop = true;
+        cap.cond.notify_all();
+    }
+    cap.writer.join();
+
+    glDeleteBuffers(capNPBO, cap.pbo);
+    if( video_depth )
+        glDeleteBuffers(capNPBO, cap.pbodepth);
+    for( int i=0; i<capNSLOT; i++ )
+        free(cap.slot[i]);
+    bool ok = (isEncoded(video_name) ? pclose(cap.fp) : fclose(cap.fp))==0;
+    if( cap.fpdepth )
+        fclose(cap.fpdepth);
+    cap.open = false;
+
+    // sustained rate while recording (F9 pauses are included)
+    double sec = 1e-9*(double)(cap.tmLast-cap.tmFirst);
+    double fps = (sec>0 ? (cap.issued-1)/sec : 0);
+    printf("\nVideo: %lld frames %dx%d, %.1f fps captured (%.1f MB/s), waited %.2f sec for the %s\n",
+           cap.issued, cap.W, cap.H, fps, 1e-6*fps*(double)(cap.rgbsz+cap.depthsz), 1e-9*(double)cap.tmWait,
+           isEncoded(video_name) ? "encoder" : "disk");
+    if( !ok )
+        printf("Could not write %s%s\n", video_name, isEncoded(video_name) ? " (is ffmpeg on the PATH?)" : "");
+    else if( isEncoded(video_name) )
+    {
+        FILE* fp = fopen(video_name, "rb");
+        long long sz = 0;
+        if( fp )
+        {
+            fseek(fp, 0, SEEK_END);
+            sz = ftell(fp);
+            fclose(fp);
+        }
+        printf("Encoded %.2f MB (%.0fx smaller than raw)\n", 1e-6*(double)sz,
+               sz>0 ? (double)cap.rgbsz*cap.issued/(double)sz : 0);
+    }
+}
+
+
+
 //-------------------------------- simulation and rendering -----------------------------
 
 // make option string
@@ -651,9 +1665,9 @@ void makeoptionstring(const char* name, char key, char* buf)
 // advance simulation
 void simulation(void)
 {
-    static double lastupdate = glfwGetTime();
+    static double lastupdate = mjTimeSec();
 
-    if( glfwGetTime()-lastupdate > m->opt.timestep )
+    if( mjTimeSec()-lastupdate > m->opt.timestep )
     {
         if( frame<numrec-1 )
         {
@@ -661,7 +1675,7 @@ void simulation(void)
             setFrame();
         }
 
-        lastupdate = glfwGetTime();
+        lastupdate = mjTimeSec();
     }
 }
 
@@ -755,6 +1769,92 @@ static void ShowSensor(mjrRect rect)
 
 
 
+// init timeline figure
+static void InitTimeline(void)
+{
+    mjv_defaultFigure(&figtimeline);
+    figtimeline.flg_extend = 0;
+    figtimeline.gridsize[0] = 5;
+    figtimeline.gridsize[1] = 2;
+    strcpy(figtimeline.xformat, "%.0f");
+    strcpy(figtimeline.yformat, "%.1f");
+    figtimeline.range[1][0] = 0;
+    figtimeline.range[1][1] = 1;
+
+    // line colors, last line: current frame
+    const float color[6][3] = {{1,.3f,.3f}, {.3f,1,.3f}, {.4f,.6f,1}, {1,1,.3f}, {1,.4f,1}, {.3f,1,1}};
+    for( int i=0; i<mjMAXLINE-1; i++ )
+        memcpy(figtimeline.linergb[i], color[i%6], sizeof(float)*3);
+    figtimeline.linergb[mjMAXLINE-1][0] = 1;
+    figtimeline.linergb[mjMAXLINE-1][1] = 1;
+    figtimeline.linergb[mjMAXLINE-1][2] = 1;
+}
+
+
+// update timeline: channel ranges per column, each channel scaled to its visible range
+static void UpdateTimeline(void)
+{
+    const char* name[4] = {"", "ctrl", "qpos", "sensordata"};
+    int size = tl.size[tl.group];
+    int nline = mjMIN(size, mjMAXLINE-1);
+    static std::vector<float> col;
+    static std::vector<float> lo, hi;
+    col.resize(2*size*tlNCOLUMN);
+    lo.assign(nline, FLT_MAX);
+    hi.assign(nline, -FLT_MAX);
+
+    // window of frames around the current one
+    double span = tl.zoom*tlNCOLUMN;
+    double start = mjMAX(0, mjMIN(frame-span/2, tl.nframe-span));
+    sprintf(figtimeline.title, "%s%s", name[tl.group], tl.done<tl.nblock[0] ? " (building)" : "");
+    figtimeline.range[0][0] = (float)start;
+    figtimeline.range[0][1] = (float)(start+span);
+
+    // ranges of the columns built so far
+    bool built[tlNCOLUMN];
+    for( int c=0; c<tlNCOLUMN; c++ )
+    {
+        float* r = col.data() + 2*size*c;
+        built[c] = tlRange(r, (long long)(start+c*tl.zoom), (long long)(start+(c+1)*tl.zoom));
+        for( int i=0; built[c] && i<nline; i++ )
+        {
+            lo[i] = mjMIN(lo[i], r[2*i]);
+            hi[i] = mjMAX(hi[i], r[2*i+1]);
+        }
+    }
+
+    // min and max of each column as a vertical stroke
+    for( int i=0; i<mjMAXLINE; i++ )
+        figtimeline.linepnt[i] = 0;
+    for( int i=0; i<nline; i++ )
+    {
+        float scl = (hi[i]>lo[i] ? 1/(hi[i]-lo[i]) : 0);
+        float* pnt = figtimeline.linedata[i];
+        int p = 0;
+        for( int c=0; c<tlNCOLUMN; c++ )
+            if( built[c] )
+            {
+                const float* r = col.data() + 2*size*c + 2*i;
+                float x = (float)(start+(c+0.5)*tl.zoom);
+                pnt[2*p] = x;
+                pnt[2*p+1] = (scl ? (r[0]-lo[i])*scl : 0.5f);
+                pnt[2*p+2] = x;
+                pnt[2*p+3] = (scl ? (r[1]-lo[i])*scl : 0.5f);
+                p += 2;
+            }
+        figtimeline.linepnt[i] = p;
+    }
+
+    // current frame
+    float* cur = figtimeline.linedata[mjMAXLINE-1];
+    cur[0] = cur[2] = (float)frame;
+    cur[1] = 0;
+    cur[3] = 1;
+    figtimeline.linepnt[mjMAXLINE-1] = 2;
+}
+
+
+
 // render
 void render(GLFWwindow* window)
 {
@@ -785,12 +1885,12 @@ void render(GLFWwindow* window)
 
     // get scroll bar sizes, remove from rendering
     Bar b = getBar(rectfull.width);
-    mjrRect rect = {0, b.bar, rectfull.width, rectfull.height-b.bar};
+    mjrRect rect = {0, b.bar+b.plot, rectfull.width, rectfull.height-b.bar-b.plot};
 
     // get window size (different from framebuffer size)
     mjrRect R = {0, 0, 0, 0};
     glfwGetWindowSize(window, &R.width, &R.height);
-    R.bottom = mju_round(b.bar/window2buffer);
+    R.bottom = mju_round((b.bar+b.plot)/window2buffer);
     R.height -= R.bottom;
 
     // selection
@@ -887,19 +1987,43 @@ void render(GLFWwindow* window)
         ShowSensor(rect);
     }
 
+    // timeline between the scene and the bar
+    if( b.plot )
+    {
+        UpdateTimeline();
+        mjrRect rplot = {0, b.bar, rectfull.width, b.plot};
+        mjr_figure(rplot, &figtimeline, &con);
+    }
+
     // render bar
     rect.bottom = 0;
     rect.height = b.bar;
     mjr_rectangle(rect, .5, .5, .5, 1);
-    char info[100];
-    sprintf(info, "%lld / %lld", frame, numrec);
+    char info[100], evinfo[50] = "";
+    if( !events.empty() )
+    {
+        int e = 0;
+        while( e<(int)evframe.size() && evframe[e]<=frame )
+            e++;
+        sprintf(evinfo, "  event %d / %d", e, (int)events.size());
+    }
+    sprintf(info, "%lld / %lld%s%s", frame, numrec,
+            follow ? (frame>=numrec-1 ? "  LIVE" : "  following") : "", evinfo);
     mjr_overlay(mjFONT_NORMAL, mjGRID_BOTTOMLEFT, rect, info, NULL, &con);
-    mjr_overlay(mjFONT_NORMAL, mjGRID_BOTTOMRIGHT, rect, paused ? "PAUSED" : "PLAYING", NULL, &con);
+    char play[50] = "PAUSED";
+    if( !paused )
+        sprintf(play, speed==1 ? "PLAYING" : "PLAYING %gx", speed);
+    mjr_overlay(mjFONT_NORMAL, mjGRID_BOTTOMRIGHT, rect, play, NULL, &con);
     mjrRect rline = {rect.width/4, b.bar/2-b.lwidth/2, rect.width/2, b.lwidth};
     mjr_rectangle(rline, .2, .2, .2, 1);
     mjrRect rcursor = {rect.width/4 + b.cpos-b.cwidth/2, b.bar/2-b.cheight/2, b.cwidth, b.cheight};
     mjr_rectangle(rcursor, 1, 1, 1, .8);
 
+    // read back the frame for the video before it is swapped out (main loop frames only)
+    if( recording && video_name && capturenext )
+        captureFrame();
+    capturenext = false;
+
     // swap buffers
     glfwSwapBuffers(window); 
 }
@@ -907,101 +2031,26 @@ void render(GLFWwindow* window)
 
 // main function ----------------------------------------
 
-// record 
-void record_view(char* videoName, bool terminate_recording = false)
-{
-	static bool initFlag = true;
-	static unsigned char* rgb;
-	static float* depth;
-	static int W, H;
-	static FILE* fp;
-	static mjrRect viewport;
-	static int framecount = 0;
-	static double frametime = 0;
-
-	// close file and free buffers
-	if(terminate_recording)
-	{
-		if(!initFlag)
-		{
-			fclose(fp);
-			free(rgb);
-			free(depth);
-		}
-		return;
-	}
-
-	// initialize
-	if(initFlag)
-	{
-		// create output rgb file
-		fp = fopen(videoName, "wb");
-
-		// get size of active renderbuffer
-		viewport =  mjr_maxViewport(&con);
-		W = viewport.width;
-		H = viewport.height;
-
-		// allocate rgb and depth buffers
-		rgb = (unsigned char*)malloc(3*W*H);
-		depth = (float*)malloc(sizeof(float)*W*H);
-		if( !rgb || !depth )
-			mju_error("Could not allocate buffers");
-		initFlag = false;
-	}
-
-	 // render scene in offscreen buffer
-	// mjr_render(viewport, &scn, &con);
-	// 
-	// // add time stamp in upper-left corner
-	// char stamp[50];
-	// sprintf(stamp, "Time = %.3f", d->time);
-	// mjr_overlay(mjFONT_NORMAL, mjGRID_TOPLEFT, viewport, stamp, NULL, &con);
-
-	// read rgb and depth buffers
-	mjr_readPixels(rgb, depth, viewport, &con);
-
-	// insert subsampled depth image in lower-left corner of rgb image
-	// const int NS = 3;           // depth image sub-sampling
-	// for( int r=0; r<H; r+=NS )
-	// 	for( int c=0; c<W; c+=NS )
-	// 	{
-	// 		int adr = (r/NS)*W + c/NS;
-	// 		rgb[3*adr] = rgb[3*adr+1] = rgb[3*adr+2] =
-	// 			(unsigned char)((1.0f-depth[r*W+c])*255.0f);
-	// 	}
-
-	// write rgb image to file
-	fwrite(rgb, 3, W*H, fp);
-
-	// print every 10 frames: '.' if ok, 'x' if OpenGL error
-	if( ((framecount++)%10)==0 )
-	{
-		if( mjr_getError() )
-			printf("x");
-		else
-			printf(".");
-	}
-
-	// save simulation time
-	frametime = d->time;
-}
-
-
 // Instructions
 char* help = {
 	"-----------------------------------------------------------------\n"
 	"Playlog: Replay logs [optionally, dump raw video from the logs]\n"
-	"Usage:\t playlog.exe modelfile logfile [video_name W H fps] [fontscale]\n"
+	"Usage:\t playlog.exe modelfile logfile [video_name W H fps] [fontscale | depth]\n"
+	"\t playlog.exe modelfile logfile follow\n"
+	"\t playlog.exe modelfile logfile eventsfile\n"
+	"\t playlog.exe catalogfile N\n"
 	"Note:\t Donot manually resize window if dumping video. Use W & H\n"
+	"\t F9 starts/stops recording; depth also writes video_name.depth (float)\n"
+	"\t video_name .mp4/.mkv/.mov/.avi: H.264 through ffmpeg, else raw rgb24\n"
+	"\t follow plays a log that is still being written (F6 toggles, End goes live)\n"
+	"\t eventsfile: output of mjltool query, PgDn/PgUp jump between its events\n"
+	"\t catalogfile N: log N of an mjltool catalog, with the model saved next to it\n"
 	"-----------------------------------------------------------------\n\n"
 };
 
 
 int main(int argc, const char** argv)
 {
-	char video_name[100] ="none";
-    double video_fps = 30;
 	int W = 1280, H = 720;
 
 	printf("%s", help);
@@ -1010,16 +2059,43 @@ int main(int argc, const char** argv)
         mju_error("MuJoCo headers and library have different versions");
 
     // check arguments
-    if( argc!=3 && argc!=7 && argc!=8)
+    if( argc!=3 && argc!=4 && argc!=7 && argc!=8)
     {
         printf("Check arguments\n");
         return 1;
     }
 
+    // session N of a catalog: log and the model saved next to it
+    const char* modelfile = argv[1];
+    const char* logfile = argv[2];
+    std::string catalogmodel;
+    mjlCatalogEntry entry;
+    if( argc==3 && argv[2][0] && strspn(argv[2], "0123456789")==strlen(argv[2]) )
+    {
+        if( !mjl_catalogEntry(argv[1], atoi(argv[2]), entry) )
+        {
+            printf("Could not read entry %s of catalog %s\n", argv[2], argv[1]);
+            return 1;
+        }
+        catalogmodel = mjl_modelPath(entry.path);
+        modelfile = catalogmodel.c_str();
+        logfile = entry.path;
+        printf("Catalog entry %s: %s (%.1f sec)\n", argv[2], logfile, entry.t1-entry.t0);
+    }
+
+    // follow a log that is still being written, or jump between searched events
+    if( argc==4 && !strcmp(argv[3], "follow") )
+    {
+        follow = true;
+        paused = false;
+    }
+    else if( argc==4 )
+        events_name = argv[3];
+
 	// parse video data
-    if( argc>=4 )
+    if( argc>=7 )
     {
-		strcpy(video_name, argv[3]);
+		video_name = argv[3];
 		sscanf(argv[4], "%d", &W);
 		sscanf(argv[5], "%d", &H);
 		sscanf(argv[6], "%lf", &video_fps);
@@ -1030,10 +2106,12 @@ int main(int argc, const char** argv)
 		}
     }
 
-	// parse fontscale
-    if( argc==6 )
+	// depth video or fontscale
+    if( argc==8 && !strcmp(argv[7], "depth") )
+        video_depth = true;
+    else if( argc==8 )
     {
-        sscanf(argv[5], "%lf", &fontscale);
+        sscanf(argv[7], "%lf", &fontscale);
         if( fontscale<1.25 )
             fontscale = 1;
         else if( fontscale>1.75 )
@@ -1043,8 +2121,8 @@ int main(int argc, const char** argv)
     }
 
     // init
-    initOpenGL(argv[1], argv[2], W, H, strcmp(video_name,"none"));
-    initMuJoCo(argv[1], argv[2]);
+    initOpenGL(modelfile, logfile, W, H, video_name!=0);
+    initMuJoCo(modelfile, logfile);
 
     // set GLFW callbacks
     glfwSetKeyCallback(window, keyboard);
@@ -1053,8 +2131,7 @@ int main(int argc, const char** argv)
     glfwSetScrollCallback(window, scroll);
     glfwSetWindowRefreshCallback(window, render);
     InitSensor();
-
-	int nstep = 0;
+    InitTimeline();
 
     // main loop
     while( !glfwWindowShouldClose(window) )
@@ -1063,39 +2140,57 @@ int main(int argc, const char** argv)
 
 		// timing statistics
 		if( lastrender==0 )
-			lastrender = glfwGetTime();
-		if(recording)
-			nstep = (int)(1.0/(video_fps*m->opt.timestep));
-		else
-			nstep = mjMAX(1, (int)((glfwGetTime()-lastrender)/m->opt.timestep));
-		lastrender = glfwGetTime();
-		
+			lastrender = mjTimeSec();
+		double elapsed = mjTimeSec()-lastrender;
+		lastrender = mjTimeSec();
 
-		// advance frame:: keep realtime for playback/ maintain FPS when recording 
+		// pick up records appended to a followed log
+		followLog();
+
+		// advance log time: real time x speed, or one video frame when recording;
+		// show the last record at or before it in the time segment of the frame
+		// (fast playback skips records, one render per loop at any speed)
 		if( !paused && !jumped && !reposition )
 		{
-			frame = mjMIN(frame+nstep, numrec-1);
-			setFrame();
+			playtime += (recording ? 1.0/video_fps : elapsed) * speed;
+			long long f = logReader.find(playtime, master, frame), last;
+			logReader.getSegment(frame, master, 0, &last);
+			if( f>frame )
+			{
+				frame = mjMIN(f, numrec-1);
+				setFrame();
+			}
+
+			// last record of a segment shown: time was reset after it, continue with
+			// the next segment from its first record
+			else if( frame==last-1 && last<numrec )
+			{
+				frame = last;
+				setFrame();
+				playtime = d->time;
+			}
+
+			// at the end: wait there (follow: for new records)
+			if( frame>=numrec-1 )
+				playtime = d->time;
 		}
-		mj_forward(m, d);
+		else
+			playtime = d->time;
+		updateFrame();
 
 		// clear flag, so next time we advance automatically
 		jumped = false;
 
-        // simulate and render
+        // simulate and render (recording: the frame goes to the video)
+        capturenext = true;
         render(window);
 
-		// render new frame (or first frame)
-		if((recording)&&(strcmp(video_name,"none")!=0))
-			record_view(video_name);
-
         // handle events (this calls all callbacks)
         glfwPollEvents();
     }
 
     // free and terminate
-	if(strcmp(video_name,"none")!=0)
-		record_view(video_name, true);
+    captureClose();
     closeMuJoCo();
     glfwTerminate();
     return 0;
@@ -44,7 +44,7 @@ static void uniformDist(RealType* data, double min, double max, size_t count)
 // process event. Return true is the event is active
 bool user_event(mjModel *m, mjData *d, int event_id, double* prms)
 {
-    int skip = prms[0];
+    int skip = (prms ? (int)prms[0] : 0);
     int step_cnt = (int)(d->time / m->opt.timestep);
 
     // process events
@@ -162,6 +162,19 @@ void user_requests(mjModel *m, mjData *d, int request_idx, int request_id, mjtNu
     }
 }
 
+// close the log being recorded and save the xml used as well
+void close_logs(mjModel* m, mjData* d)
+{
+    saveLogs = false; // stop savnig logs
+    write_logs(m, d, opt->logFile, true);
+    printf("\tLogs Saved: %s\n", logName);
+    char error[1000] = "Could not save model";
+    char name[100];
+    sprintf(name, "%s_%s.xml", opt->logFile, logTimestr);
+    mj_saveLastXML(name, m, error, 1000);
+    printf("\tModel saved: %s\n", name);
+}
+
 // user demands
 void user_step(mjModel* m, mjData* d)
 {
@@ -170,18 +183,9 @@ void user_step(mjModel* m, mjData* d)
     int request_id;
     mjtNum* request_prms;
 
-    // Close logs on reset and save the xml used as well
-    if ((user_event(m, d, on_reset, NULL))&&(strcmp(opt->logFile,"none")!=0)&&saveLogs)
-    {
-        saveLogs = false; // stop savnig logs
-        write_logs(m, d, opt->logFile, true);
-        printf("\tLogs Saved: %s%s.mjl\n", opt->logFile, logTimestr);
-        char error[1000] = "Could not save model";        
-        char name[100];
-        sprintf(name, "%s_%s.xml", opt->logFile, logTimestr);
-        mj_saveLastXML(name, m, error, 1000);
-        printf("\tModel saved: %s%s.xml\n", opt->logFile, logTimestr);
-    }
+    // Close logs on reset; session logs stay open across resets (reset records)
+    if (!opt->logSession&&(user_event(m, d, on_reset, NULL))&&(strcmp(opt->logFile,"none")!=0)&&saveLogs)
+        close_logs(m, d);
 
 
     // process actuator requests //evnt, e0, cmd, c0....
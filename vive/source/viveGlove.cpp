@@ -21,6 +21,9 @@
 using namespace vr;
 
 #include "cyberGlove_utils.h"	// cyberGlove
+#include "timing.h"				// shared time base, scoped timers
+#include "mjlog.h"				// asynchronous log writer
+#include "mjlcheck.h"			// re-simulation check (replay)
 cgOption* opt;					// cyber glove options
 
 //-------------------------------- MuJoCo global data -----------------------------------
@@ -52,6 +55,20 @@ void resetMuJoCo()
     mj_forward(m, d);
 }
 
+// activate with the license in MUJOCOPATH; return 0 if error, 1 if ok
+int activateMuJoCo(void)
+{
+	char licensePath[100];
+	char* mujocoPath = getenv("MUJOCOPATH");
+    if(mujocoPath == NULL)
+		printf("WARNING:: Environment variable 'MUJOCOPATH' not found. Defaulting to the local folder\n");
+	else
+		(std::string(mujocoPath));
+	sprintf(licensePath, "%s\\mjkey.txt", mujocoPath);
+
+	return mj_activate(licensePath);
+}
+
 // load model, init simulation and rendering; return 0 if error, 1 if ok
 int initMuJoCo(const char* filename, int width2, int height)
 {
@@ -77,16 +94,8 @@ int initMuJoCo(const char* filename, int width2, int height)
     if( glewInit()!=GLEW_OK )
         return 0;
 
-	char licensePath[100];
-	char* mujocoPath = getenv("MUJOCOPATH");
-    if(mujocoPath == NULL)
-		printf("WARNING:: Environment variable 'MUJOCOPATH' not found. Defaulting to the local folder\n");
-	else
-		(std::string(mujocoPath));
-	sprintf(licensePath, "%s\\mjkey.txt", mujocoPath);
-
     // activate
-	if(!mj_activate(licensePath))
+	if(!activateMuJoCo())
 	    return 0;
 
     // load and compile
@@ -664,7 +673,7 @@ void v_update(void)
                 {
                     ctl[n].tool = (ctl[n].tool + 1) % vNTOOL;
                     ctl[n].messageduration = 1;
-                    ctl[n].messagestart = glfwGetTime();
+                    ctl[n].messagestart = mjTimeSec();
                     strcpy(ctl[n].message, toolName[ctl[n].tool]);
                 }
 
@@ -677,7 +686,7 @@ void v_update(void)
                         ctl[n].body = mjMIN(m->nbody-1, ctl[n].body+1);
 
                     ctl[n].messageduration = 1;
-                    ctl[n].messagestart = glfwGetTime();
+                    ctl[n].messagestart = mjTimeSec();
                     const char* name = mj_id2name(m, mjOBJ_BODY, ctl[n].body);
                     if( name )
                         sprintf(ctl[n].message, "body '%s'", name);
@@ -689,7 +698,7 @@ void v_update(void)
                 else if( button==vBUTTON_PAD && ctl[n].tool!=vTOOL_PULL )
                 {
 					ctl[n].messageduration = 1;
-                    ctl[n].messagestart = glfwGetTime();
+                    ctl[n].messagestart = mjTimeSec();
 					
 					// Left button reset the scene
                     if(ctl[n].padpos[0]<-0.5 && abs(ctl[n].padpos[1]<0.5))
@@ -816,7 +825,7 @@ void v_update(void)
                 else
                     g->type = mjGEOM_BOX;
 
-                if( ctl[n].message[0] && glfwGetTime()-ctl[n].messagestart < ctl[n].messageduration)
+                if( ctl[n].message[0] && mjTimeSec()-ctl[n].messagestart < ctl[n].messageduration)
                     strcpy(g->label, ctl[n].message);
 
                 scn.ngeom++;
@@ -997,85 +1006,237 @@ void v_close(void)
 
 //-------------------------------- main function ----------------------------------------
 
-// Type conversion
-int num2float(float* res, mjtNum* data, int n)
-{
-	for (int i = 0; i < n; i++)
-		res[i] = (float)data[i];
-	return n;
-}
-
 // Save logs
 #include <time.h>
 char logTimestr[50]="";
+char logName[200]="";				// file being recorded: <logFile>_<timestamp>.log or .mjc
+mjlWriter logWriter;				// asynchronous: physics only copies into a ring slot
+std::vector<mjlStream> logStreams;	// streams written (schema, session streams)
+std::vector<mjlPacker> logPackers;	// record layout per stream, computed once per model
+long long logStep = 0;				// steps since the log was opened (stream decimation)
+bool logReset = false;				// scene was reset: write the event streams (reset) at this step
+mjtNum* gloveSample = 0;			// last glove sample applied by physics (calibSenor_n)
+
+// session inputs, sampled by the physics thread when it writes the log
+#define vLOGCONTROLLER 27			// floats per controller
+struct _vLogSession_t
+{
+    mjtNum clock;                   // wall clock since the log was opened (sec)
+    mjtNum controller[2*vLOGCONTROLLER];    // valid, tool, body, trackMocap, hold[4], touch[4],
+                                    // triggerpos, padpos[2], roompos[3], roommat[9]
+    mjtNum hmd[12];                 // roompos[3], roommat[9]
+    mjtNum scene[8];                // translate[3], rotate[4], scale
+    mjtNum step;                    // logStep of a reset record
+    double start;                   // wall clock at open (sec)
+};
+typedef struct _vLogSession_t vLogSession_t;
+vLogSession_t logSession;
 
-void write_logs(mjModel* m, mjData* d, char* filename, bool closeFile=false)
+// add one log field of d to a record layout
+void add_logField(mjlPacker& packer, mjModel* m, mjData* d, int field)
 {
-    static bool initFlag = true;
-    static float* writebuf = nullptr;
-	static FILE* logfile = nullptr;
+    switch( field )
+    {
+    case mjlFIELD_QPOS:         packer.add(d->qpos, m->nq);                 break;
+    case mjlFIELD_QVEL:         packer.add(d->qvel, m->nv);                 break;
+    case mjlFIELD_CTRL:         packer.add(d->ctrl, m->nu);                 break;
+    case mjlFIELD_MOCAP_POS:    packer.add(d->mocap_pos, 3*m->nmocap);      break;
+    case mjlFIELD_MOCAP_QUAT:   packer.add(d->mocap_quat, 4*m->nmocap);     break;
+    case mjlFIELD_SENSORDATA:   packer.add(d->sensordata, m->nsensordata);  break;
+    case mjlFIELD_USERDATA:     packer.add(d->userdata, m->nuserdata);      break;
+
+    // session
+    case mjlFIELD_CLOCK:        packer.add(&logSession.clock, 1);           break;
+    case mjlFIELD_CONTROLLER:   packer.add(logSession.controller, 2*vLOGCONTROLLER);    break;
+    case mjlFIELD_HMD:          packer.add(logSession.hmd, 12);             break;
+    case mjlFIELD_SCENE:        packer.add(logSession.scene, 8);            break;
+    case mjlFIELD_GLOVE:        packer.add(gloveSample, opt->calibSenor_n); break;
+
+    // exact inputs of mj_step, in replay order
+    case mjlFIELD_INPUT:
+        packer.addRaw(d->ctrl, m->nu);
+        packer.addRaw(d->qfrc_applied, m->nv);
+        packer.addRaw(d->xfrc_applied, 6*m->nbody);
+        packer.addRaw(d->mocap_pos, 3*m->nmocap);
+        packer.addRaw(d->mocap_quat, 4*m->nmocap);
+        break;
 
-    if (initFlag&&!closeFile)
+    // exact state, and the model parameters user requests randomize
+    case mjlFIELD_RESET:
+        packer.addRaw(&logSession.step, 1);
+        packer.addRaw(&d->time, 1);
+        packer.addRaw(d->qpos, m->nq);
+        packer.addRaw(d->qvel, m->nv);
+        packer.addRaw(d->act, m->na);
+        packer.addRaw(d->qacc_warmstart, m->nv);
+        packer.addRaw(m->body_pos, 3*m->nbody);
+        packer.addRaw(m->body_quat, 4*m->nbody);
+        packer.addRaw(m->site_pos, 3*m->nsite);
+        break;
+    }
+}
+
+// size of a session field in floats (see add_logField)
+int size_logField(mjModel* m, int field)
+{
+    switch( field )
     {
-        char name[100];
-        time_t now = time(0);
-        strftime(logTimestr, sizeof(name), "%Y_%m_%d_%H_%M_%S", localtime(&now));
-        sprintf(name, "%s_%s.log", filename, logTimestr);
-        logfile = fopen(name,"wb");
-        if (logfile == NULL)
+    case mjlFIELD_CLOCK:        return 1;
+    case mjlFIELD_CONTROLLER:   return 2*vLOGCONTROLLER;
+    case mjlFIELD_HMD:          return 12;
+    case mjlFIELD_SCENE:        return 8;
+    case mjlFIELD_GLOVE:        return (gloveSample ? opt->calibSenor_n : 0);
+    case mjlFIELD_INPUT:        return 2*(m->nu + m->nv + 6*m->nbody + 7*m->nmocap);
+    case mjlFIELD_RESET:        return 2*(2 + m->nq + 2*m->nv + m->na + 7*m->nbody + 3*m->nsite);
+    default:                    return 0;
+    }
+}
+
+// sample the session inputs (render thread state as seen by physics)
+void sample_session(void)
+{
+    logSession.clock = mjTimeSec() - logSession.start;
+    for( int n=0; n<2; n++ )
+    {
+        mjtNum* c = logSession.controller + n*vLOGCONTROLLER;
+        c[0] = (ctl[n].id>=0 && ctl[n].valid);
+        c[1] = ctl[n].tool;
+        c[2] = ctl[n].body;
+        c[3] = trackMocap[n];
+        for( int i=0; i<vNBUTTON; i++ )
         {
-            printf("Could not open %s\n", filename);
+            c[4+i] = ctl[n].hold[i];
+            c[8+i] = ctl[n].touch[i];
+        }
+        c[12] = ctl[n].triggerpos;
+        c[13] = ctl[n].padpos[0];
+        c[14] = ctl[n].padpos[1];
+        mju_f2n(c+15, ctl[n].roompos, 3);
+        mju_f2n(c+18, ctl[n].roommat, 9);
+    }
+    mju_f2n(logSession.hmd, hmd.roompos, 3);
+    mju_f2n(logSession.hmd+3, hmd.roommat, 9);
+    mju_f2n(logSession.scene, scn.translate, 3);
+    mju_f2n(logSession.scene+3, scn.rotate, 4);
+    logSession.scene[7] = scn.scale;
+}
+
+void write_logs(mjModel* m, mjData* d, char* filename, bool closeFile=false)
+{
+	// close if requested (drains the ring, prints log statistics)
+	if(closeFile)
+	{	
+		logWriter.close();
+		return;
+	}
+
+    if (!logWriter.isOpen())
+    {
+        // schema, or one stream of all fields
+        logStreams.assign(1, mjl_defaultStream());
+        if( opt->logStreams[0] && !mjl_parseStreams(opt->logStreams, logStreams) )
             return;
+
+        // session: input sources, exact step inputs every step, state at open (event)
+        if( opt->logSession )
+        {
+            mjlStream st[4];
+            const int fields[4][3] = {
+                {mjlFIELD_CONTROLLER, mjlFIELD_HMD, mjlFIELD_SCENE},
+                {mjlFIELD_GLOVE},
+                {mjlFIELD_CLOCK, mjlFIELD_INPUT},
+                {mjlFIELD_RESET}};
+            const int nfields[4] = {3, 1, 2, 1};
+            for( int k=0; k<4; k++ )
+            {
+                if( fields[k][0]==mjlFIELD_GLOVE && !gloveSample )
+                    continue;
+                st[k].decimation = (fields[k][0]==mjlFIELD_RESET ? 0 : 1);
+                st[k].nfield = nfields[k];
+                for( int i=0; i<nfields[k]; i++ )
+                {
+                    st[k].field[i] = fields[k][i];
+                    st[k].size[i] = size_logField(m, fields[k][i]);
+                }
+                logStreams.push_back(st[k]);
+            }
+            logSession.start = mjTimeSec();
         }
-        else
+        if( logStreams.size()>mjlMAXSTREAM )
         {
-            // write header
-            fwrite(&(m->nq), sizeof(int), 1, logfile);
-            fwrite(&(m->nv), sizeof(int), 1, logfile);
-            fwrite(&(m->nu), sizeof(int), 1, logfile);
-            fwrite(&(m->nmocap), sizeof(int), 1, logfile);
-            fwrite(&(m->nsensordata), sizeof(int),  1, logfile);
-            fwrite(&(m->nuserdata), sizeof(int),  1, logfile);
-            int sz = (int)strlen(m->names);
-            fwrite(&sz, sizeof(int),  1, logfile);
-            if (sz)
-                fwrite(m->names, sizeof(char), sz, logfile);
+            printf("Log schema: at most %d streams with the session streams\n", mjlMAXSTREAM);
+            return;
         }
 
-		writebuf = (float*)mju_malloc(sizeof(float)*(1 + m->nq + m->nv + m->nu
-        + 3 * m->nmocap + 4 * m->nmocap + m->nsensordata));
+        // schema and sessions need the chunked format
+        bool plain = (!opt->logStreams[0] && !opt->logSession);
+        int chunk = mjMAX(0, opt->logChunk);
+        if( !plain && !chunk )
+            chunk = 256;
+
+        time_t now = time(0);
+        strftime(logTimestr, sizeof(logTimestr), "%Y_%m_%d_%H_%M_%S", localtime(&now));
+        snprintf(logName, sizeof(logName), "%s_%s.%s", filename, logTimestr, chunk>0 ? "mjc" : "log");
+
+        // header: sizes and model names
+        int sz = (int)strlen(m->names);
+        int headersz = 7*sizeof(int) + sz;
+        char* header = (char*)mju_malloc(headersz);
+        int sizes[7] = {m->nq, m->nv, m->nu, m->nmocap, m->nsensordata, m->nuserdata, sz};
+        memcpy(header, sizes, 7*sizeof(int));
+        memcpy(header+7*sizeof(int), m->names, sz);
+
+        // record layout per stream: time, then the stream's fields (see parse_mjl.py)
+        int nstream = (int)logStreams.size();
+        logPackers.assign(nstream, mjlPacker());
+        for( int s=0; s<nstream; s++ )
+        {
+            logPackers[s].add(&d->time, 1);
+            for( int i=0; i<logStreams[s].nfield; i++ )
+            {
+                if( logStreams[s].field[i]>=mjlNDATAFIELD )
+                    logStreams[s].size[i] = size_logField(m, logStreams[s].field[i]);
+                add_logField(logPackers[s], m, d, logStreams[s].field[i]);
+            }
+        }
+        logStep = 0;
 
-        initFlag = false;
+        bool ok;
+        if( plain )
+            ok = logWriter.open(logName, header, headersz, logPackers[0].size(),
+                                opt->logSlots, chunk, mjMAX(0, opt->logSync));
+        else
+            ok = logWriter.open(logName, header, headersz, logStreams,
+                                opt->logSlots, chunk, mjMAX(0, opt->logSync));
+        mju_free(header);
+        if( !ok )
+            return;
     }
 
-	// close if requested
-	if(closeFile)
-	{	
-        if(logfile!=nullptr)
-			fclose(logfile);
+    if( opt->logSession )
+        sample_session();
 
-        mju_free(writebuf);
-        writebuf = nullptr;
-        logfile = nullptr;
-        initFlag = true;
+    // every stream due at this step; event streams (reset) when the log opens and
+    // after every scene reset, so that replay restarts from the reset state
+    for( int s=0; s<(int)logPackers.size(); s++ )
+    {
+        int dec = logStreams[s].decimation;
+        if( dec ? logStep%dec : (logStep && !logReset) )
+            continue;
+        logSession.step = (mjtNum)logStep;
 
-		return;
-	}
+        // prepare float record directly in the ring slot (dropped and counted if the ring is full)
+        float* writebuf = logWriter.acquire(false, s);
+        if( !writebuf )
+            continue;
 
-    // prepare float buffer
-    
-    writebuf[0] = (float)d->time;
-    int wpos = 1;
-    wpos += num2float(writebuf + wpos, d->qpos, m->nq);
-    wpos += num2float(writebuf + wpos, d->qvel, m->nv);
-    wpos += num2float(writebuf + wpos, d->ctrl, m->nu);
-    wpos += num2float(writebuf + wpos, d->mocap_pos, 3 * m->nmocap);
-    wpos += num2float(writebuf + wpos, d->mocap_quat, 4 * m->nmocap);
-    wpos += num2float(writebuf + wpos, d->sensordata, m->nsensordata);
-    wpos += num2float(writebuf + wpos, d->userdata, m->nuserdata);
-
-    // write buffer to file
-    fwrite((void*)writebuf, sizeof(float), wpos, logfile);
+        logPackers[s].pack(writebuf);
+
+        // hand over to the writer thread
+        logWriter.commit();
+    }
+    logReset = false;
+    logStep++;
 }
 
 // configure devices
@@ -1162,6 +1323,7 @@ char* help = {
 	"Usage:\n"
 	"\t\t (1) puppet.exe <model_file> (<log_name>)\n"
 	"\t\t (2) puppet.exe <config_file>\n"
+	"\t\t (3) puppet.exe replay <model_file> <session.mjc>\n"
 	"-----------------------------------------------------------------\n\n"
 };
 
@@ -1169,7 +1331,12 @@ char* help = {
 // Close and clean up -------------------------------
 void closenclear()
 {
-    // close logs and save models
+    // close logs that are still being recorded (session logs are not closed by
+    // resets), save their models
+    if( logWriter.isOpen() )
+        close_logs(m, d);
+
+    // reset (user requests on reset)
     mj_resetData(m, d);
     mj_forward(m, d);
     user_step(m, d);
@@ -1180,6 +1347,7 @@ void closenclear()
 
 	if(opt->USEGLOVE)
 		cGlove_clean(NULL);
+	free(gloveSample);
 }
 
 
@@ -1188,12 +1356,15 @@ void closenclear()
 void physics(bool& run)
 {
     printf("Physics thread started\n");
+    mjTimerThreadName("physics");
     
-    double stepTimeStamp = glfwGetTime();
+    double stepTimeStamp = mjTimeSec();
     double stepDuration = 0.0;
     double stepLeft = 0.0;
     while(run)
     {   
+        mjTIMER("physics loop");
+
         // process reset:: resets the scene and clearns controller states
         if(reset_request)
         {
@@ -1201,6 +1372,7 @@ void physics(bool& run)
             trackMocap[0] = false;
             trackMocap[1] = false;
             reset_request = false;
+            logReset = true;    // recorded by write_logs, after user_step's on_reset requests
         }
         
         // Refresh tracking data respecting skip
@@ -1208,7 +1380,7 @@ void physics(bool& run)
         if((int)(float)(d->time/m->opt.timestep)%opt->skip==0)
         {
             // begin step
-            stepTimeStamp = glfwGetTime();
+            stepTimeStamp = mjTimeSec();
 
             // apply controller perturbations
             mju_zero(d->xfrc_applied, 6*m->nbody);
@@ -1230,9 +1402,12 @@ void physics(bool& run)
                     user_perturbations(n);
                 }
             
-            // get glove demands
+            // get glove demands (kept for the session log)
             if(opt->USEGLOVE)
+            {
                 cGlove_getData(d->ctrl, m->nu);
+                mju_copy(gloveSample, d->ctrl, mjMIN(m->nu, opt->calibSenor_n));
+            }
         }
 
         // user requests
@@ -1243,10 +1418,13 @@ void physics(bool& run)
             write_logs(m, d, opt->logFile);
 
         // simulate
-        mj_step(m, d);
+        {
+            mjTIMER("mj_step");
+            mj_step(m, d);
+        }
 
         // real time sync
-        stepDuration = glfwGetTime() - stepTimeStamp;
+        stepDuration = mjTimeSec() - stepTimeStamp;
         stepLeft = 1000.0*(m->opt.timestep-stepDuration);
 
         if(stepLeft>=1.0)
@@ -1256,11 +1434,65 @@ void physics(bool& run)
 }
 
 
+// headless replay of a session log: reset to the recorded state, apply the recorded
+// inputs step by step, compare with the recorded qpos/qvel; return 0 if identical
+int replay(const char* modelfile, const char* logfile)
+{
+    if( !activateMuJoCo() )
+        return 1;
+    char error[1000] = "Could not load binary model";
+    if( strlen(modelfile)>4 && !strcmp(modelfile+strlen(modelfile)-4, ".mjb") )
+		m = mj_loadModel(modelfile, NULL);
+    else
+        m = mj_loadXML(modelfile, NULL, error, 1000);
+    if( !m )
+    {
+        printf("%s\n", error);
+        return 1;
+    }
+
+    mjlReader log;
+    if( !log.open(logfile) )
+        return 1;
+
+    mjlCheck res;
+    double tm = mjTimeSec();
+    bool ok = mjl_check(m, log, &res);
+    tm = mjTimeSec() - tm;
+    if( ok && !res.exact )
+    {
+        ok = false;
+        snprintf(res.message, sizeof(res.message), "not a session log (logSession = true), use logcheck");
+    }
+    if( res.message[0] )
+        printf("%s: %s\n", logfile, res.message);
+
+    if( ok )
+    {
+        printf("Replayed %lld steps (%.2f sec sim) in %.2f sec\n", res.nstep, res.nstep*m->opt.timestep, tm);
+        if( res.ndiffer )
+            printf("DIVERGED: %lld of %lld logged states differ, first at step %lld, max |qpos error| %g\n",
+                   res.ndiffer, res.ncompared, res.first, res.qpos);
+        else
+            printf("Identical: %lld logged states match\n", res.ncompared);
+    }
+
+    log.close();
+    mj_deleteModel(m);
+    mj_deactivate();
+    return (ok && !res.ndiffer ? 0 : 1);
+}
+
+
 // main
 int main(int argc, char** argv)
 {
 	printf("%s", help);
 
+    // headless replay of a session log
+    if( argc==4 && !strcmp(argv[1], "replay") )
+        return replay(argv[2], argv[3]);
+
     // get options from command line or iteractively ---
 	char config_filename[100];
 	char log_filename[100];
@@ -1291,7 +1523,10 @@ int main(int argc, char** argv)
 		
 	// init ----------------------------------------
 	if(opt->USEGLOVE)
+	{
 		cGlove_init(opt);
+		gloveSample = (mjtNum*)calloc(opt->calibSenor_n, sizeof(mjtNum));
+	}
 
     // pre-initialize vr ----------------------------------
     v_initPre();
@@ -1318,9 +1553,12 @@ int main(int argc, char** argv)
     std::thread ph_thread(physics, std::ref(run)); // pass by reference
 
     double frameduration = 0.0;
-    double lasttm = glfwGetTime(), FPS = 90;
+    double lasttm = mjTimeSec(), FPS = 90;
+    mjTimerThreadName("render");
     while( !glfwWindowShouldClose(window) )
     {
+        mjTIMER("render frame");
+
         // create abstract scene
         mjv_updateScene(m, d, &vopt, NULL, NULL, mjCAT_ALL, &scn);
 
@@ -1333,9 +1571,9 @@ int main(int argc, char** argv)
         mjr_render(viewFull, &scn, &con);
 
         // show FPS (window only, hmd clips it)
-        frameduration = glfwGetTime() - lasttm;
+        frameduration = mjTimeSec() - lasttm;
         FPS = 0.9*FPS + 0.1/frameduration;
-        lasttm = glfwGetTime();
+        lasttm = mjTimeSec();
 
         // real time sync
         std::this_thread::sleep_for(std::chrono::milliseconds(int(1000*(1.0/FPS-frameduration))));
@@ -1356,6 +1594,7 @@ int main(int argc, char** argv)
 	printf("Main:>\t Done\n");
 
 	closenclear();
+	mjTimerReport();
 	Sleep(1000);
     return 1;
 }